@@ -5,4 +5,5 @@
 
 bool wifi_start(const char* hostname, const uint32_t conn_timeout_ms);
 void wifi_stop(void);
+void wifi_set_power_save(bool enable);
 // TODO: Support forcing to override credentials already stored in NVS
\ No newline at end of file
@@ -24,11 +24,22 @@ static const char *SEPARATORS = " \t\n\r";
 extern const uint8_t wifi_credentials_start[] asm("_binary_" CONFIG_WIFI_HELPER_CREDENTIALS_SYMBOL "_start");
 extern const uint8_t wifi_credentials_end[] asm("_binary_" CONFIG_WIFI_HELPER_CREDENTIALS_SYMBOL "_end");
 
+#define AP_CACHE_MAGIC 0x41504331      /* "APC1" */
+
 static char *wifi_hostname = NULL;
 static esp_netif_t *sta_netif;
 static SemaphoreHandle_t s_semph_get_ip_addrs;
 bool credentials_set;
 
+/* the access point last associated with, kept across software resets */
+static RTC_NOINIT_ATTR struct
+{
+    uint32_t magic;
+    uint8_t bssid[6];
+    uint8_t channel;
+} ap_cache;
+static bool connecting_to_cached_ap = false;
+
 
 static inline char *terminated_strncpy(char *dest, size_t dest_max, const char *src, size_t src_len)
 {
@@ -140,7 +151,50 @@ static void set_wifi_credentials()
     wifi_config.sta.threshold.authmode = WIFI_AUTH_WPA2_PSK;    // require WPA2 minimum
 
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+    ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_FLASH));
     ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_config));
+    ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_RAM));
+}
+
+
+/**
+ * Connect to the access point of the last association directly, skipping
+ * the scan of all channels, or scan if there is none (or it failed). The
+ * BSSID and channel are only set in RAM, the stored credentials stay as
+ * they are.
+ */
+static void connect_to_ap()
+{
+    wifi_config_t config = {};
+    if (esp_wifi_get_config(ESP_IF_WIFI_STA, &config) == ESP_OK)
+    {
+        connecting_to_cached_ap = (ap_cache.magic == AP_CACHE_MAGIC);
+        config.sta.bssid_set = connecting_to_cached_ap;
+        if (connecting_to_cached_ap)
+        {
+            memcpy(config.sta.bssid, ap_cache.bssid, sizeof(config.sta.bssid));
+            config.sta.channel = ap_cache.channel;
+        }
+        else
+        {
+            config.sta.channel = 0;
+        }
+        (void) esp_wifi_set_config(ESP_IF_WIFI_STA, &config);
+    }
+    esp_wifi_connect();
+}
+
+
+static void update_ap_cache()
+{
+    wifi_ap_record_t ap_info;
+    if (esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK)
+    {
+        memcpy(ap_cache.bssid, ap_info.bssid, sizeof(ap_cache.bssid));
+        ap_cache.channel = ap_info.primary;
+        ap_cache.magic = AP_CACHE_MAGIC;
+    }
+    connecting_to_cached_ap = false;
 }
 
 
@@ -154,7 +208,7 @@ static void wifi_event_handler_start(void* arg, esp_event_base_t event_base,
     {
         if (event_id == WIFI_EVENT_STA_START)
         {
-            esp_wifi_connect();
+            connect_to_ap();
         }
     }
 }
@@ -169,7 +223,13 @@ static void wifi_event_handler_reconnect(void* arg, esp_event_base_t event_base,
         {
             const char *note = "";
             bool *credentials_set = (bool *) arg;
-            if (!*credentials_set)
+            if (connecting_to_cached_ap)
+            {
+                /* the access point moved or is gone -> scan again */
+                ap_cache.magic = 0;
+                note = " after a scan";
+            }
+            else if (!*credentials_set)
             {
                 /* if authentication fails, try to reauthenticate with updated credentials */
                 set_wifi_credentials();
@@ -177,7 +237,7 @@ static void wifi_event_handler_reconnect(void* arg, esp_event_base_t event_base,
                 note = " with updated credentials";
             }
             ESP_LOGI(TAG, "WIFI disconnected, reconnecting%s...", note);
-            esp_wifi_connect();
+            connect_to_ap();
         }
     }
 }
@@ -192,6 +252,7 @@ static void wifi_event_handler_got_ip(void* arg, esp_event_base_t event_base,
         {
             ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
             ESP_LOGI(TAG, "Got IP address: " IPSTR, IP2STR(&event->ip_info.ip));
+            update_ap_cache();
             if (s_semph_get_ip_addrs)
             {
                 xSemaphoreGive(s_semph_get_ip_addrs);
@@ -218,6 +279,8 @@ bool wifi_start(const char* hostname, const uint32_t conn_timeout_ms)
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
 
+    // the BSSID and channel of the cached access point must not be written to flash
+    ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_RAM));
     credentials_set = false;
     if (!has_sta_configured())
     {
@@ -255,6 +318,20 @@ bool wifi_start(const char* hostname, const uint32_t conn_timeout_ms)
 }
 
 
+/**
+ * Switch between modem sleep (the default) and keeping the radio on for the
+ * lowest latency.
+ */
+void wifi_set_power_save(bool enable)
+{
+    esp_err_t err = esp_wifi_set_ps(enable ? WIFI_PS_MIN_MODEM : WIFI_PS_NONE);
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Cannot set power save mode: %s", esp_err_to_name(err));
+    }
+}
+
+
 void wifi_stop(void)
 {
     ESP_ERROR_CHECK(esp_event_handler_unregister(IP_EVENT, IP_EVENT_STA_GOT_IP,
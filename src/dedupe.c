@@ -0,0 +1,158 @@
+#include <string.h>
+
+#include "sdkconfig.h"
+
+#include "dedupe.h"
+
+#ifdef CONFIG_SYSLOG_DEDUPE
+
+#define DEDUPE_WINDOW pdMS_TO_TICKS(CONFIG_SYSLOG_DEDUPE_WINDOW_MS)
+
+#define min(a,b) \
+   ({ __typeof__ (a) _a = (a); \
+       __typeof__ (b) _b = (b); \
+     _a < _b ? _a : _b; })
+
+
+/* FNV-1a over both segments of the span */
+static uint32_t span_hash(const line_span_t *span)
+{
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < 2; i++)
+    {
+        const uint8_t *p = (const uint8_t *)span->seg[i];
+        for (size_t n = span->len[i]; n > 0; n--)
+        {
+            hash = (hash ^ *p++) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+
+/* compare the sample of an entry with the start of the span */
+static bool sample_matches(const dedupe_entry_t *entry, const line_span_t *span)
+{
+    const size_t first = min(span->len[0], sizeof(entry->sample));
+    const size_t second = min(span->len[1], sizeof(entry->sample) - first);
+    return (memcmp(entry->sample, span->seg[0], first) == 0) &&
+           ((second == 0) || (memcmp(entry->sample + first, span->seg[1], second) == 0));
+}
+
+
+static inline bool entry_used(const dedupe_entry_t *entry)
+{
+    return entry->len > 0;
+}
+
+
+static inline bool entry_expired(const dedupe_entry_t *entry, TickType_t now)
+{
+    return (TickType_t)(now - entry->since) >= DEDUPE_WINDOW;
+}
+
+
+void dedupe_init(dedupe_t *dedupe)
+{
+    memset(dedupe, 0, sizeof(*dedupe));
+}
+
+
+/**
+ * Return true if the line repeats one sent within the window, counting it
+ * for the summary. A repeat has the same hash and length, and starts with the
+ * same DEDUPE_SAMPLE_LEN bytes as the sample. Bytes beyond the sample are only
+ * compared through the hash, so a collision can still suppress a different
+ * line of the same length and start. Otherwise remember the line, if there is
+ * a free entry.
+ * Expired entries must have been summarized before.
+ */
+bool dedupe_check(dedupe_t *dedupe, const line_record_t *record, TickType_t now)
+{
+    const size_t len = line_span_len(&record->span);
+    const uint32_t hash = span_hash(&record->span);
+    dedupe_entry_t *free_entry = NULL;
+
+    for (size_t i = 0; i < DEDUPE_ENTRIES; i++)
+    {
+        dedupe_entry_t *entry = &dedupe->entries[i];
+        if (!entry_used(entry) || (entry_expired(entry, now) && (entry->count == 0)))
+        {
+            free_entry = free_entry ? free_entry : entry;
+        }
+        else if ((entry->hash == hash) && (entry->len == min(len, (size_t)UINT16_MAX)) &&
+                 !entry_expired(entry, now) && sample_matches(entry, &record->span))
+        {
+            entry->count += 1;
+            entry->last_seq = record->seq;
+            entry->last_timestamp_us = record->timestamp_us;
+            dedupe->suppressed += 1;
+            return true;
+        }
+    }
+
+    if (free_entry)
+    {
+        const size_t first = min(record->span.len[0], sizeof(free_entry->sample));
+        free_entry->hash = hash;
+        free_entry->len = min(len, (size_t)UINT16_MAX);
+        free_entry->severity = record->severity;
+        free_entry->count = 0;
+        free_entry->since = now;
+        memset(free_entry->sample, 0, sizeof(free_entry->sample));
+        memcpy(free_entry->sample, record->span.seg[0], first);
+        if ((first < sizeof(free_entry->sample)) && (record->span.len[1] > 0))
+        {
+            memcpy(free_entry->sample + first, record->span.seg[1],
+                   min(record->span.len[1], sizeof(free_entry->sample) - first));
+        }
+    }
+    return false;
+}
+
+
+/**
+ * Take the next entry with repeats to summarize: those whose window expired,
+ * or all of them (before a different line is sent). Expired entries are
+ * forgotten, the others keep suppressing their line.
+ */
+bool dedupe_take_summary(dedupe_t *dedupe, TickType_t now, bool all, dedupe_entry_t *summary)
+{
+    for (size_t i = 0; i < DEDUPE_ENTRIES; i++)
+    {
+        dedupe_entry_t *entry = &dedupe->entries[i];
+        const bool expired = entry_expired(entry, now);
+        if (entry_used(entry) && (entry->count > 0) && (all || expired))
+        {
+            *summary = *entry;
+            entry->count = 0;
+            if (expired)
+            {
+                entry->len = 0;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * Return the time until the next summary is due.
+ */
+TickType_t dedupe_poll(const dedupe_t *dedupe, TickType_t now)
+{
+    TickType_t wait = portMAX_DELAY;
+    for (size_t i = 0; i < DEDUPE_ENTRIES; i++)
+    {
+        const dedupe_entry_t *entry = &dedupe->entries[i];
+        if (entry_used(entry) && (entry->count > 0))
+        {
+            const TickType_t age = now - entry->since;
+            wait = min(wait, (age < DEDUPE_WINDOW) ? DEDUPE_WINDOW - age : 0);
+        }
+    }
+    return wait;
+}
+
+#endif
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "line_queue.h"
+
+#define DEDUPE_ENTRIES 8
+#define DEDUPE_SAMPLE_LEN 48
+
+/* a recently sent line and the number of its suppressed repeats */
+typedef struct
+{
+    uint32_t hash;
+    uint16_t len;
+    uint8_t severity;
+    uint32_t count;         /* repeats since sent or last summarized */
+    uint32_t last_seq;      /* sequence number of the last repeat */
+    int64_t last_timestamp_us;
+    TickType_t since;       /* when the line was sent */
+    char sample[DEDUPE_SAMPLE_LEN];
+} dedupe_entry_t;
+
+/**
+ * Fingerprints of the lines sent by one source within the window. Lines
+ * repeating one of them are suppressed and later summarized.
+ */
+typedef struct
+{
+    dedupe_entry_t entries[DEDUPE_ENTRIES];
+    uint32_t suppressed;    /* total number of suppressed lines */
+} dedupe_t;
+
+void dedupe_init(dedupe_t *dedupe);
+
+bool dedupe_check(dedupe_t *dedupe, const line_record_t *record, TickType_t now);
+
+bool dedupe_take_summary(dedupe_t *dedupe, TickType_t now, bool all, dedupe_entry_t *summary);
+
+TickType_t dedupe_poll(const dedupe_t *dedupe, TickType_t now);
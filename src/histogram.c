@@ -0,0 +1,52 @@
+#include <string.h>
+
+#include "histogram.h"
+
+
+void histogram_add(histogram_t *histogram, uint32_t value)
+{
+    unsigned int bucket = (value == 0) ? 0 : 32 - __builtin_clz(value);
+    if (bucket >= HISTOGRAM_BUCKETS)
+    {
+        bucket = HISTOGRAM_BUCKETS - 1;
+    }
+    histogram->count[bucket] += 1;
+    histogram->total += 1;
+}
+
+
+/**
+ * Return the exclusive upper bound of a bucket. The last bucket also holds
+ * all larger values, its bound saturates.
+ */
+uint32_t histogram_bucket_bound(unsigned int bucket)
+{
+    return (bucket >= HISTOGRAM_BUCKETS - 1) ? UINT32_MAX : (uint32_t)1 << bucket;
+}
+
+
+/**
+ * Return the exclusive upper bound of the bucket holding the given
+ * percentile, i.e. the percentile is below it, or 0 if the histogram is
+ * empty.
+ */
+uint32_t histogram_percentile(const histogram_t *histogram, unsigned int percent)
+{
+    const uint64_t rank = ((uint64_t)histogram->total * percent + 99) / 100;
+    uint64_t sum = 0;
+    for (unsigned int bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++)
+    {
+        sum += histogram->count[bucket];
+        if ((sum >= rank) && (sum > 0))
+        {
+            return histogram_bucket_bound(bucket);
+        }
+    }
+    return 0;
+}
+
+
+void histogram_reset(histogram_t *histogram)
+{
+    memset(histogram, 0, sizeof(*histogram));
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+
+#define HISTOGRAM_BUCKETS 32
+
+/**
+ * Histogram with power-of-two buckets: bucket i counts values in
+ * [2^(i-1), 2^i), bucket 0 counts zeros.
+ */
+typedef struct
+{
+    uint32_t count[HISTOGRAM_BUCKETS];
+    uint32_t total;
+} histogram_t;
+
+void histogram_add(histogram_t *histogram, uint32_t value);
+
+uint32_t histogram_bucket_bound(unsigned int bucket);
+
+uint32_t histogram_percentile(const histogram_t *histogram, unsigned int percent);
+
+void histogram_reset(histogram_t *histogram);
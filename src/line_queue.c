@@ -0,0 +1,84 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "line_queue.h"
+
+
+/**
+ * Set up a queue of count slots, or of slots allocated from the heap if
+ * slots is NULL.
+ */
+bool line_queue_init(line_queue_t *queue, line_record_t *slots, size_t count)
+{
+    if ((count == 0) || ((count & (count - 1)) != 0))
+    {
+        return false;
+    }
+    queue->slots = slots ? slots : (line_record_t *)calloc(count, sizeof(line_record_t));
+    if (queue->slots == NULL)
+    {
+        return false;
+    }
+    queue->mask = count - 1;
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    queue->high_water = 0;
+    return true;
+}
+
+
+bool line_queue_full(line_queue_t *queue)
+{
+    const size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    const size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    return (head - tail) > queue->mask;
+}
+
+
+/**
+ * Producer side: append a record. The release store publishes both the slot
+ * and the line data it points to.
+ */
+bool line_queue_push(line_queue_t *queue, const line_record_t *record)
+{
+    const size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    const size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    const size_t depth = head - tail;
+    if (depth > queue->mask)
+    {
+        return false;
+    }
+    queue->slots[head & queue->mask] = *record;
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    if (depth + 1 > queue->high_water)
+    {
+        queue->high_water = depth + 1;
+    }
+    return true;
+}
+
+
+/**
+ * Consumer side: return the oldest record without removing it, or NULL if the
+ * queue is empty.
+ */
+const line_record_t *line_queue_front(line_queue_t *queue)
+{
+    const size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    const size_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    return (head != tail) ? &queue->slots[tail & queue->mask] : NULL;
+}
+
+
+void line_queue_pop(line_queue_t *queue)
+{
+    const size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+}
+
+
+size_t line_queue_depth(line_queue_t *queue)
+{
+    return atomic_load_explicit(&queue->head, memory_order_relaxed) -
+           atomic_load_explicit(&queue->tail, memory_order_relaxed);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+#include "line_ring.h"
+
+/**
+ * A queued line: its span in the line ring and the metadata captured with it.
+ */
+typedef struct
+{
+    line_span_t span;
+    int64_t timestamp_us;   /* capture time, 0 if unknown */
+    uint32_t seq;           /* per-source sequence number */
+    uint8_t severity;       /* syslog severity of the line */
+    uint32_t fragment_id;   /* sequence number of the first part of a split line */
+    bool partial;           /* the line was incomplete when the input went idle */
+#ifdef CONFIG_SYSLOG_TRACE
+    uint32_t queued_us;     /* esp_timer time it was queued */
+#endif
+} line_record_t;
+
+/**
+ * Lock-free single-producer/single-consumer queue of framed lines. The
+ * producer (capture task) pushes records of lines in its line ring, the
+ * consumer (sender task) sends them and releases the ring space again. The
+ * number of slots must be a power of two.
+ */
+typedef struct
+{
+    line_record_t *slots;
+    size_t mask;
+    atomic_size_t head;     /* written by the producer only */
+    atomic_size_t tail;     /* written by the consumer only */
+    size_t high_water;      /* maximum depth seen by the producer */
+} line_queue_t;
+
+bool line_queue_init(line_queue_t *queue, line_record_t *slots, size_t count);
+
+bool line_queue_full(line_queue_t *queue);
+
+bool line_queue_push(line_queue_t *queue, const line_record_t *record);
+
+const line_record_t *line_queue_front(line_queue_t *queue);
+
+void line_queue_pop(line_queue_t *queue);
+
+size_t line_queue_depth(line_queue_t *queue);
@@ -0,0 +1,241 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "line_ring.h"
+
+#define LINE_DELIMITER '\n'
+
+#define min(a,b) \
+   ({ __typeof__ (a) _a = (a); \
+       __typeof__ (b) _b = (b); \
+     _a < _b ? _a : _b; })
+
+
+/**
+ * Set up a ring of size bytes in buf, or in a buffer allocated from the heap
+ * if buf is NULL.
+ */
+bool line_ring_init(line_ring_t *ring, char *buf, size_t size)
+{
+    /* size must be a power of two for masking the free-running positions */
+    if ((size == 0) || ((size & (size - 1)) != 0))
+    {
+        return false;
+    }
+    memset(ring, 0, sizeof(*ring));
+    ring->buf = buf ? buf : (char *)malloc(size);
+    if (ring->buf == NULL)
+    {
+        return false;
+    }
+    ring->mask = size - 1;
+    atomic_init(&ring->tail, 0);
+    return true;
+}
+
+
+/**
+ * Return the position and length of the largest contiguous free region,
+ * e.g. for reading from the UART driver directly into the ring.
+ */
+char *line_ring_write_ptr(line_ring_t *ring, size_t *avail)
+{
+    const size_t size = ring->mask + 1;
+    const size_t offset = ring->head & ring->mask;
+    const size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    *avail = min(size - (ring->head - tail), size - offset);
+    return ring->buf + offset;
+}
+
+
+void line_ring_commit(line_ring_t *ring, size_t len)
+{
+    ring->head += len;
+}
+
+
+static void line_ring_make_span(const line_ring_t *ring, size_t start, size_t len,
+                                size_t next, line_span_t *span)
+{
+    const size_t offset = start & ring->mask;
+    const size_t first = min(len, ring->mask + 1 - offset);
+
+    span->seg[0] = ring->buf + offset;
+    span->len[0] = first;
+    span->seg[1] = ring->buf;
+    span->len[1] = len - first;
+    span->next = next;
+    span->part = 0;
+    span->more = false;
+}
+
+
+/**
+ * Frame the next complete line. Only bytes not searched before are examined,
+ * and lines exceeding max_len are split into numbered parts. Trailing
+ * carriage returns are not part of the returned span.
+ */
+bool line_ring_next_line(line_ring_t *ring, size_t max_len, line_span_t *span)
+{
+    for (;;)
+    {
+        const size_t line_len = ring->scan - ring->line_start;
+        if (line_len > max_len)
+        {
+            /* no delimiter within max_len bytes -> emit a fragment */
+            const size_t next = ring->line_start + max_len;
+            line_ring_make_span(ring, ring->line_start, max_len, next, span);
+            if (ring->part == 0)
+            {
+                ring->split_count += 1;
+            }
+            ring->part = (ring->part < UINT16_MAX - 1) ? ring->part + 1 : 1;
+            span->part = ring->part;
+            span->more = true;
+            ring->line_start = next;
+            ring->scan = next;
+            return true;
+        }
+        if (ring->scan == ring->head)
+        {
+            return false;
+        }
+
+        /* search up to the end of the data, the end of the buffer, or one
+           byte past max_len (which may still be the delimiter) */
+        const size_t offset = ring->scan & ring->mask;
+        const size_t n = min(min(ring->head - ring->scan, ring->mask + 1 - offset),
+                             max_len + 1 - line_len);
+        const char *found = memchr(ring->buf + offset, LINE_DELIMITER, n);
+        if (found)
+        {
+            const size_t eol = ring->scan + (size_t)(found - (ring->buf + offset));
+            size_t len = eol - ring->line_start;
+            while ((len > 0) && (ring->buf[(ring->line_start + len - 1) & ring->mask] == '\r'))
+            {
+                len -= 1;
+            }
+            line_ring_make_span(ring, ring->line_start, len, eol + 1, span);
+            if (ring->part > 0)
+            {
+                /* the last part of a split line */
+                span->part = ring->part + 1;
+                ring->part = 0;
+            }
+            ring->line_start = eol + 1;
+            ring->scan = eol + 1;
+            return true;
+        }
+        ring->scan += n;
+    }
+}
+
+
+/**
+ * Frame the bytes received so far of an incomplete line as its next part,
+ * e.g. a prompt which is not followed by a delimiter for a while. The rest
+ * of the line follows as further parts, the last one possibly empty.
+ */
+bool line_ring_next_partial(line_ring_t *ring, line_span_t *span)
+{
+    const size_t len = ring->head - ring->line_start;
+    if (len == 0)
+    {
+        return false;
+    }
+    line_ring_make_span(ring, ring->line_start, len, ring->head, span);
+    ring->part = (ring->part < UINT16_MAX - 1) ? ring->part + 1 : 1;
+    span->part = ring->part;
+    span->more = true;
+    ring->line_start = ring->head;
+    ring->scan = ring->head;
+    return true;
+}
+
+
+/**
+ * Give the last len bytes of the part just framed back to the ring, so that
+ * they start the next part instead, e.g. a character which was cut in half.
+ * Returns false if nothing was left of the part, which is then not framed at
+ * all.
+ */
+bool line_ring_carry(line_ring_t *ring, line_span_t *span, size_t len)
+{
+    const size_t from_second = min(len, span->len[1]);
+    span->len[1] -= from_second;
+    span->len[0] -= len - from_second;
+    span->next -= len;
+    ring->line_start -= len;
+    ring->scan = ring->line_start;
+    if (line_span_len(span) == 0)
+    {
+        ring->part = span->part - 1;
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * Frame the next chunk of raw bytes without looking for delimiters: max_len
+ * bytes as soon as they were received, or all remaining bytes if flush is
+ * set (e.g. after the input went idle).
+ */
+bool line_ring_next_chunk(line_ring_t *ring, size_t max_len, bool flush, line_span_t *span)
+{
+    const size_t pending = ring->head - ring->line_start;
+    if ((pending == 0) || ((pending < max_len) && !flush))
+    {
+        return false;
+    }
+    const size_t len = min(pending, max_len);
+    line_ring_make_span(ring, ring->line_start, len, ring->line_start + len, span);
+    ring->line_start += len;
+    ring->scan = ring->line_start;
+    return true;
+}
+
+
+/**
+ * Number of received bytes not framed yet.
+ */
+size_t line_ring_pending(const line_ring_t *ring)
+{
+    return ring->head - ring->line_start;
+}
+
+
+/**
+ * Wrap a text which is not stored in the ring (e.g. a status marker) into a
+ * span, so that it can be queued in order with the framed lines. Releasing
+ * it only frees the lines framed before.
+ */
+void line_ring_text_span(const line_ring_t *ring, const char *text, line_span_t *span)
+{
+    span->seg[0] = text;
+    span->len[0] = strlen(text);
+    span->seg[1] = NULL;
+    span->len[1] = 0;
+    span->next = ring->line_start;
+    span->part = 0;
+    span->more = false;
+}
+
+
+/**
+ * Give the space occupied by the span (and all lines before it) back to the
+ * producer.
+ */
+void line_ring_release(line_ring_t *ring, const line_span_t *span)
+{
+    atomic_store_explicit(&ring->tail, span->next, memory_order_release);
+}
+
+
+/**
+ * Number of bytes currently held (as seen by the producer).
+ */
+size_t line_ring_fill(line_ring_t *ring)
+{
+    return ring->head - atomic_load_explicit(&ring->tail, memory_order_relaxed);
+}
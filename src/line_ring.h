@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A line span references one framed line inside a line ring. If the line
+ * wraps around the end of the ring, the second segment holds the remainder,
+ * otherwise its length is zero. Lines exceeding the maximum length are
+ * framed as numbered parts.
+ */
+typedef struct
+{
+    const char *seg[2];
+    size_t len[2];
+    size_t next;        /* ring position right after the line (incl. delimiter) */
+    uint16_t part;      /* 1-based part number of a split line, 0 if complete */
+    bool more;          /* further parts of the line follow */
+} line_span_t;
+
+/**
+ * Byte ring buffer which is filled directly from the UART driver and framed
+ * into lines in place. All positions are free-running and masked on access,
+ * so the ring size must be a power of two. Filling and framing belong to the
+ * producer, releasing may happen from another task.
+ */
+typedef struct
+{
+    char *buf;
+    size_t mask;
+    size_t head;        /* bytes written by the producer */
+    atomic_size_t tail; /* bytes released by the consumer */
+    size_t scan;        /* bytes already searched for a delimiter */
+    size_t line_start;  /* start of the line currently being framed */
+    size_t split_count; /* lines split for exceeding the maximum length */
+    uint16_t part;      /* parts framed of the current line so far */
+} line_ring_t;
+
+bool line_ring_init(line_ring_t *ring, char *buf, size_t size);
+
+char *line_ring_write_ptr(line_ring_t *ring, size_t *avail);
+
+void line_ring_commit(line_ring_t *ring, size_t len);
+
+bool line_ring_next_line(line_ring_t *ring, size_t max_len, line_span_t *span);
+
+bool line_ring_next_partial(line_ring_t *ring, line_span_t *span);
+
+bool line_ring_carry(line_ring_t *ring, line_span_t *span, size_t len);
+
+bool line_ring_next_chunk(line_ring_t *ring, size_t max_len, bool flush, line_span_t *span);
+
+size_t line_ring_pending(const line_ring_t *ring);
+
+void line_ring_text_span(const line_ring_t *ring, const char *text, line_span_t *span);
+
+void line_ring_release(line_ring_t *ring, const line_span_t *span);
+
+size_t line_ring_fill(line_ring_t *ring);
+
+static inline size_t line_span_len(const line_span_t *span)
+{
+    return span->len[0] + span->len[1];
+}
@@ -0,0 +1,145 @@
+#include <string.h>
+
+#include "lz4_block.h"
+
+/* see https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md */
+#define MIN_MATCH 4
+#define LAST_LITERALS 5         /*!< the last bytes are always literals */
+#define MF_LIMIT 12             /*!< the last match starts before this */
+
+#define min(a,b) \
+   ({ __typeof__ (a) _a = (a); \
+       __typeof__ (b) _b = (b); \
+     _a < _b ? _a : _b; })
+
+
+static inline uint32_t read32(const uint8_t *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+
+static inline uint32_t hash32(uint32_t value)
+{
+    return (value * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+
+/* bytes needed for a length field continuing a token nibble */
+static inline size_t length_size(size_t len)
+{
+    return (len >= 15) ? (len - 15) / 255 + 1 : 0;
+}
+
+
+static inline uint8_t *write_length(uint8_t *op, size_t len)
+{
+    if (len >= 15)
+    {
+        len -= 15;
+        while (len >= 255)
+        {
+            *op++ = 255;
+            len -= 255;
+        }
+        *op++ = (uint8_t)len;
+    }
+    return op;
+}
+
+
+/**
+ * Emit one sequence: literals, followed by a match unless match_len is 0.
+ * Returns NULL if the output would exceed end.
+ */
+static uint8_t *write_sequence(uint8_t *op, const uint8_t *end, const uint8_t *literals,
+                               size_t literal_len, size_t offset, size_t match_len)
+{
+    const size_t ml = (match_len > 0) ? match_len - MIN_MATCH : 0;
+    const size_t needed = 1 + length_size(literal_len) + literal_len +
+                          ((match_len > 0) ? 2 + length_size(ml) : 0);
+    if (needed > (size_t)(end - op))
+    {
+        return NULL;
+    }
+    *op++ = (uint8_t)((min(literal_len, (size_t)15) << 4) | min(ml, (size_t)15));
+    op = write_length(op, literal_len);
+    memcpy(op, literals, literal_len);
+    op += literal_len;
+    if (match_len > 0)
+    {
+        *op++ = (uint8_t)offset;
+        *op++ = (uint8_t)(offset >> 8);
+        op = write_length(op, ml);
+    }
+    return op;
+}
+
+
+/**
+ * Compress src into one raw LZ4 block using a greedy single-probe match
+ * finder. Returns the compressed size, or 0 if it would exceed capacity (so
+ * passing capacity < len only accepts results which save space). Stale table
+ * entries from previous calls need no reset, since every candidate is
+ * verified against the current input.
+ */
+size_t lz4_compress_block(lz4_state_t *state, const char *src, size_t len, char *dst, size_t capacity)
+{
+    const uint8_t *base = (const uint8_t *)src;
+    uint8_t *op = (uint8_t *)dst;
+    const uint8_t *end = op + capacity;
+    size_t anchor = 0;
+
+    if (len > LZ4_MAX_INPUT_SIZE)
+    {
+        return 0;
+    }
+    if (len > MF_LIMIT)
+    {
+        const size_t match_start_limit = len - MF_LIMIT;
+        const size_t match_end_limit = len - LAST_LITERALS;
+        size_t ip = 0;
+        while (ip < match_start_limit)
+        {
+            const uint32_t sequence = read32(base + ip);
+            const uint32_t h = hash32(sequence);
+            size_t ref = state->table[h];
+            state->table[h] = (uint16_t)ip;
+            if ((ref >= ip) || (read32(base + ref) != sequence))
+            {
+                ip += 1;
+                continue;
+            }
+
+            /* extend the match backwards into the pending literals ... */
+            while ((ip > anchor) && (ref > 0) && (base[ip - 1] == base[ref - 1]))
+            {
+                ip -= 1;
+                ref -= 1;
+            }
+            /* ... and forwards */
+            size_t match_len = MIN_MATCH;
+            while ((ip + match_len < match_end_limit) && (base[ip + match_len] == base[ref + match_len]))
+            {
+                match_len += 1;
+            }
+
+            op = write_sequence(op, end, base + anchor, ip - anchor, ip - ref, match_len);
+            if (op == NULL)
+            {
+                return 0;
+            }
+            ip += match_len;
+            anchor = ip;
+            if (ip - 2 < match_start_limit)
+            {
+                state->table[hash32(read32(base + ip - 2))] = (uint16_t)(ip - 2);
+            }
+        }
+    }
+
+    op = write_sequence(op, end, base + anchor, len - anchor, 0, 0);
+    return (op != NULL) ? op - (uint8_t *)dst : 0;
+}
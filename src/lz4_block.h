@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LZ4_HASH_BITS 11
+#define LZ4_MAX_INPUT_SIZE 65535
+
+/* match finder state, 4 KB */
+typedef struct
+{
+    uint16_t table[1 << LZ4_HASH_BITS];
+} lz4_state_t;
+
+size_t lz4_compress_block(lz4_state_t *state, const char *src, size_t len, char *dst, size_t capacity);
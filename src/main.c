@@ -14,22 +14,51 @@
 #include "nvs.h"
 #include "nvs_flash.h"
 #include "esp_system.h"
+#include "esp_cpu.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "esp_wifi.h"
 
 #include "sdkconfig.h"
 #include "wifi_helper.h"
 #include "syslog_client.h"
+#include "syslog_sender.h"
+#include "sanitize.h"
+#include "severity.h"
+#include "static_mem.h"
+#include "timestamp.h"
+#include "trace.h"
 
 static const char *TAG = "uart_events";
 
 #define PATTERN_CHR        '\n'
 #define PATTERN_CHR_NUM    (1)         /*!< Set the number of consecutive and identical characters received by receiver which defines a UART pattern*/
 
-#define LINE_BUF_SIZE 200
-#define UART_BUF_SIZE (10 * 1024)
-#define UART_QUEUE_SIZE 100
+#define LINE_RING_SIZE CONFIG_SYSLOG_LINE_RING_SIZE     /*!< must be a power of two */
+#define LINE_QUEUE_SIZE CONFIG_SYSLOG_LINE_QUEUE_SIZE   /*!< must be a power of two */
+#define CAPTURE_TASK_PRIORITY (configMAX_PRIORITIES - 4)   /*!< right below esp_timer */
+#define CAPTURE_TASK_STACK_SIZE 3072
+#define PROCID_MAX_LEN 128             /*!< see RFC 5424 section 6 */
+#define RAW_CHUNK_LEN CONFIG_SYSLOG_MAX_LINE_LEN
+
+_Static_assert((LINE_RING_SIZE & (LINE_RING_SIZE - 1)) == 0, "SYSLOG_LINE_RING_SIZE must be a power of two");
+_Static_assert(LINE_RING_SIZE >= 2 * CONFIG_SYSLOG_MAX_LINE_LEN, "SYSLOG_LINE_RING_SIZE must hold two maximum length lines");
+_Static_assert((LINE_QUEUE_SIZE & (LINE_QUEUE_SIZE - 1)) == 0, "SYSLOG_LINE_QUEUE_SIZE must be a power of two");
+
+#if defined(CONFIG_SYSLOG_MESSAGE_FORMAT_RAW)
+#define IDLE_FLUSH_MS CONFIG_SYSLOG_RAW_IDLE_MS
+#elif defined(CONFIG_SYSLOG_IDLE_FLUSH)
+#define IDLE_FLUSH_MS CONFIG_SYSLOG_IDLE_FLUSH_MS
+#endif
+#define IDLE_FLUSH_TICKS max(pdMS_TO_TICKS(IDLE_FLUSH_MS), (TickType_t)1)
+
+#define TUNING_INTERVAL_MS 250
+#define TUNING_HOLD_MS 5000                    /*!< no raising for this long after an overflow */
+#define TUNING_MAX_RX_FULL_THRESHOLD (UART_RXFIFO_FULL_THRHD_V * 3 / 4)
+#define TUNING_MAX_RX_TIMEOUT 100
+#define TUNING_HIGH_LOAD_PERCENT 25
+#define TUNING_LOW_LOAD_PERCENT 5
 
 #define max(a,b) \
    ({ __typeof__ (a) _a = (a); \
@@ -41,14 +70,114 @@ static const char *TAG = "uart_events";
        __typeof__ (b) _b = (b); \
      _a < _b ? _a : _b; })
 
+/* driver and interrupt limits of one UART */
+typedef struct
+{
+    int buf_size;
+    int event_queue_size;
+    int pattern_queue_size;
+    uint8_t rx_full_threshold;
+    uint8_t rx_timeout;             /* in symbols */
+} uart_limits_t;
+
+/* state of the adaptive interrupt tuning */
+typedef struct
+{
+    uint8_t rx_full_threshold;
+    uint8_t rx_timeout;
+    uint32_t last_bytes;
+    TickType_t last_tick;
+    TickType_t hold_until;
+} uart_tuning_t;
+
+/* one entry of the source table */
+typedef struct
+{
+    const char *name;
+    uart_port_t uart_port;
+    int baud_rate;
+    int rx_pin;
+    const char *task_name;          /* PROCID of the syslog messages */
+    uart_limits_t limits;
+} uart_source_config_t;
+
+/* a UART being captured */
 typedef struct
 {
-    const char *syslog_task_name;
     uart_port_t uart_port;
+    int baud_rate;
+    uart_limits_t limits;
     QueueHandle_t uart_queue;
-} task_params_t;
+    uart_event_type_t last_event_type;
+    bool backlogged;                /* the sender is behind, retry draining */
+    syslog_source_t source;
+#ifdef CONFIG_SYSLOG_UART_ADAPTIVE
+    uart_tuning_t tuning;
+#endif
+#ifdef IDLE_FLUSH_MS
+    TickType_t last_rx_tick;        /* when the last bytes were read */
+    int64_t last_rx_us;             /* timestamp of the UART event delivering them */
+#endif
+} capture_t;
+
+/* all captured UARTs, as configured */
+static const uart_source_config_t uart_sources[] = {
+#ifdef CONFIG_SYSLOG_USE_UART1
+    {
+        .name = "uart1",
+        .uart_port = UART_NUM_1,
+        .baud_rate = CONFIG_SYSLOG_UART1_BAUD_RATE,
+        .rx_pin = CONFIG_SYSLOG_UART1_RX_PIN,
+        .task_name = CONFIG_SYSLOG_UART1_TASK_NAME,
+        .limits = {
+            .buf_size = CONFIG_SYSLOG_UART1_BUF_SIZE,
+            .event_queue_size = CONFIG_SYSLOG_UART1_EVENT_QUEUE_SIZE,
+            .pattern_queue_size = CONFIG_SYSLOG_UART1_PATTERN_QUEUE_SIZE,
+            .rx_full_threshold = CONFIG_SYSLOG_UART1_RX_FULL_THRESHOLD,
+            .rx_timeout = CONFIG_SYSLOG_UART1_RX_TIMEOUT,
+        },
+    },
+#endif
+#ifdef CONFIG_SYSLOG_USE_UART2
+    {
+        .name = "uart2",
+        .uart_port = UART_NUM_2,
+        .baud_rate = CONFIG_SYSLOG_UART2_BAUD_RATE,
+        .rx_pin = CONFIG_SYSLOG_UART2_RX_PIN,
+        .task_name = CONFIG_SYSLOG_UART2_TASK_NAME,
+        .limits = {
+            .buf_size = CONFIG_SYSLOG_UART2_BUF_SIZE,
+            .event_queue_size = CONFIG_SYSLOG_UART2_EVENT_QUEUE_SIZE,
+            .pattern_queue_size = CONFIG_SYSLOG_UART2_PATTERN_QUEUE_SIZE,
+            .rx_full_threshold = CONFIG_SYSLOG_UART2_RX_FULL_THRESHOLD,
+            .rx_timeout = CONFIG_SYSLOG_UART2_RX_TIMEOUT,
+        },
+    },
+#endif
+};
+
+#define UART_SOURCE_COUNT (sizeof(uart_sources) / sizeof(uart_sources[0]))
+
+static capture_t captures[SYSLOG_SENDER_MAX_SOURCES];
+static size_t capture_count = 0;
+static QueueSetHandle_t capture_queue_set = NULL;
 
-static char *app_name;
+#ifdef CONFIG_SYSLOG_STATIC_MEMORY
+/* the line buffers and headers of every configured source, and the capture task */
+static char line_rings[UART_SOURCE_COUNT][LINE_RING_SIZE];
+static line_record_t line_queues[UART_SOURCE_COUNT][LINE_QUEUE_SIZE];
+static char headers[UART_SOURCE_COUNT][SEVERITY_COUNT][SYSLOG_HEADER_MAX_LEN];
+static StackType_t capture_task_stack[CAPTURE_TASK_STACK_SIZE];
+static StaticTask_t capture_task_buffer;
+#endif
+
+static char app_name[sizeof(CONFIG_SYSLOG_APP_NAME)];
+
+#ifdef CONFIG_SYSLOG_TRACE
+/* cycle counts of the capture task: woken by a UART event, and the last read */
+static uint32_t trace_wakeup_cycles;
+static uint32_t trace_read_cycles;
+#endif
 
 // from https://stackoverflow.com/a/32496721
 static char* replace_char(char* str, char find, char replace)
@@ -63,124 +192,470 @@ static char* replace_char(char* str, char find, char replace)
 }
 
 
-static void uart_event_task(void *pvParameters)
+#ifdef CONFIG_SYSLOG_TRACE
+/* stamp a line read from the UART right before it is queued */
+static void trace_queued(line_record_t *record)
 {
-    uart_event_t event;
-    const char *error_msg;
-    uart_event_type_t last_event_type = UART_DATA;
+    trace_record(TRACE_FRAME, esp_cpu_get_cycle_count() - trace_read_cycles);
+    record->queued_us = (uint32_t)esp_timer_get_time();
+}
+#endif
 
-    task_params_t *params = (task_params_t *)pvParameters;
 
-    char *buffer = build_syslog_client_header(SYSLOG_INFO,
-                                              app_name,
-                                              params->syslog_task_name);
-    size_t header_len = strlen(buffer);
-    buffer = realloc(buffer, header_len + LINE_BUF_SIZE + PATTERN_CHR_NUM + 1);
-    assert(buffer != NULL);
-    char *msg = buffer + header_len;
-    *msg = '\0';
+static void queue_marker(syslog_source_t *source, const char *marker)
+{
+    ESP_LOGW(TAG, "%s", marker);
+#ifndef CONFIG_SYSLOG_MESSAGE_FORMAT_RAW
+    // in raw mode a marker would corrupt the byte stream, the drops are in the stats
+    line_record_t record = { .timestamp_us = timestamp_now(), .severity = SYSLOG_WARNING };
+    line_ring_text_span(&source->ring, marker, &record.span);
+    if (!line_queue_full(&source->queue))
+    {
+        record.seq = syslog_source_next_seq(source);
+#ifdef CONFIG_SYSLOG_TRACE
+        record.queued_us = (uint32_t)esp_timer_get_time();
+#endif
+        (void) line_queue_push(&source->queue, &record);
+        syslog_sender_notify();
+    }
+#else
+    (void) source;
+#endif
+}
 
-    vTaskDelay(1000 / portTICK_PERIOD_MS);
 
-    ESP_LOGI(TAG, "Capturing UART%d with syslog header '%s'", params->uart_port, buffer);
+/**
+ * Discard everything buffered by the UART driver, accounting for the lost
+ * bytes. The event queue is not reset, as it is a member of the queue set:
+ * its remaining events just find nothing to read.
+ */
+static void flush_uart(capture_t *capture)
+{
+    size_t buffered = 0;
+    if (uart_get_buffered_data_len(capture->uart_port, &buffered) == ESP_OK)
+    {
+        atomic_fetch_add_explicit(&capture->source.drops.flushed_bytes, buffered, memory_order_relaxed);
+    }
+    uart_flush_input(capture->uart_port);
+}
 
-    error_msg = "[start uart console logging]";
-    ESP_LOGI(TAG, "%s", error_msg);
-    strcpy(msg, error_msg);
-    syslog_client_send_with_header(buffer, -1);
 
-    for (;;) {
-        //Waiting for UART event.
-        if (xQueueReceive(params->uart_queue, (void *)&event, (TickType_t)portMAX_DELAY)) {
-            //ESP_LOGD(TAG, "uart[%d] event:", params->uart_port);
-            switch (event.type) {
-            // newline detected
-            case UART_PATTERN_DET:
-                //uart_get_buffered_data_len(params->uart_port, &buffered_size);
-                int pos = uart_pattern_pop_pos(params->uart_port);
-                //ESP_LOGD(TAG, "[UART PATTERN DETECTED] pos: %d", pos);
-                while (pos > LINE_BUF_SIZE)
-                {
-                    uart_read_bytes(params->uart_port, msg, LINE_BUF_SIZE, 100 / portTICK_PERIOD_MS);
-                    syslog_client_send_with_header(buffer, header_len + LINE_BUF_SIZE);
-                    pos -= LINE_BUF_SIZE;
-                }
-                uart_read_bytes(params->uart_port, msg, pos + PATTERN_CHR_NUM, 100 / portTICK_PERIOD_MS);
-                // strip trailing carriage return(s)
-                while ((pos > 0) && (msg[pos - 1] == '\r'))
-                {
-                    pos -= 1;
-                }
-                if (pos > 0)
-                {
-                    syslog_client_send_with_header(buffer, header_len + pos);
-                }
-                break;
-            //Event of HW FIFO overflow detected
-            case UART_FIFO_OVF:
-                // If fifo overflow happened, you should consider adding flow control for your application.
-                // The ISR has already reset the rx FIFO,
-                error_msg = "[hw fifo overflow]";
-                ESP_LOGW(TAG, "%s", error_msg);
-                strcpy(msg, error_msg);
-                syslog_client_send_with_header(buffer, -1);
-                // As an example, we directly flush the rx buffer here in order to read more data.
-                uart_flush_input(params->uart_port);
-                xQueueReset(params->uart_queue);
-                break;
-            //Event of UART ring buffer full
-            case UART_BUFFER_FULL:
-                // If buffer full happened, you should consider increasing your buffer size
-                error_msg = "[ring buffer full]";
-                ESP_LOGW(TAG, "%s", error_msg);
-                strcpy(msg, error_msg);
-                syslog_client_send_with_header(buffer, -1);
-                // As an example, we directly flush the rx buffer here in order to read more data.
-                uart_flush_input(params->uart_port);
-                xQueueReset(params->uart_queue);
-                break;
-            //Event of UART RX break detected
-            case UART_BREAK:
-                if (last_event_type != UART_BREAK)
-                {
-                    error_msg = "[uart rx break]";
-                    ESP_LOGW(TAG, "%s", error_msg);
-                    strcpy(msg, error_msg);
-                    syslog_client_send_with_header(buffer, -1);
-                }
-                uart_flush_input(params->uart_port);
-                xQueueReset(params->uart_queue);
-                break;
-            //Event of UART frame error
-            case UART_FRAME_ERR:
-                if (last_event_type != UART_FRAME_ERR)
-                {
-                    error_msg = "[uart frame error]";
-                    ESP_LOGW(TAG, "%s", error_msg);
-                    strcpy(msg, error_msg);
-                    syslog_client_send_with_header(buffer, -1);
-                }
-                break;
-            //Others
-            default:
-                //ESP_LOGI(TAG, "uart event type: %d", event.type);
+#ifdef CONFIG_SYSLOG_SANITIZE
+/* clean up a framed line, accounting for the changes and the time taken */
+static void sanitize_line(syslog_source_t *source, line_span_t *span)
+{
+    sanitize_result_t result = { 0 };
+    const size_t len = line_span_len(span);
+    const uint32_t start = esp_cpu_get_cycle_count();
+    sanitize_span(span, &result);
+    atomic_fetch_add_explicit(&source->sanitized.cycles, esp_cpu_get_cycle_count() - start, memory_order_relaxed);
+    atomic_fetch_add_explicit(&source->sanitized.bytes, len, memory_order_relaxed);
+    if ((result.stripped > 0) || (result.repaired > 0))
+    {
+        atomic_fetch_add_explicit(&source->sanitized.stripped, result.stripped, memory_order_relaxed);
+        atomic_fetch_add_explicit(&source->sanitized.repaired, result.repaired, memory_order_relaxed);
+    }
+}
+#endif
+
+
+#ifdef CONFIG_SYSLOG_MESSAGE_FORMAT_RAW
+/**
+ * Queue the received bytes as chunks of RAW_CHUNK_LEN for the sender, and a
+ * shorter last one if flush is set. Returns the number of queued chunks.
+ */
+static size_t queue_chunks(syslog_source_t *source, int64_t timestamp_us, bool flush)
+{
+    line_record_t record = { .timestamp_us = timestamp_us, .severity = SYSLOG_INFO };
+    size_t queued = 0;
+    while (!line_queue_full(&source->queue) &&
+           line_ring_next_chunk(&source->ring, RAW_CHUNK_LEN, flush, &record.span))
+    {
+        record.seq = syslog_source_next_seq(source);
+#ifdef CONFIG_SYSLOG_TRACE
+        trace_queued(&record);
+#endif
+        (void) line_queue_push(&source->queue, &record);
+        queued += 1;
+    }
+    return queued;
+}
+#endif
+
+
+#ifndef CONFIG_SYSLOG_MESSAGE_FORMAT_RAW
+/**
+ * Queue all complete lines in the ring for the sender, and if flush is set
+ * the received part of an incomplete one as well. Returns the number of
+ * queued records.
+ */
+static size_t queue_lines(syslog_source_t *source, int64_t timestamp_us, bool flush)
+{
+    line_record_t record = { .timestamp_us = timestamp_us, .severity = SYSLOG_INFO };
+    size_t queued = 0;
+
+    while (!line_queue_full(&source->queue))
+    {
+        record.partial = false;
+        if (!line_ring_next_line(&source->ring, CONFIG_SYSLOG_MAX_LINE_LEN, &record.span))
+        {
+            if (!flush || !line_ring_next_partial(&source->ring, &record.span))
+            {
                 break;
             }
-            last_event_type = event.type;
+            record.partial = true;
+        }
+#ifdef CONFIG_SYSLOG_SANITIZE
+        // a character cut in half is sent with the next part, so it is not replaced
+        if (record.span.more &&
+            !line_ring_carry(&source->ring, &record.span, sanitize_utf8_tail(&record.span)))
+        {
+            break;
+        }
+#endif
+        if (record.partial)
+        {
+            atomic_fetch_add_explicit(&source->captured.partial_lines, 1, memory_order_relaxed);
+        }
+#ifdef CONFIG_SYSLOG_SANITIZE
+        sanitize_line(source, &record.span);
+#endif
+        // the sender skips empty lines, a number of their own would look like a lost line
+        record.seq = ((line_span_len(&record.span) > 0) || (record.span.part > 0)) ?
+                     syslog_source_next_seq(source) : 0;
+        if (record.span.part <= 1)
+        {
+#ifdef CONFIG_SYSLOG_SEVERITY_CLASSIFY
+            record.severity = severity_classify(&record.span, SYSLOG_INFO);
+#endif
+            // all parts of a split line are identified by the first one
+            source->fragment_id = record.seq;
+            source->fragment_severity = record.severity;
+        }
+        record.severity = source->fragment_severity;
+        record.fragment_id = (record.span.part > 0) ? source->fragment_id : 0;
+#ifdef CONFIG_SYSLOG_TRACE
+        trace_queued(&record);
+#endif
+        (void) line_queue_push(&source->queue, &record);
+        queued += 1;
+    }
+    atomic_store_explicit(&source->drops.split_lines, source->ring.split_count, memory_order_relaxed);
+    return queued;
+}
+#endif
+
+
+#ifdef IDLE_FLUSH_MS
+/**
+ * Queue the bytes of an incomplete line (or in raw mode, chunk) once the
+ * UART stayed idle for IDLE_FLUSH_TICKS, e.g. a prompt without a newline.
+ * Returns the time until this is due.
+ */
+static TickType_t flush_idle(capture_t *capture)
+{
+    syslog_source_t *source = &capture->source;
+    if (line_ring_pending(&source->ring) == 0)
+    {
+        return portMAX_DELAY;
+    }
+    const TickType_t idle = xTaskGetTickCount() - capture->last_rx_tick;
+    if (idle < IDLE_FLUSH_TICKS)
+    {
+        return IDLE_FLUSH_TICKS - idle;
+    }
+#ifdef CONFIG_SYSLOG_TRACE
+    trace_read_cycles = esp_cpu_get_cycle_count();
+#endif
+#ifdef CONFIG_SYSLOG_MESSAGE_FORMAT_RAW
+    const size_t queued = queue_chunks(source, capture->last_rx_us, true);
+#else
+    const size_t queued = queue_lines(source, capture->last_rx_us, true);
+#endif
+    if (queued > 0)
+    {
+        atomic_fetch_add_explicit(&source->captured.lines, queued, memory_order_relaxed);
+        syslog_sender_notify();
+    }
+    // the queue is full -> retry soon, other bytes left wait for the rest of their character
+    return ((line_ring_pending(&source->ring) > 0) && line_queue_full(&source->queue)) ? 1 : portMAX_DELAY;
+}
+#endif
+
+
+/**
+ * Move everything buffered by the UART driver into the line ring and queue
+ * all complete lines (or in raw mode, full chunks) for the sender, stamped with the time the UART event was
+ * received. Returns false if this had to stop because the ring or the queue
+ * is full.
+ */
+static bool drain_uart(capture_t *capture, int64_t timestamp_us)
+{
+    syslog_source_t *source = &capture->source;
+    size_t buffered = 0;
+    size_t queued = 0;
+    bool drained = true;
+
+    while ((uart_get_buffered_data_len(capture->uart_port, &buffered) == ESP_OK) && (buffered > 0))
+    {
+        size_t avail;
+        char *dst = line_ring_write_ptr(&source->ring, &avail);
+        int len = (avail > 0) ? uart_read_bytes(capture->uart_port, dst, min(buffered, avail), 0) : 0;
+        if (len > 0)
+        {
+            line_ring_commit(&source->ring, len);
+#ifdef CONFIG_SYSLOG_TRACE
+            trace_read_cycles = esp_cpu_get_cycle_count();
+            trace_record(TRACE_READ, trace_read_cycles - trace_wakeup_cycles);
+#endif
+            atomic_fetch_add_explicit(&source->captured.bytes, len, memory_order_relaxed);
+            source->ring_high_water = max(source->ring_high_water, line_ring_fill(&source->ring));
+#ifdef IDLE_FLUSH_MS
+            capture->last_rx_tick = xTaskGetTickCount();
+            capture->last_rx_us = timestamp_us;
+#endif
+        }
+
+#ifdef CONFIG_SYSLOG_MESSAGE_FORMAT_RAW
+        queued += queue_chunks(source, timestamp_us, false);
+#else
+        queued += queue_lines(source, timestamp_us, false);
+#endif
+
+        if (len <= 0)
+        {
+            drained = false;
+            break;
+        }
+    }
+
+    if (queued > 0)
+    {
+        atomic_fetch_add_explicit(&source->captured.lines, queued, memory_order_relaxed);
+        syslog_sender_notify();
+    }
+    return drained && !line_queue_full(&source->queue);
+}
+
+
+#ifdef CONFIG_SYSLOG_UART_ADAPTIVE
+static void apply_tuning(capture_t *capture, uint8_t rx_full_threshold, uint8_t rx_timeout)
+{
+    uart_tuning_t *tuning = &capture->tuning;
+    if (rx_full_threshold != tuning->rx_full_threshold)
+    {
+        uart_set_rx_full_threshold(capture->uart_port, rx_full_threshold);
+        tuning->rx_full_threshold = rx_full_threshold;
+    }
+    if (rx_timeout != tuning->rx_timeout)
+    {
+        uart_set_rx_timeout(capture->uart_port, rx_timeout);
+        tuning->rx_timeout = rx_timeout;
+    }
+    atomic_store_explicit(&capture->source.tuning.rx_full_threshold, rx_full_threshold, memory_order_relaxed);
+    atomic_store_explicit(&capture->source.tuning.rx_timeout, rx_timeout, memory_order_relaxed);
+}
+
+
+/**
+ * Halve the FIFO threshold after an overflow and keep it from being raised
+ * again for a while.
+ */
+static void back_off_tuning(capture_t *capture)
+{
+    uart_tuning_t *tuning = &capture->tuning;
+    const uint8_t threshold = max(tuning->rx_full_threshold / 2, (int)capture->limits.rx_full_threshold);
+    if (threshold != tuning->rx_full_threshold)
+    {
+        atomic_fetch_add_explicit(&capture->source.tuning.backoffs, 1, memory_order_relaxed);
+    }
+    apply_tuning(capture, threshold, tuning->rx_timeout);
+    tuning->hold_until = xTaskGetTickCount() + pdMS_TO_TICKS(TUNING_HOLD_MS);
+}
+
+
+/**
+ * Every TUNING_INTERVAL_MS, raise the FIFO threshold and RX timeout while the
+ * line is busy or UART events pile up (fewer interrupts), and lower them
+ * back to the configured values when traffic is light (lower latency).
+ * Returns the time until the next adjustment is due.
+ */
+static TickType_t update_tuning(capture_t *capture)
+{
+    uart_tuning_t *tuning = &capture->tuning;
+    const uart_limits_t *limits = &capture->limits;
+    const TickType_t now = xTaskGetTickCount();
+    const TickType_t elapsed = now - tuning->last_tick;
+    const TickType_t interval = pdMS_TO_TICKS(TUNING_INTERVAL_MS);
+    if (elapsed < interval)
+    {
+        return interval - elapsed;
+    }
+
+    const uint32_t bytes = atomic_load_explicit(&capture->source.captured.bytes, memory_order_relaxed);
+    const uint64_t capacity = (uint64_t)capture->baud_rate / 10 * elapsed * portTICK_PERIOD_MS / 1000;
+    const unsigned int load = (unsigned int)((uint64_t)(bytes - tuning->last_bytes) * 100 / max(capacity, (uint64_t)1));
+    const bool backlog = uxQueueMessagesWaiting(capture->uart_queue) > (UBaseType_t)(limits->event_queue_size / 4);
+    tuning->last_bytes = bytes;
+    tuning->last_tick = now;
+
+    uint8_t threshold = tuning->rx_full_threshold;
+    uint8_t timeout = tuning->rx_timeout;
+    if (((load >= TUNING_HIGH_LOAD_PERCENT) || backlog) && ((int32_t)(now - tuning->hold_until) >= 0))
+    {
+        threshold = min(threshold * 2, max(TUNING_MAX_RX_FULL_THRESHOLD, (int)limits->rx_full_threshold));
+        timeout = min(timeout * 2, max(TUNING_MAX_RX_TIMEOUT, (int)limits->rx_timeout));
+        if ((threshold != tuning->rx_full_threshold) || (timeout != tuning->rx_timeout))
+        {
+            atomic_fetch_add_explicit(&capture->source.tuning.raised, 1, memory_order_relaxed);
+        }
+    }
+    else if ((load < TUNING_LOW_LOAD_PERCENT) && !backlog)
+    {
+        threshold = max(threshold / 2, (int)limits->rx_full_threshold);
+        timeout = limits->rx_timeout;
+        if ((threshold != tuning->rx_full_threshold) || (timeout != tuning->rx_timeout))
+        {
+            atomic_fetch_add_explicit(&capture->source.tuning.lowered, 1, memory_order_relaxed);
+        }
+    }
+    apply_tuning(capture, threshold, timeout);
+
+    /* nothing to lower anymore -> wait for traffic */
+    const bool at_minimum = (threshold == limits->rx_full_threshold) && (timeout == limits->rx_timeout);
+    return at_minimum ? portMAX_DELAY : interval;
+}
+#endif
+
+
+static void handle_uart_event(capture_t *capture, const uart_event_t *event)
+{
+    syslog_source_t *source = &capture->source;
+
+    switch (event->type) {
+    // newline detected or data received
+    case UART_PATTERN_DET:
+    case UART_DATA:
+        // lines are framed in the line ring, so the pattern
+        // positions are not needed (the driver drops them on read)
+        break;
+    //Event of HW FIFO overflow detected
+    case UART_FIFO_OVF:
+        // If fifo overflow happened, you should consider adding flow control for your application.
+        // The ISR has already reset the rx FIFO,
+        atomic_fetch_add_explicit(&source->drops.fifo_overflows, 1, memory_order_relaxed);
+#ifdef CONFIG_SYSLOG_UART_ADAPTIVE
+        back_off_tuning(capture);
+#endif
+        queue_marker(source, "[hw fifo overflow]");
+        // As an example, we directly flush the rx buffer here in order to read more data.
+        flush_uart(capture);
+        break;
+    //Event of UART ring buffer full
+    case UART_BUFFER_FULL:
+        // If buffer full happened, you should consider increasing your buffer size
+        queue_marker(source, "[ring buffer full]");
+        // As an example, we directly flush the rx buffer here in order to read more data.
+        flush_uart(capture);
+        break;
+    //Event of UART RX break detected
+    case UART_BREAK:
+        if (capture->last_event_type != UART_BREAK)
+        {
+            queue_marker(source, "[uart rx break]");
+        }
+        flush_uart(capture);
+        break;
+    //Event of UART frame error
+    case UART_FRAME_ERR:
+        // counted every time, but only marked once per run
+        atomic_fetch_add_explicit(&source->drops.frame_errors, 1, memory_order_relaxed);
+        if (capture->last_event_type != UART_FRAME_ERR)
+        {
+            queue_marker(source, "[uart frame error]");
+        }
+        break;
+    //Others
+    default:
+        //ESP_LOGI(TAG, "uart event type: %d", event->type);
+        break;
+    }
+    capture->last_event_type = event->type;
+}
+
+
+/**
+ * Serve the events of all UARTs from one task, waiting on the queue set of
+ * their event queues.
+ */
+static void capture_task(void *pvParameters)
+{
+    (void) pvParameters;
+    uart_event_t event;
+    TickType_t wait = portMAX_DELAY;
+
+    vTaskDelay(1000 / portTICK_PERIOD_MS);
+
+    for (size_t i = 0; i < capture_count; i++)
+    {
+        ESP_LOGI(TAG, "Capturing UART%d with syslog header '%s'",
+                 captures[i].uart_port, captures[i].source.header[SYSLOG_INFO]);
+        queue_marker(&captures[i].source, "[start uart console logging]");
+    }
+
+    for (;;) {
+        //Waiting for UART events, or retry soon if the sender is behind
+        QueueSetMemberHandle_t member = xQueueSelectFromSet(capture_queue_set, wait);
+#ifdef CONFIG_SYSLOG_TRACE
+        trace_wakeup_cycles = esp_cpu_get_cycle_count();
+#endif
+        // lines completed by this event were received (about) now
+        const int64_t timestamp_us = timestamp_now();
+
+        wait = portMAX_DELAY;
+        for (size_t i = 0; i < capture_count; i++)
+        {
+            capture_t *capture = &captures[i];
+            const bool selected = (member == capture->uart_queue);
+            if (selected && xQueueReceive(capture->uart_queue, (void *)&event, 0))
+            {
+                handle_uart_event(capture, &event);
+            }
+            if (selected || capture->backlogged)
+            {
+                capture->backlogged = !drain_uart(capture, timestamp_us);
+            }
+            if (capture->backlogged)
+            {
+                wait = 1;
+            }
+#ifdef CONFIG_SYSLOG_UART_ADAPTIVE
+            wait = min(wait, update_tuning(capture));
+#endif
+#ifdef IDLE_FLUSH_MS
+            wait = min(wait, flush_idle(capture));
+#endif
         }
     }
-    free(buffer);
-    buffer = NULL;
     vTaskDelete(NULL);
 }
 
-void configure_uart(uart_port_t uart_port, int baud_rate, int rx_io_num, const char *syslog_task_name, const char *os_task_name)
+
+static bool configure_uart(const uart_source_config_t *config)
 {
     /* Configure parameters of an UART driver,
      * communication pins and install the driver */
+    const uart_port_t uart_port = config->uart_port;
+    const uart_limits_t *limits = &config->limits;
+
+    if (capture_count >= SYSLOG_SENDER_MAX_SOURCES)
+    {
+        ESP_LOGE(TAG, "Cannot capture more than %d sources", SYSLOG_SENDER_MAX_SOURCES);
+        return false;
+    }
 
     uart_config_t uart_config = {
-        .baud_rate = baud_rate,
+        .baud_rate = config->baud_rate,
         .data_bits = UART_DATA_8_BITS,
         .parity = UART_PARITY_DISABLE,
         .stop_bits = UART_STOP_BITS_1,
@@ -189,31 +664,142 @@ void configure_uart(uart_port_t uart_port, int baud_rate, int rx_io_num, const c
     };
     QueueHandle_t uart_queue;
     // install UART driver, and get the queue.
-    ESP_ERROR_CHECK(uart_driver_install(uart_port, UART_BUF_SIZE, 0, UART_QUEUE_SIZE, &uart_queue, ESP_INTR_FLAG_IRAM));
+    ESP_ERROR_CHECK(uart_driver_install(uart_port, limits->buf_size, 0, limits->event_queue_size, &uart_queue, ESP_INTR_FLAG_IRAM));
+    // only an empty queue can join the set, so join before the pins are set
+    if (xQueueAddToSet(uart_queue, capture_queue_set) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Cannot add the event queue of UART%d to the queue set", uart_port);
+        uart_driver_delete(uart_port);
+        return false;
+    }
     ESP_ERROR_CHECK(uart_param_config(uart_port, &uart_config));
 
     // reduce receive FIFO "full" threshold from 0x60 (default) to reduce FIFO overflows
-    uart_set_rx_full_threshold(uart_port, UART_RXFIFO_FULL_THRHD_V / 3);
+    uart_set_rx_full_threshold(uart_port, limits->rx_full_threshold);
+    uart_set_rx_timeout(uart_port, limits->rx_timeout);
 
     // set UART pins
     uart_set_pin(uart_port, UART_PIN_NO_CHANGE,
-                            rx_io_num,
+                            config->rx_pin,
                             UART_PIN_NO_CHANGE,
                             UART_PIN_NO_CHANGE);
 
+#ifndef CONFIG_SYSLOG_MESSAGE_FORMAT_RAW
     // configure UART pattern detect function
     uart_enable_pattern_det_baud_intr(uart_port, PATTERN_CHR, PATTERN_CHR_NUM, 9, 0, 0);
-    // reset the pattern queue length to record at most 500 pattern positions
-    uart_pattern_queue_reset(uart_port, 500);
-
-    // create a task to handler UART event from ISR
-    task_params_t *params = (task_params_t *)malloc(sizeof(task_params_t));
-    params->uart_port = uart_port;
-    params->uart_queue = uart_queue;
-    params->syslog_task_name = syslog_task_name;
-    // run our task on the CPU core not running the Wifi driver
+    // reset the pattern queue length to record at most that many pattern positions
+    uart_pattern_queue_reset(uart_port, limits->pattern_queue_size);
+#endif
+
+    capture_t *capture = &captures[capture_count];
+    capture->uart_port = uart_port;
+    capture->baud_rate = config->baud_rate;
+    capture->limits = *limits;
+    capture->uart_queue = uart_queue;
+    capture->last_event_type = UART_DATA;
+    capture->backlogged = false;
+    capture->source.name = config->name;
+#ifdef IDLE_FLUSH_MS
+    capture->last_rx_tick = xTaskGetTickCount();
+    capture->last_rx_us = 0;
+#endif
+
+    char task_name[PROCID_MAX_LEN + 1];
+    strlcpy(task_name, config->task_name, sizeof(task_name));
+    (void) replace_char(task_name, ' ', '_');
+    // precompute the headers of all severities, so that classified lines
+    // only need to pick theirs
+    for (int severity = 0; severity < SEVERITY_COUNT; severity++)
+    {
+#ifdef CONFIG_SYSLOG_STATIC_MEMORY
+        char *header = headers[capture_count][severity];
+        size_t header_len = syslog_client_format_header(header, SYSLOG_HEADER_MAX_LEN, severity, app_name, task_name);
+        if (header_len >= SYSLOG_HEADER_MAX_LEN)
+        {
+            header = build_syslog_client_header(severity, app_name, task_name);
+            static_mem_count_fallback("syslog header", header_len + 1);
+        }
+        capture->source.header[severity] = header;
+        capture->source.header_len[severity] = header_len;
+#else
+        capture->source.header[severity] = build_syslog_client_header(severity, app_name, task_name);
+        capture->source.header_len[severity] = strlen(capture->source.header[severity]);
+#endif
+    }
+
+#ifdef CONFIG_SYSLOG_STATIC_MEMORY
+    char *ring_buf = line_rings[capture_count];
+    line_record_t *queue_slots = line_queues[capture_count];
+#else
+    char *ring_buf = NULL;
+    line_record_t *queue_slots = NULL;
+#endif
+    capture->source.ring_high_water = 0;
+    if (!line_ring_init(&capture->source.ring, ring_buf, LINE_RING_SIZE) ||
+        !line_queue_init(&capture->source.queue, queue_slots, LINE_QUEUE_SIZE) ||
+        !syslog_sender_add_source(&capture->source))
+    {
+        ESP_LOGE(TAG, "Cannot set up capturing of UART%d", uart_port);
+        return false;
+    }
+    atomic_store_explicit(&capture->source.tuning.rx_full_threshold, limits->rx_full_threshold, memory_order_relaxed);
+    atomic_store_explicit(&capture->source.tuning.rx_timeout, limits->rx_timeout, memory_order_relaxed);
+#ifdef CONFIG_SYSLOG_UART_ADAPTIVE
+    capture->tuning = (uart_tuning_t) {
+        .rx_full_threshold = limits->rx_full_threshold,
+        .rx_timeout = limits->rx_timeout,
+        .last_tick = xTaskGetTickCount(),
+    };
+#endif
+    capture_count += 1;
+    return true;
+}
+
+
+/**
+ * Set up all UARTs of the source table and start the task capturing them.
+ */
+static void start_capture()
+{
+    // the set must be able to hold every event of all member queues
+    UBaseType_t set_length = 0;
+    for (size_t i = 0; i < UART_SOURCE_COUNT; i++)
+    {
+        set_length += uart_sources[i].limits.event_queue_size;
+    }
+    if (set_length == 0)
+    {
+        return;
+    }
+    capture_queue_set = xQueueCreateSet(set_length);
+
+    for (size_t i = 0; i < UART_SOURCE_COUNT; i++)
+    {
+        (void) configure_uart(&uart_sources[i]);
+    }
+    if (capture_count == 0)
+    {
+        return;
+    }
+
+    // run our task on the CPU core not running the Wifi driver, lines are
+    // sent by the syslog sender on the Wifi core
     BaseType_t cpu_affinity = configNUM_CORES - 1 - WIFI_TASK_CORE_ID;
-    xTaskCreatePinnedToCore(uart_event_task, os_task_name, 2048, (void *)params, 12, NULL, cpu_affinity);
+    TaskHandle_t task = NULL;
+#ifdef CONFIG_SYSLOG_STATIC_MEMORY
+    static_mem_reserve("line rings", sizeof(line_rings));
+    static_mem_reserve("line queues", sizeof(line_queues));
+    static_mem_reserve("syslog headers", sizeof(headers));
+    static_mem_reserve("capture task", sizeof(capture_task_stack) + sizeof(capture_task_buffer));
+    task = xTaskCreateStaticPinnedToCore(capture_task, "capture_task", CAPTURE_TASK_STACK_SIZE, NULL, CAPTURE_TASK_PRIORITY,
+                                         capture_task_stack, &capture_task_buffer, cpu_affinity);
+#else
+    xTaskCreatePinnedToCore(capture_task, "capture_task", CAPTURE_TASK_STACK_SIZE, NULL, CAPTURE_TASK_PRIORITY, &task, cpu_affinity);
+#endif
+    for (size_t i = 0; i < capture_count; i++)
+    {
+        captures[i].source.task = task;
+    }
 }
 
 
@@ -238,34 +824,21 @@ void app_main(void)
         esp_restart();
     }
 
-    syslog_client_start(CONFIG_SYSLOG_HOST, CONFIG_SYSLOG_PORT, SYSLOG_LOCAL0);
-
-    app_name = strdup(CONFIG_SYSLOG_APP_NAME);
+#ifdef CONFIG_SYSLOG_TIMESTAMP
+    timestamp_start_sync(CONFIG_SYSLOG_SNTP_SERVER);
+#endif
+    strlcpy(app_name, CONFIG_SYSLOG_APP_NAME, sizeof(app_name));
     (void) replace_char(app_name, ' ', '_');
 
-#ifdef CONFIG_SYSLOG_USE_UART1
-    {
-        char *task_name = strdup(CONFIG_SYSLOG_UART1_TASK_NAME);
-        (void) replace_char(task_name, ' ', '_');
-
-        configure_uart(UART_NUM_1,
-                       CONFIG_SYSLOG_UART1_BAUD_RATE,
-                       CONFIG_SYSLOG_UART1_RX_PIN,
-                       task_name,
-                       "uart1_event_task");
-    }
+#ifdef CONFIG_SYSLOG_SEVERITY_CLASSIFY
+    severity_init(CONFIG_SYSLOG_SEVERITY_PATTERNS);
 #endif
-
-#ifdef CONFIG_SYSLOG_USE_UART2
-    {
-        char *task_name = strdup(CONFIG_SYSLOG_UART2_TASK_NAME);
-        (void) replace_char(task_name, ' ', '_');
-
-        configure_uart(UART_NUM_2,
-                       CONFIG_SYSLOG_UART2_BAUD_RATE,
-                       CONFIG_SYSLOG_UART2_RX_PIN,
-                       task_name,
-                       "uart2_event_task");
-    }
+    syslog_client_start(SYSLOG_LOCAL0);
+    (void) syslog_client_add_destination(CONFIG_SYSLOG_HOST, CONFIG_SYSLOG_HOST_FALLBACK, CONFIG_SYSLOG_PORT);
+#ifdef CONFIG_SYSLOG_USE_HOST2
+    (void) syslog_client_add_destination(CONFIG_SYSLOG_HOST2, CONFIG_SYSLOG_HOST2_FALLBACK, CONFIG_SYSLOG_PORT2);
 #endif
+    syslog_sender_start(WIFI_TASK_CORE_ID, app_name);
+
+    start_capture();
 }
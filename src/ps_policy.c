@@ -0,0 +1,61 @@
+#include <string.h>
+
+#include "ps_policy.h"
+
+
+void ps_policy_init(ps_policy_t *policy, const ps_policy_config_t *config, uint32_t now_ms, uint32_t sent)
+{
+    memset(policy, 0, sizeof(*policy));
+    policy->config = *config;
+    policy->mode = PS_POLICY_SAVE;
+    policy->last_ms = now_ms;
+    policy->last_sent = sent;
+}
+
+
+/**
+ * Feed the running total of sent bytes and the current backlog. The rate is
+ * measured since the previous call. Returns true if the mode changed.
+ */
+bool ps_policy_update(ps_policy_t *policy, uint32_t now_ms, uint32_t sent, uint32_t queued)
+{
+    const ps_policy_config_t *config = &policy->config;
+    const uint32_t elapsed_ms = now_ms - policy->last_ms;
+    if (elapsed_ms == 0)
+    {
+        return false;
+    }
+    const uint32_t rate = (uint32_t)((uint64_t)(sent - policy->last_sent) * 1000 / elapsed_ms);
+    policy->last_ms = now_ms;
+    policy->last_sent = sent;
+
+    const bool busy = (rate >= config->high_rate) || (queued >= config->high_queued);
+    const bool idle = (rate < config->low_rate) && (queued < config->high_queued / 2);
+    ps_policy_mode_t mode = policy->mode;
+    if (busy)
+    {
+        mode = PS_POLICY_PERFORMANCE;
+        policy->quiet = false;
+    }
+    else if (!idle)
+    {
+        policy->quiet = false;
+    }
+    else if (!policy->quiet)
+    {
+        policy->quiet = true;
+        policy->quiet_since_ms = now_ms;
+    }
+    else if (now_ms - policy->quiet_since_ms >= config->hold_ms)
+    {
+        mode = PS_POLICY_SAVE;
+    }
+
+    if (mode == policy->mode)
+    {
+        return false;
+    }
+    policy->mode = mode;
+    policy->transitions[mode] += 1;
+    return true;
+}
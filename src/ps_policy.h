@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum
+{
+    PS_POLICY_SAVE = 0,         /* modem sleep between beacons */
+    PS_POLICY_PERFORMANCE,      /* radio always on */
+    PS_POLICY_MODES
+} ps_policy_mode_t;
+
+typedef struct
+{
+    uint32_t high_rate;         /* bytes/s switching to performance */
+    uint32_t low_rate;          /* bytes/s below which power may be saved again */
+    uint32_t high_queued;       /* backlog in bytes switching to performance */
+    uint32_t hold_ms;           /* quiet time before saving power again */
+} ps_policy_config_t;
+
+/**
+ * Choice of the Wi-Fi power save mode from the send rate and the backlog of
+ * the syslog pipeline. Bursts switch to performance at once, power is only
+ * saved again after the traffic stayed low for hold_ms (hysteresis). Free of
+ * any ESP-IDF dependency, the caller applies the mode.
+ */
+typedef struct
+{
+    ps_policy_config_t config;
+    ps_policy_mode_t mode;
+    uint32_t last_ms;
+    uint32_t last_sent;
+    bool quiet;
+    uint32_t quiet_since_ms;
+    uint32_t transitions[PS_POLICY_MODES];  /* switches into each mode */
+} ps_policy_t;
+
+void ps_policy_init(ps_policy_t *policy, const ps_policy_config_t *config, uint32_t now_ms, uint32_t sent);
+
+bool ps_policy_update(ps_policy_t *policy, uint32_t now_ms, uint32_t sent, uint32_t queued);
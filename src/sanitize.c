@@ -0,0 +1,233 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include "sanitize.h"
+
+#define ESC 0x1b
+#define DEL 0x7f
+
+#define ONES 0x01010101u
+#define HIGHS 0x80808080u
+
+
+#ifndef SANITIZE_BYTEWISE     /* defined for comparison by the host benchmark */
+/**
+ * Return true if all four bytes of the word are printable ASCII (0x20 to
+ * 0x7e). A borrow or carry may flag a neighbouring byte as well, but only
+ * next to one which is flagged anyway, so a plain word is never missed.
+ */
+static inline bool word_plain(uint32_t x)
+{
+    const uint32_t below = (x - ONES * 0x20) & ~x;     /* a byte < 0x20 */
+    const uint32_t above = (x + ONES) | x;              /* a byte >= 0x7f */
+    return ((below | above) & HIGHS) == 0;
+}
+#endif
+
+
+/* the byte at a position of the (possibly wrapped) span */
+static inline char *span_at(const line_span_t *span, size_t pos)
+{
+    return (char *)((pos < span->len[0]) ? span->seg[0] + pos : span->seg[1] + (pos - span->len[0]));
+}
+
+
+static inline uint8_t span_byte(const line_span_t *span, size_t pos)
+{
+    return (uint8_t)*span_at(span, pos);
+}
+
+
+/**
+ * Return the length of the valid UTF-8 sequence starting with the lead byte
+ * at pos, or 0 if it is invalid or incomplete (see RFC 3629 section 4).
+ */
+static size_t utf8_sequence_len(const line_span_t *span, size_t pos, size_t len)
+{
+    const uint8_t lead = span_byte(span, pos);
+    size_t n;
+    uint8_t lower = 0x80;
+    uint8_t upper = 0xbf;
+
+    if ((lead >= 0xc2) && (lead <= 0xdf))
+    {
+        n = 2;
+    }
+    else if ((lead >= 0xe0) && (lead <= 0xef))
+    {
+        n = 3;
+        lower = (lead == 0xe0) ? 0xa0 : 0x80;       /* no overlong forms */
+        upper = (lead == 0xed) ? 0x9f : 0xbf;       /* no surrogates */
+    }
+    else if ((lead >= 0xf0) && (lead <= 0xf4))
+    {
+        n = 4;
+        lower = (lead == 0xf0) ? 0x90 : 0x80;
+        upper = (lead == 0xf4) ? 0x8f : 0xbf;       /* nothing above U+10FFFF */
+    }
+    else
+    {
+        return 0;
+    }
+
+    if (len - pos < n)
+    {
+        return 0;
+    }
+    for (size_t i = 1; i < n; i++)
+    {
+        const uint8_t c = span_byte(span, pos + i);
+        if ((c < lower) || (c > upper))
+        {
+            return 0;
+        }
+        lower = 0x80;
+        upper = 0xbf;
+    }
+    return n;
+}
+
+
+/**
+ * Return the length of the escape sequence at pos (see ECMA-48): a CSI
+ * sequence ESC '[' parameters intermediates final (0x40 to 0x7e), or ESC
+ * intermediates (0x20 to 0x2f) final (0x30 to 0x7e). A sequence cut off by
+ * the end of the line extends to it, a malformed one is just the ESC.
+ */
+static size_t escape_len(const line_span_t *span, size_t pos, size_t len)
+{
+    const bool csi = (pos + 1 < len) && (span_byte(span, pos + 1) == '[');
+    const uint8_t final_min = csi ? 0x40 : 0x30;
+    size_t end = csi ? pos + 2 : pos + 1;
+    while (end < len)
+    {
+        const uint8_t c = span_byte(span, end);
+        if ((c >= final_min) && (c <= 0x7e))
+        {
+            return end + 1 - pos;
+        }
+        if ((c < 0x20) || (c > 0x3f) || (!csi && (c > 0x2f)))
+        {
+            return 1;
+        }
+        end += 1;
+    }
+    return len - pos;
+}
+
+
+void sanitize_span(line_span_t *span, sanitize_result_t *result)
+{
+    const size_t len = line_span_len(span);
+    size_t r = 0;       /* read position */
+    size_t w = 0;       /* write position, never ahead of r */
+
+    while (r < len)
+    {
+        const char *p = span_at(span, r);
+
+#ifndef SANITIZE_BYTEWISE
+        const size_t seg_end = (r < span->len[0]) ? span->len[0] : len;
+        /* runs of printable ASCII a word at a time, only moved once bytes were removed */
+        size_t run = 0;
+        while ((((uintptr_t)p & 3) == 0) && (seg_end - r - run >= 4))
+        {
+            uint32_t word;
+            memcpy(&word, p + run, sizeof(word));
+            if (!word_plain(word))
+            {
+                break;
+            }
+            run += 4;
+        }
+        if (run > 0)
+        {
+            if ((w != r) && (w < span->len[0]) && (w + run > span->len[0]))
+            {
+                /* wrapped where it goes */
+                for (size_t i = 0; i < run; i++)
+                {
+                    *span_at(span, w + i) = p[i];
+                }
+            }
+            else if (w != r)
+            {
+                memmove(span_at(span, w), p, run);
+            }
+            r += run;
+            w += run;
+            continue;
+        }
+#endif
+
+        const uint8_t c = (uint8_t)*p;
+        size_t n = 1;
+        if (((c >= 0x20) && (c < DEL)) || (c == '\t'))
+        {
+            *span_at(span, w++) = c;
+        }
+        else if (c == ESC)
+        {
+            n = escape_len(span, r, len);
+            result->stripped += n;
+        }
+        else if (c < 0x80)
+        {
+            /* other control characters, incl. NUL, CR and DEL */
+            result->stripped += 1;
+        }
+        else if ((n = utf8_sequence_len(span, r, len)) > 0)
+        {
+            for (size_t i = 0; i < n; i++)
+            {
+                *span_at(span, w++) = *span_at(span, r + i);
+            }
+        }
+        else
+        {
+            n = 1;
+            *span_at(span, w++) = SANITIZE_REPLACEMENT;
+            result->repaired += 1;
+        }
+        r += n;
+    }
+
+    const size_t first = (w < span->len[0]) ? w : span->len[0];
+    span->len[1] = w - first;
+    span->len[0] = first;
+}
+
+
+/**
+ * Return the number of bytes at the end of the span which start a UTF-8
+ * sequence without completing it, e.g. a character cut in half where a long
+ * line was split.
+ */
+size_t sanitize_utf8_tail(const line_span_t *span)
+{
+    const size_t len = line_span_len(span);
+    size_t start = len;
+    /* back up over at most three continuation bytes to the lead byte */
+    while ((start > 0) && (len - start < 3) && ((span_byte(span, start - 1) & 0xc0) == 0x80))
+    {
+        start -= 1;
+    }
+    if (start == 0)
+    {
+        return 0;
+    }
+    const uint8_t lead = span_byte(span, start - 1);
+    const size_t needed = (lead >= 0xf0) ? 4 : (lead >= 0xe0) ? 3 : (lead >= 0xc0) ? 2 : 1;
+    return (len - (start - 1) < needed) ? len - (start - 1) : 0;
+}
+
+
+/**
+ * Return the length of text without an incomplete UTF-8 sequence at its end,
+ * e.g. after it was cut to fit a buffer.
+ */
+size_t sanitize_utf8_prefix(const char *text, size_t len)
+{
+    const line_span_t span = { .seg = { text, NULL }, .len = { len, 0 } };
+    return len - sanitize_utf8_tail(&span);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "line_ring.h"
+
+#define SANITIZE_REPLACEMENT '?'    /*!< for bytes which are not valid UTF-8 */
+
+/* changes made to a line */
+typedef struct
+{
+    uint32_t stripped;      /* bytes of escape sequences and control characters removed */
+    uint32_t repaired;      /* invalid UTF-8 bytes replaced */
+} sanitize_result_t;
+
+/**
+ * Clean up a framed line in place, so that the collector receives plain
+ * UTF-8 text: ANSI escape sequences (e.g. colors) and control characters
+ * other than tab are removed, and every byte which is not part of a valid
+ * UTF-8 sequence is replaced by SANITIZE_REPLACEMENT. The line never grows,
+ * its span is shortened by the removed bytes. Runs of printable ASCII are
+ * skipped a word at a time.
+ */
+void sanitize_span(line_span_t *span, sanitize_result_t *result);
+
+size_t sanitize_utf8_tail(const line_span_t *span);
+
+size_t sanitize_utf8_prefix(const char *text, size_t len);
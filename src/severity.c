@@ -0,0 +1,116 @@
+#include <string.h>
+#include <stdlib.h>
+
+#include "esp_log.h"
+
+#include "severity.h"
+
+#define ANSI_MAX_LEN 8          /*!< e.g. "\033[0;31m" */
+
+#define min(a,b) \
+   ({ __typeof__ (a) _a = (a); \
+       __typeof__ (b) _b = (b); \
+     _a < _b ? _a : _b; })
+
+typedef struct
+{
+    uint8_t len;
+    uint8_t severity;
+    char prefix[SEVERITY_MAX_PREFIX_LEN];
+} pattern_t;
+
+static const char *TAG = "severity";
+
+static pattern_t patterns[SEVERITY_MAX_PATTERNS];
+static size_t pattern_count = 0;
+static uint32_t first_chars[256 / 32];     /* bitmap of the first pattern characters */
+
+
+/**
+ * Parse the pattern list. Invalid entries are skipped with a warning.
+ */
+void severity_init(const char *list)
+{
+    pattern_count = 0;
+    memset(first_chars, 0, sizeof(first_chars));
+
+    const char *entry = list;
+    while (entry && *entry)
+    {
+        const char *end = strchr(entry, ',');
+        const size_t entry_len = end ? (size_t)(end - entry) : strlen(entry);
+        const char *equals = NULL;
+        for (const char *p = entry; p < entry + entry_len; p++)
+        {
+            if (*p == '=')
+            {
+                equals = p;     /* the last one, a prefix may contain '=' */
+            }
+        }
+        const size_t prefix_len = equals ? (size_t)(equals - entry) : 0;
+        const int severity = equals ? atoi(equals + 1) : -1;
+
+        if ((prefix_len == 0) || (prefix_len > SEVERITY_MAX_PREFIX_LEN) ||
+            (severity < 0) || (severity >= SEVERITY_COUNT) ||
+            (pattern_count >= SEVERITY_MAX_PATTERNS))
+        {
+            ESP_LOGW(TAG, "Ignoring pattern '%.*s'", (int)entry_len, entry);
+        }
+        else
+        {
+            pattern_t *pattern = &patterns[pattern_count++];
+            pattern->len = prefix_len;
+            pattern->severity = severity;
+            memcpy(pattern->prefix, entry, prefix_len);
+            const uint8_t first = (uint8_t)entry[0];
+            first_chars[first / 32] |= 1u << (first % 32);
+        }
+        entry = end ? end + 1 : NULL;
+    }
+    ESP_LOGI(TAG, "%u patterns", (unsigned)pattern_count);
+}
+
+
+/**
+ * Return the severity of the first matching pattern, or default_severity.
+ * Only the first bytes of the line are examined, without any allocation.
+ */
+uint8_t severity_classify(const line_span_t *span, uint8_t default_severity)
+{
+    char buf[ANSI_MAX_LEN + SEVERITY_MAX_PREFIX_LEN];
+    const char *text = span->seg[0];
+    size_t len = min(line_span_len(span), sizeof(buf));
+
+    if (span->len[0] < len)
+    {
+        /* the prefix wraps around the end of the ring */
+        memcpy(buf, span->seg[0], span->len[0]);
+        memcpy(buf + span->len[0], span->seg[1], len - span->len[0]);
+        text = buf;
+    }
+
+    /* skip a color sequence like ESC "[0;31m" */
+    if ((len > 1) && (text[0] == '\033') && (text[1] == '['))
+    {
+        const char *m = memchr(text, 'm', len);
+        if (m)
+        {
+            len -= m + 1 - text;
+            text = m + 1;
+        }
+    }
+
+    if ((len == 0) || !(first_chars[(uint8_t)text[0] / 32] & (1u << ((uint8_t)text[0] % 32))))
+    {
+        return default_severity;
+    }
+    for (size_t i = 0; i < pattern_count; i++)
+    {
+        const pattern_t *pattern = &patterns[i];
+        if ((pattern->len <= len) && (memcmp(pattern->prefix, text, pattern->len) == 0))
+        {
+            return pattern->severity;
+        }
+    }
+    return default_severity;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "line_ring.h"
+
+#define SEVERITY_COUNT 8
+#define SEVERITY_MAX_PATTERNS 32
+#define SEVERITY_MAX_PREFIX_LEN 15
+
+/**
+ * Classification of captured lines by their prefix, e.g. "E (1234) tag:" of
+ * ESP-IDF or "Error:" of Marlin. The patterns are given as a comma separated
+ * list of "prefix=severity" entries. A leading ANSI color sequence is skipped.
+ */
+void severity_init(const char *patterns);
+
+uint8_t severity_classify(const line_span_t *span, uint8_t default_severity);
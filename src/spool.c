@@ -0,0 +1,318 @@
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "sdkconfig.h"
+
+#include "spool.h"
+#include "spool_flash.h"
+
+#ifdef CONFIG_SYSLOG_SPOOL
+
+#ifdef CONFIG_SYSLOG_SPOOL_FLASH
+static const char *TAG = "spool";
+#endif
+
+#define min(a,b) \
+   ({ __typeof__ (a) _a = (a); \
+       __typeof__ (b) _b = (b); \
+     _a < _b ? _a : _b; })
+
+static char ram[CONFIG_SYSLOG_SPOOL_RAM_SIZE];
+static size_t ram_head = 0;         /* write offset */
+static size_t ram_tail = 0;         /* read offset */
+static size_t ram_used = 0;
+static size_t ram_count = 0;
+
+#ifdef CONFIG_SYSLOG_SPOOL_FLASH
+static bool flash_ok = false;
+static char scratch[SPOOL_MAX_LINE_LEN];   /* a line moved to or read from flash */
+#endif
+
+static uint32_t evicted[SPOOL_MAX_SOURCES];
+static uint32_t evicted_total = 0;
+static uint32_t truncated_total = 0;
+
+
+static void ram_write(size_t pos, const void *src, size_t len)
+{
+    const size_t first = min(len, sizeof(ram) - pos);
+    memcpy(ram + pos, src, first);
+    if (first < len)
+    {
+        memcpy(ram, (const char *)src + first, len - first);
+    }
+}
+
+
+static void ram_read(size_t pos, void *dst, size_t len)
+{
+    const size_t first = min(len, sizeof(ram) - pos);
+    memcpy(dst, ram + pos, first);
+    if (first < len)
+    {
+        memcpy((char *)dst + first, ram, len - first);
+    }
+}
+
+
+static inline size_t ram_advance(size_t pos, size_t len)
+{
+    pos += len;
+    return (pos >= sizeof(ram)) ? pos - sizeof(ram) : pos;
+}
+
+
+static void count_evicted(uint8_t source)
+{
+    evicted[(source < SPOOL_MAX_SOURCES) ? source : 0] += 1;
+    evicted_total += 1;
+}
+
+
+#ifdef CONFIG_SYSLOG_SPOOL_FLASH
+/* stop using the flash after an error (e.g. a worn sector), the lines pending there are lost */
+static void flash_disable()
+{
+    const uint32_t lost = spool_flash_pending();
+    ESP_LOGE(TAG, "Flash tier disabled, %u lines lost, spooling to RAM only", (unsigned)lost);
+    evicted_total += lost;
+    flash_ok = false;
+}
+#endif
+
+
+/* make room by moving the oldest RAM entry to flash, or dropping it */
+static void ram_evict_oldest()
+{
+    spool_entry_t entry;
+    ram_read(ram_tail, &entry, sizeof(entry));
+#ifdef CONFIG_SYSLOG_SPOOL_FLASH
+    if (flash_ok)
+    {
+        uint32_t flash_evicted[SPOOL_MAX_SOURCES] = { 0 };
+        ram_read(ram_advance(ram_tail, sizeof(entry)), scratch, entry.len);
+        if (!spool_flash_append(&entry, scratch, flash_evicted, SPOOL_MAX_SOURCES))
+        {
+            flash_disable();
+            count_evicted(entry.source);
+        }
+        for (size_t i = 0; i < SPOOL_MAX_SOURCES; i++)
+        {
+            evicted[i] += flash_evicted[i];
+            evicted_total += flash_evicted[i];
+        }
+    }
+    else
+#endif
+    {
+        count_evicted(entry.source);
+    }
+    ram_tail = ram_advance(ram_tail, sizeof(entry) + entry.len);
+    ram_used -= sizeof(entry) + entry.len;
+    ram_count -= 1;
+}
+
+
+void spool_init()
+{
+#ifdef CONFIG_SYSLOG_SPOOL_FLASH
+    flash_ok = spool_flash_init();
+#endif
+}
+
+
+bool spool_empty()
+{
+    if (ram_count > 0)
+    {
+        return false;
+    }
+#ifdef CONFIG_SYSLOG_SPOOL_FLASH
+    return !flash_ok || spool_flash_empty();
+#else
+    return true;
+#endif
+}
+
+
+/**
+ * Keep a copy of a line (and its capture time) for later. The oldest lines
+ * make room if necessary.
+ */
+void spool_put(uint8_t source, const line_record_t *record)
+{
+    const size_t len = min(line_span_len(&record->span), (size_t)SPOOL_MAX_LINE_LEN);
+    if (len < line_span_len(&record->span))
+    {
+        truncated_total += 1;
+    }
+    const spool_entry_t entry = {
+        .len = len,
+        .source = source,
+        .state = 0,
+        .timestamp_us = record->timestamp_us,
+        .seq = record->seq,
+        .severity = record->severity,
+        .more = record->span.more,
+        .part = record->span.part,
+        .fragment_id = record->fragment_id,
+    };
+    const size_t needed = sizeof(entry) + len;
+    if (needed > sizeof(ram))
+    {
+        count_evicted(source);
+        return;
+    }
+    while (sizeof(ram) - ram_used < needed)
+    {
+        ram_evict_oldest();
+    }
+
+    const size_t first = min(len, record->span.len[0]);
+    ram_write(ram_head, &entry, sizeof(entry));
+    ram_write(ram_advance(ram_head, sizeof(entry)), record->span.seg[0], first);
+    if (first < len)
+    {
+        ram_write(ram_advance(ram_head, sizeof(entry) + first), record->span.seg[1], len - first);
+    }
+    ram_head = ram_advance(ram_head, needed);
+    ram_used += needed;
+    ram_count += 1;
+}
+
+
+/**
+ * Return the oldest spooled line without removing it. The returned span stays
+ * valid until the next call to any other spool function.
+ */
+bool spool_peek(uint8_t *source, line_record_t *record)
+{
+    spool_entry_t entry;
+#ifdef CONFIG_SYSLOG_SPOOL_FLASH
+    /* lines in flash are older than all lines in RAM */
+    if (flash_ok && spool_flash_peek(&entry, scratch, sizeof(scratch)))
+    {
+        *source = entry.source;
+        record->timestamp_us = entry.timestamp_us;
+        record->seq = entry.seq;
+        record->severity = entry.severity;
+        record->fragment_id = entry.fragment_id;
+        record->span = (line_span_t) { .seg = { scratch, NULL }, .len = { entry.len, 0 },
+                                       .part = entry.part, .more = entry.more };
+        return true;
+    }
+    if (flash_ok && !spool_flash_empty())
+    {
+        flash_disable();
+    }
+#endif
+    if (ram_count == 0)
+    {
+        return false;
+    }
+    ram_read(ram_tail, &entry, sizeof(entry));
+    const size_t pos = ram_advance(ram_tail, sizeof(entry));
+    const size_t first = min((size_t)entry.len, sizeof(ram) - pos);
+    *source = entry.source;
+    record->timestamp_us = entry.timestamp_us;
+    record->seq = entry.seq;
+    record->severity = entry.severity;
+    record->fragment_id = entry.fragment_id;
+    record->span = (line_span_t) { .seg = { ram + pos, ram }, .len = { first, entry.len - first },
+                                   .part = entry.part, .more = entry.more };
+    return true;
+}
+
+
+void spool_pop()
+{
+#ifdef CONFIG_SYSLOG_SPOOL_FLASH
+    if (flash_ok && !spool_flash_empty())
+    {
+        if (!spool_flash_pop())
+        {
+            flash_disable();
+        }
+        return;
+    }
+#endif
+    if (ram_count > 0)
+    {
+        spool_entry_t entry;
+        ram_read(ram_tail, &entry, sizeof(entry));
+        ram_tail = ram_advance(ram_tail, sizeof(entry) + entry.len);
+        ram_used -= sizeof(entry) + entry.len;
+        ram_count -= 1;
+    }
+}
+
+
+/**
+ * Return the number of lines of the given source evicted since the last call.
+ */
+uint32_t spool_take_evicted(uint8_t source)
+{
+    uint32_t count = 0;
+    if (source < SPOOL_MAX_SOURCES)
+    {
+        count = evicted[source];
+        evicted[source] = 0;
+    }
+    return count;
+}
+
+
+void spool_get_stats(spool_stats_t *stats)
+{
+    stats->ram_lines = ram_count;
+    stats->ram_bytes = ram_used;
+    stats->flash_lines = 0;
+#ifdef CONFIG_SYSLOG_SPOOL_FLASH
+    stats->flash_lines = flash_ok ? spool_flash_pending() : 0;
+#endif
+    stats->evicted = evicted_total;
+    stats->truncated = truncated_total;
+}
+
+#else
+
+void spool_init()
+{
+}
+
+
+bool spool_empty()
+{
+    return true;
+}
+
+
+void spool_put(uint8_t source, const line_record_t *record)
+{
+}
+
+
+bool spool_peek(uint8_t *source, line_record_t *record)
+{
+    return false;
+}
+
+
+void spool_pop()
+{
+}
+
+
+uint32_t spool_take_evicted(uint8_t source)
+{
+    return 0;
+}
+
+
+void spool_get_stats(spool_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+#endif
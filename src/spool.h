@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+#include "line_queue.h"
+
+#define SPOOL_MAX_SOURCES 4
+#define SPOOL_MAX_LINE_LEN CONFIG_SYSLOG_MAX_LINE_LEN
+
+/**
+ * Bounded store-and-forward buffer for lines which could not be sent. Lines
+ * are kept in RAM, and optionally the oldest ones move on to a flash
+ * partition. After a flash error, the spool continues in RAM only. When
+ * full, the oldest lines are evicted and counted per source. Only to be used
+ * from the sender task.
+ */
+void spool_init();
+
+bool spool_empty();
+
+void spool_put(uint8_t source, const line_record_t *record);
+
+bool spool_peek(uint8_t *source, line_record_t *record);
+
+void spool_pop();
+
+uint32_t spool_take_evicted(uint8_t source);
+
+typedef struct
+{
+    uint32_t ram_lines;
+    uint32_t ram_bytes;
+    uint32_t flash_lines;
+    uint32_t evicted;       /* lines lost since start */
+    uint32_t truncated;     /* lines cut to SPOOL_MAX_LINE_LEN */
+} spool_stats_t;
+
+void spool_get_stats(spool_stats_t *stats);
@@ -0,0 +1,326 @@
+/**
+ * Flash tier of the spool: an append-only log in the data partition labeled
+ * "spool". The partition is used as a circular sequence of sectors, each
+ * starting with a header carrying a sequence number. A sector is only erased
+ * right before it is reused, so all sectors wear evenly. Replayed entries are
+ * marked by clearing bits of their state byte, which needs no erase either.
+ */
+#include <stddef.h>
+#include <string.h>
+
+#include "sdkconfig.h"
+
+#ifdef CONFIG_SYSLOG_SPOOL_FLASH
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+
+#include "spool_flash.h"
+
+#define SEGMENT_SIZE 4096               /*!< flash sector size */
+#define SEGMENT_MAGIC 0x344f4f50        /*!< "POO4", changed with the entry layout */
+#define ENTRY_ALIGN 4
+
+#define ENTRY_STATE_PENDING 0xfe
+#define ENTRY_STATE_DONE 0x00
+#define ENTRY_LEN_ERASED 0xffff
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t sequence;
+} segment_header_t;
+
+typedef struct
+{
+    uint32_t segment;
+    uint32_t offset;
+} log_pos_t;
+
+static const char *TAG = "spool_flash";
+
+static const esp_partition_t *partition = NULL;
+static uint32_t segment_count;
+static uint32_t sequence;
+static log_pos_t write_pos;
+static log_pos_t read_pos;
+static uint32_t pending;
+
+
+static inline uint32_t entry_size(uint16_t len)
+{
+    return (sizeof(spool_entry_t) + len + ENTRY_ALIGN - 1) & ~(ENTRY_ALIGN - 1);
+}
+
+
+static inline uint32_t address(const log_pos_t *pos)
+{
+    return pos->segment * SEGMENT_SIZE + pos->offset;
+}
+
+
+static bool read_segment_header(uint32_t segment, segment_header_t *header)
+{
+    return (esp_partition_read(partition, segment * SEGMENT_SIZE, header, sizeof(*header)) == ESP_OK) &&
+           (header->magic == SEGMENT_MAGIC);
+}
+
+
+/* log a failed flash operation, so that the caller can stop using the flash */
+static bool check(esp_err_t err, const char *operation)
+{
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Flash %s failed: %s", operation, esp_err_to_name(err));
+        return false;
+    }
+    return true;
+}
+
+
+/* read the entry at pos, returns false at the end of the written part of a segment */
+static bool read_entry(const log_pos_t *pos, spool_entry_t *entry)
+{
+    if (pos->offset + sizeof(*entry) > SEGMENT_SIZE)
+    {
+        return false;
+    }
+    if (esp_partition_read(partition, address(pos), entry, sizeof(*entry)) != ESP_OK)
+    {
+        return false;
+    }
+    return (entry->len != ENTRY_LEN_ERASED) && (pos->offset + entry_size(entry->len) <= SEGMENT_SIZE);
+}
+
+
+static bool open_segment(uint32_t segment)
+{
+    const segment_header_t header = { .magic = SEGMENT_MAGIC, .sequence = ++sequence };
+    if (!check(esp_partition_erase_range(partition, segment * SEGMENT_SIZE, SEGMENT_SIZE), "erase") ||
+        !check(esp_partition_write(partition, segment * SEGMENT_SIZE, &header, sizeof(header)), "write"))
+    {
+        return false;
+    }
+    write_pos.segment = segment;
+    write_pos.offset = sizeof(header);
+    return true;
+}
+
+
+/* skip replayed entries and exhausted segments */
+static void settle_read_pos()
+{
+    spool_entry_t entry;
+    for (;;)
+    {
+        if ((read_pos.segment == write_pos.segment) && (read_pos.offset >= write_pos.offset))
+        {
+            return;
+        }
+        if (!read_entry(&read_pos, &entry))
+        {
+            read_pos.segment = (read_pos.segment + 1) % segment_count;
+            read_pos.offset = sizeof(segment_header_t);
+            continue;
+        }
+        if (entry.state == ENTRY_STATE_PENDING)
+        {
+            return;
+        }
+        read_pos.offset += entry_size(entry.len);
+    }
+}
+
+
+/**
+ * Find the newest segment to continue writing and the oldest pending entry
+ * to continue replaying, so that spooled lines survive a reboot.
+ */
+bool spool_flash_init()
+{
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "spool");
+    if (partition == NULL)
+    {
+        ESP_LOGW(TAG, "No \"spool\" partition found, spooling to RAM only");
+        return false;
+    }
+    segment_count = partition->size / SEGMENT_SIZE;
+    if (segment_count < 2)
+    {
+        ESP_LOGW(TAG, "Partition \"spool\" is too small");
+        partition = NULL;
+        return false;
+    }
+
+    /* newest segment by sequence number */
+    segment_header_t header;
+    bool found = false;
+    sequence = 0;
+    for (uint32_t segment = 0; segment < segment_count; segment++)
+    {
+        if (read_segment_header(segment, &header) && (!found || (int32_t)(header.sequence - sequence) > 0))
+        {
+            sequence = header.sequence;
+            write_pos.segment = segment;
+            found = true;
+        }
+    }
+    if (!found)
+    {
+        if (!open_segment(0))
+        {
+            partition = NULL;
+            return false;
+        }
+        read_pos = write_pos;
+        pending = 0;
+        return true;
+    }
+
+    /* end of the newest segment */
+    spool_entry_t entry;
+    write_pos.offset = sizeof(segment_header_t);
+    while (read_entry(&write_pos, &entry))
+    {
+        write_pos.offset += entry_size(entry.len);
+    }
+
+    /* the oldest valid segment follows the newest one circularly */
+    read_pos.segment = write_pos.segment;
+    for (uint32_t i = 1; i < segment_count; i++)
+    {
+        const uint32_t segment = (write_pos.segment + i) % segment_count;
+        if (read_segment_header(segment, &header))
+        {
+            read_pos.segment = segment;
+            break;
+        }
+    }
+    read_pos.offset = sizeof(segment_header_t);
+
+    /* count what is left to replay */
+    pending = 0;
+    log_pos_t pos = read_pos;
+    while ((pos.segment != write_pos.segment) || (pos.offset < write_pos.offset))
+    {
+        if (!read_entry(&pos, &entry))
+        {
+            /* end of segment (never written segments end immediately) */
+            pos.segment = (pos.segment + 1) % segment_count;
+            pos.offset = sizeof(segment_header_t);
+            continue;
+        }
+        pending += (entry.state == ENTRY_STATE_PENDING) ? 1 : 0;
+        pos.offset += entry_size(entry.len);
+    }
+    settle_read_pos();
+
+    ESP_LOGI(TAG, "Using %u sectors, %u lines pending from before", (unsigned)segment_count, (unsigned)pending);
+    return true;
+}
+
+
+bool spool_flash_empty()
+{
+    return pending == 0;
+}
+
+
+/**
+ * Append an entry. If the log is full, the oldest segment is reused and its
+ * pending entries are counted as evicted. Returns false if the flash failed.
+ */
+bool spool_flash_append(const spool_entry_t *entry, const char *payload, uint32_t *evicted, size_t sources)
+{
+    const uint32_t size = entry_size(entry->len);
+    if (write_pos.offset + size > SEGMENT_SIZE)
+    {
+        const uint32_t next = (write_pos.segment + 1) % segment_count;
+        if ((next == read_pos.segment) && (pending > 0))
+        {
+            /* drop the oldest segment */
+            spool_entry_t old;
+            while ((read_pos.segment == next) && read_entry(&read_pos, &old))
+            {
+                if (old.state == ENTRY_STATE_PENDING)
+                {
+                    evicted[(old.source < sources) ? old.source : 0] += 1;
+                    pending -= 1;
+                }
+                read_pos.offset += entry_size(old.len);
+            }
+            read_pos.segment = (next + 1) % segment_count;
+            read_pos.offset = sizeof(segment_header_t);
+        }
+        if (!open_segment(next))
+        {
+            return false;
+        }
+        if (pending == 0)
+        {
+            read_pos = write_pos;
+        }
+    }
+
+    spool_entry_t stored = *entry;
+    stored.state = ENTRY_STATE_PENDING;
+    if (!check(esp_partition_write(partition, address(&write_pos), &stored, sizeof(stored)), "write") ||
+        !check(esp_partition_write(partition, address(&write_pos) + sizeof(stored), payload, entry->len), "write"))
+    {
+        return false;
+    }
+    write_pos.offset += size;
+    pending += 1;
+    return true;
+}
+
+
+/**
+ * Read the oldest pending entry. Returns false if there is none, or if it
+ * cannot be read although entries are pending, i.e. the flash failed.
+ */
+bool spool_flash_peek(spool_entry_t *entry, char *payload, size_t size)
+{
+    if ((pending == 0) || !read_entry(&read_pos, entry))
+    {
+        return false;
+    }
+    if (entry->len > size)
+    {
+        entry->len = size;
+    }
+    return check(esp_partition_read(partition, address(&read_pos) + sizeof(*entry), payload, entry->len), "read");
+}
+
+
+/**
+ * Mark the oldest pending entry as replayed. Returns false if the flash
+ * failed.
+ */
+bool spool_flash_pop()
+{
+    spool_entry_t entry;
+    if ((pending == 0) || !read_entry(&read_pos, &entry))
+    {
+        return pending == 0;
+    }
+    const uint8_t done = ENTRY_STATE_DONE;
+    if (!check(esp_partition_write(partition, address(&read_pos) + offsetof(spool_entry_t, state),
+                                   &done, sizeof(done)), "write"))
+    {
+        return false;
+    }
+    read_pos.offset += entry_size(entry.len);
+    pending -= 1;
+    settle_read_pos();
+    return true;
+}
+
+
+uint32_t spool_flash_pending()
+{
+    return pending;
+}
+
+#endif
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* entry header shared by the RAM and the flash spool */
+typedef struct __attribute__((packed))
+{
+    uint16_t len;           /* payload length */
+    uint8_t source;
+    uint8_t state;          /* flash only, see spool_flash.c */
+    int64_t timestamp_us;
+    uint32_t seq;
+    uint8_t severity;
+    uint8_t more;
+    uint16_t part;
+    uint32_t fragment_id;
+} spool_entry_t;
+
+bool spool_flash_init();
+
+bool spool_flash_empty();
+
+bool spool_flash_append(const spool_entry_t *entry, const char *payload, uint32_t *evicted, size_t sources);
+
+bool spool_flash_peek(spool_entry_t *entry, char *payload, size_t size);
+
+bool spool_flash_pop();
+
+uint32_t spool_flash_pending();
@@ -0,0 +1,34 @@
+#include <stdatomic.h>
+
+#include "esp_log.h"
+
+#include "static_mem.h"
+
+static const char *TAG = "static_mem";
+
+static atomic_uint reserved_bytes;
+static atomic_uint fallbacks;
+static atomic_uint fallback_bytes;
+
+
+void static_mem_reserve(const char *what, size_t size)
+{
+    const unsigned int total = atomic_fetch_add_explicit(&reserved_bytes, size, memory_order_relaxed) + size;
+    ESP_LOGI(TAG, "%s: %u bytes (%u bytes in total)", what, (unsigned)size, total);
+}
+
+
+void static_mem_count_fallback(const char *what, size_t size)
+{
+    atomic_fetch_add_explicit(&fallbacks, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&fallback_bytes, size, memory_order_relaxed);
+    ESP_LOGW(TAG, "%s: allocated %u bytes from the heap", what, (unsigned)size);
+}
+
+
+void static_mem_get_stats(static_mem_stats_t *stats)
+{
+    stats->reserved_bytes = atomic_load_explicit(&reserved_bytes, memory_order_relaxed);
+    stats->fallbacks = atomic_load_explicit(&fallbacks, memory_order_relaxed);
+    stats->fallback_bytes = atomic_load_explicit(&fallback_bytes, memory_order_relaxed);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Accounting of the static memory mode: buffers reserved at build time are
+ * registered once at startup, allocations which still had to fall back to
+ * the heap are counted. Both are part of the periodic stats.
+ */
+void static_mem_reserve(const char *what, size_t size);
+
+void static_mem_count_fallback(const char *what, size_t size);
+
+typedef struct
+{
+    uint32_t reserved_bytes;    /* static buffers and task stacks */
+    uint32_t fallbacks;         /* heap allocations despite the static mode */
+    uint32_t fallback_bytes;
+} static_mem_stats_t;
+
+void static_mem_get_stats(static_mem_stats_t *stats);
@@ -1,9 +1,18 @@
+#include <stdatomic.h>
 #include <string.h>
 
+#include "sdkconfig.h"
+
 #include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_cpu.h"
 #include "esp_system.h"
+#include "esp_timer.h"
 #include "esp_log.h"
+#include "esp_event.h"
 #include "esp_netif.h"
+#include "esp_wifi.h"
 #include "lwip/err.h"
 #include "lwip/sockets.h"
 #include "lwip/sys.h"
@@ -15,18 +24,23 @@
 #include "mdns.h"
 #endif
 
+#include "lz4_block.h"
+#include "static_mem.h"
 #include "syslog_client.h"
+#include "timestamp.h"
+#include "trace.h"
 
-/* #define SYSLOG_UTF8 */
 
 /* from https://datatracker.ietf.org/doc/html/rfc5424#section-6 */
 #define SYSLOG_NILVALUE "-"
 #define SYSLOG_VERSION "1"
 #define SYSLOG_SP " "
-#define SYSLOG_TIMESTAMP SYSLOG_NILVALUE
+#define SYSLOG_TIMESTAMP SYSLOG_NILVALUE    /* placeholder for the capture time */
 #define SYSLOG_MSGID SYSLOG_NILVALUE
-#define SYSLOG_STRUCTURED_DATA SYSLOG_NILVALUE
-#ifdef SYSLOG_UTF8
+#define SYSLOG_STRUCTURED_DATA SYSLOG_NILVALUE  /* placeholder for the sequence id */
+#define SYSLOG_SD_ID_DROPS "uart@32473"         /* enterprise number for documentation (RFC 5612) */
+#define SYSLOG_SD_ID_FRAGMENT "frag@32473"
+#ifdef CONFIG_SYSLOG_UTF8
 #define SYSLOG_BOM "\xEF\xBB\xBF"         /* UTF-8 byte order mask */
 #else
 #define SYSLOG_BOM ""
@@ -41,17 +55,141 @@
                         SYSLOG_STRUCTURED_DATA SYSLOG_SP \
                         SYSLOG_BOM
 
+#define max(a,b) \
+   ({ __typeof__ (a) _a = (a); \
+       __typeof__ (b) _b = (b); \
+     _a > _b ? _a : _b; })
+
+#define min(a,b) \
+   ({ __typeof__ (a) _a = (a); \
+       __typeof__ (b) _b = (b); \
+     _a < _b ? _a : _b; })
+
+#define TCP_CONNECT_TIMEOUT_MS 1000
+#define SEND_TIMEOUT_MS 250             /*!< a send blocked for longer fails, the message is spooled */
+#define SEND_MAX_ENOMEM_RETRIES 10      /*!< one tick each, then the send fails */
+#define SOCKET_RETRY_MIN_MS 250        /*!< first retry after a socket failed */
+#define SOCKET_RETRY_MAX_MS 30000      /*!< the retry interval doubles up to this */
+#define RESOLVE_RETRY_INTERVAL_MS 10000
+#define RESOLVER_TASK_PRIORITY 2        /*!< below the capture and sender tasks */
+#define RESOLVER_TASK_STACK_SIZE 3072
+
 static const char TAG[] = "SYSLOG";
 
 static const char wifi_sta_if_key[] = "WIFI_STA_DEF";
 
-static int syslog_fd;
-static struct sockaddr_in dest_addr;
+typedef enum
+{
+    RESOLVED_NONE = 0,
+    RESOLVED_DNS,
+    RESOLVED_MDNS,
+    RESOLVED_STATIC,
+} resolved_by_t;
+
+static const char *resolved_by_names[] = { "unresolved", "DNS", "mDNS", "static" };
+
+typedef struct
+{
+    struct sockaddr_storage addr;
+    socklen_t len;              /* 0 if unknown */
+} peer_addr_t;
+
+/**
+ * A syslog server, each with its own socket. The address is re-resolved by
+ * the resolver task, which hands a changed address over through update; the
+ * sending side adopts it between two messages.
+ */
+typedef struct
+{
+    const char *host;
+    const char *fallback;       /* static address if DNS and mDNS fail */
+    unsigned int port;
+    /* sending side */
+    peer_addr_t peer;
+    int fd;
+    TickType_t next_open_tick;
+    uint32_t retry_ms;          /* backoff until the next reopen */
+    unsigned int link_generation;   /* of the link the socket was opened on */
+    /* resolver side */
+    peer_addr_t resolved;
+    TickType_t next_resolve_tick;
+    atomic_bool resolve_now;
+    /* handover */
+    peer_addr_t update;
+    atomic_bool update_pending;
+    struct
+    {
+        atomic_uint sent;
+        atomic_uint enomem_retries;
+        atomic_uint failures;
+        atomic_uint reopens;
+        atomic_uint resolutions;
+        atomic_uint resolve_failures;
+        atomic_uint resolve_ms_max;
+        atomic_uint address_changes;
+        atomic_uint resolved_by;
+    } stats;
+} destination_t;
+
+static destination_t destinations[SYSLOG_CLIENT_MAX_DESTINATIONS];
+static atomic_size_t destination_count;
+static TaskHandle_t resolver_task_handle = NULL;
+
+/* state of the network link, driven by the Wi-Fi and IP events */
+static struct
+{
+    atomic_bool up;
+    atomic_uint generation;         /* changes whenever the link goes down or up */
+    atomic_uint up_since_ms;        /* when the link was restored */
+    atomic_bool recovering;         /* no message delivered since */
+    atomic_uint losses;
+    atomic_uint recoveries;
+    atomic_uint recovery_ms_last;   /* link restored to first message delivered */
+    atomic_uint recovery_ms_max;
+} link_state;
 static int syslog_facility;
 const char *syslog_own_hostname;
 
-static char *syslog_header = NULL;
-static size_t syslog_header_len = 0;
+static struct
+{
+    atomic_uint batch_bytes;
+    atomic_uint compressed_bytes;
+    atomic_uint compress_us;
+} client_stats;
+
+#ifdef CONFIG_SYSLOG_BATCHING
+static char batch_buf[CONFIG_SYSLOG_BATCH_MAX_SIZE];
+static size_t batch_len = 0;
+static unsigned int batch_lines = 0;
+static TickType_t batch_start;
+static bool batch_kept = false;     /* sending the batch failed, it goes out before anything else */
+static SemaphoreHandle_t batch_lock;
+#endif
+
+#ifdef CONFIG_SYSLOG_BATCH_COMPRESSION
+#define COMPRESSED_MAGIC "\xffZ"      /* never starts a syslog message */
+#define COMPRESSED_HEADER_LEN 6
+static lz4_state_t lz4_state;
+static char compressed_buf[CONFIG_SYSLOG_BATCH_MAX_SIZE];
+static size_t compressed_len = 0;   /* frame of the current batch, 0 if not compressed */
+#endif
+
+
+static size_t format_decimal(char *dst, uint32_t value)
+{
+    char digits[10];
+    size_t n = 0;
+    do
+    {
+        digits[n++] = '0' + (value % 10);
+        value /= 10;
+    } while (value > 0);
+    for (size_t i = 0; i < n; i++)
+    {
+        dst[i] = digits[n - 1 - i];
+    }
+    return n;
+}
 
 
 static int get_socket_error_code(int socket)
@@ -107,112 +245,491 @@ static uint32_t resolve_mdns_host(const char *host_name)
 }
 #endif
 
-static uint32_t resolve_host(const char *host)
+static bool lookup_addr(const char *host, unsigned int port, int flags, peer_addr_t *peer)
 {
-    uint32_t result = 0;
+    char service[8];
+    struct addrinfo *result = NULL;
+    const struct addrinfo hints = {
+        .ai_flags = flags,
+        .ai_family = AF_UNSPEC,
+#ifdef CONFIG_SYSLOG_TRANSPORT_TCP
+        .ai_socktype = SOCK_STREAM,
+#else
+        .ai_socktype = SOCK_DGRAM,
+#endif
+    };
+    bool found = false;
 
-    /*
-    esp_netif_t* netif = esp_netif_get_handle_from_ifkey(wifi_sta_if_key);
-    esp_netif_dns_info_t gdns1, gdns2, gdns3;
-    ESP_ERROR_CHECK(esp_netif_get_dns_info(netif, ESP_NETIF_DNS_MAIN, &gdns1));
-    ESP_ERROR_CHECK(esp_netif_get_dns_info(netif, ESP_NETIF_DNS_BACKUP, &gdns2));
-    ESP_ERROR_CHECK(esp_netif_get_dns_info(netif, ESP_NETIF_DNS_FALLBACK, &gdns3));
+    (void) snprintf(service, sizeof(service), "%u", port);
+    if ((getaddrinfo(host, service, &hints, &result) == 0) && result &&
+        (result->ai_addrlen <= sizeof(peer->addr)))
+    {
+        memset(peer, 0, sizeof(*peer));
+        memcpy(&peer->addr, result->ai_addr, result->ai_addrlen);
+        peer->len = result->ai_addrlen;
+        found = true;
+    }
+    if (result)
+    {
+        freeaddrinfo(result);
+    }
+    return found;
+}
 
-    ESP_LOGI(TAG, "DNS servers : " IPSTR " , " IPSTR " , " IPSTR,
-      IP2STR(&gdns1.ip.u_addr.ip4),
-      IP2STR(&gdns2.ip.u_addr.ip4),
-      IP2STR(&gdns3.ip.u_addr.ip4));
-    */
 
-    struct hostent *he = gethostbyname(host);
-    if (he && (he->h_length >= sizeof(result)) && he->h_addr_list && he->h_addr_list[0])
+/**
+ * Resolve the host name (or IPv4/IPv6 address) of a destination by DNS,
+ * failing over to an mDNS query (if enabled) and then to the static address
+ * (if configured). Blocks, so only to be used by the resolver task or during
+ * setup.
+ */
+static resolved_by_t resolve_host(const destination_t *dest, peer_addr_t *peer)
+{
+    if (lookup_addr(dest->host, dest->port, 0, peer))
     {
-        result = *((uint32_t *)(he->h_addr_list[0]));
-        ESP_LOGD(TAG, "DNS query for host name '%s' returned %s", host, inet_ntoa(result));
+        return RESOLVED_DNS;
     }
 #ifdef DO_MDNS_QUERY
-    else
+    const uint32_t mdns_addr = resolve_mdns_host(dest->host);
+    if (mdns_addr)
     {
-        result = resolve_mdns_host(host);
+        struct sockaddr_in *addr = (struct sockaddr_in *)&peer->addr;
+        memset(peer, 0, sizeof(*peer));
+        addr->sin_family = AF_INET;
+        addr->sin_port = htons(dest->port);
+        addr->sin_addr.s_addr = mdns_addr;
+        peer->len = sizeof(*addr);
+        return RESOLVED_MDNS;
     }
 #endif
-    return result;
+    if (dest->fallback && *dest->fallback &&
+        lookup_addr(dest->fallback, dest->port, AI_NUMERICHOST, peer))
+    {
+        return RESOLVED_STATIC;
+    }
+    return RESOLVED_NONE;
 }
 
 
-static void syslog_socket_close()
+static const char *format_addr(const peer_addr_t *peer, char *buf, size_t size)
 {
-    if (syslog_fd > 0)
+    const struct sockaddr *addr = (const struct sockaddr *)&peer->addr;
+    const void *ip = (addr->sa_family == AF_INET6) ?
+                     (const void *)&((const struct sockaddr_in6 *)addr)->sin6_addr :
+                     (const void *)&((const struct sockaddr_in *)addr)->sin_addr;
+    const char *result = inet_ntop(addr->sa_family, ip, buf, size);
+    return result ? result : "?";
+}
+
+
+/**
+ * Resolve a destination again, timing it, and hand the address over to the
+ * sending side if it changed.
+ */
+static void refresh_destination(destination_t *dest)
+{
+    peer_addr_t peer;
+    const int64_t start_us = esp_timer_get_time();
+    const resolved_by_t resolved_by = resolve_host(dest, &peer);
+    const uint32_t elapsed_ms = (esp_timer_get_time() - start_us) / 1000;
+
+    atomic_fetch_add_explicit(&dest->stats.resolutions, 1, memory_order_relaxed);
+    if (elapsed_ms > atomic_load_explicit(&dest->stats.resolve_ms_max, memory_order_relaxed))
     {
-        shutdown(syslog_fd, 2);
-        close(syslog_fd);
+        atomic_store_explicit(&dest->stats.resolve_ms_max, elapsed_ms, memory_order_relaxed);
+    }
+    if (resolved_by == RESOLVED_NONE)
+    {
+        atomic_fetch_add_explicit(&dest->stats.resolve_failures, 1, memory_order_relaxed);
+        ESP_LOGW(TAG, "Cannot resolve syslog host name '%s'", dest->host);
+        dest->next_resolve_tick = xTaskGetTickCount() + pdMS_TO_TICKS(RESOLVE_RETRY_INTERVAL_MS);
+        return;
+    }
+    atomic_store_explicit(&dest->stats.resolved_by, resolved_by, memory_order_relaxed);
+    dest->next_resolve_tick = xTaskGetTickCount() + pdMS_TO_TICKS(CONFIG_SYSLOG_RESOLVE_INTERVAL * 1000);
+
+    if ((peer.len != dest->resolved.len) || (memcmp(&peer.addr, &dest->resolved.addr, peer.len) != 0))
+    {
+        /* the previous update must have been taken, retry soon otherwise */
+        if (atomic_load_explicit(&dest->update_pending, memory_order_acquire))
+        {
+            dest->next_resolve_tick = xTaskGetTickCount() + pdMS_TO_TICKS(SOCKET_RETRY_MIN_MS);
+            return;
+        }
+        char addr[INET6_ADDRSTRLEN];
+        ESP_LOGI(TAG, "Syslog host '%s' is now at %s (%s)", dest->host,
+                 format_addr(&peer, addr, sizeof(addr)), resolved_by_names[resolved_by]);
+        dest->resolved = peer;
+        dest->update = peer;
+        atomic_store_explicit(&dest->update_pending, true, memory_order_release);
+        atomic_fetch_add_explicit(&dest->stats.address_changes, 1, memory_order_relaxed);
     }
-    syslog_fd = 0;
 }
 
 
-void syslog_client_start(const char *host, unsigned int port, int facility)
+/**
+ * Keep the addresses of all destinations up to date: every
+ * CONFIG_SYSLOG_RESOLVE_INTERVAL seconds, and right away after a destination
+ * failed.
+ */
+static void resolver_task(void *pvParameters)
 {
-	syslog_fd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (syslog_fd > 0)
+    (void) pvParameters;
+    for (;;)
     {
-        const uint32_t dest_addr_bytes = resolve_host(host);
-        if (dest_addr_bytes)
+        TickType_t wait = portMAX_DELAY;
+        const size_t count = atomic_load_explicit(&destination_count, memory_order_acquire);
+        for (size_t i = 0; i < count; i++)
         {
-        	ESP_LOGI(TAG, "Logging to %s:%d", inet_ntoa(dest_addr_bytes), port);
-            bzero(&dest_addr, sizeof(dest_addr));
-            dest_addr.sin_family = AF_INET;
-            dest_addr.sin_port = htons(port);
-            dest_addr.sin_addr.s_addr = dest_addr_bytes;
-        	struct timeval send_to = {100,0};
-
-            int err = setsockopt(syslog_fd, SOL_SOCKET, SO_SNDTIMEO, &send_to, sizeof(send_to));
-            if (err >= 0)
+            destination_t *dest = &destinations[i];
+            const TickType_t now = xTaskGetTickCount();
+            if (atomic_exchange_explicit(&dest->resolve_now, false, memory_order_relaxed) ||
+                ((int32_t)(now - dest->next_resolve_tick) >= 0))
             {
-                esp_netif_t* netif = esp_netif_get_handle_from_ifkey(wifi_sta_if_key);
-                if (esp_netif_get_hostname(netif, &syslog_own_hostname) != ESP_OK)
-                {
-                    syslog_own_hostname = SYSLOG_NILVALUE;
-                }
+                refresh_destination(dest);
+            }
+            const TickType_t due = dest->next_resolve_tick - xTaskGetTickCount();
+            wait = ((int32_t)due > 0) ? min(wait, due) : 0;
+        }
+        (void) ulTaskNotifyTake(pdTRUE, wait);
+    }
+}
 
-                syslog_facility = facility;
 
-                ESP_LOGI(TAG, "Remote logging to %s:%d set up successfully", host, port);
-            }
-            else
-            {
-                ESP_LOGE(TAG, "Failed to set SO_SNDTIMEO. Error %d", err);
-                syslog_socket_close();
-            }
+/* ask the resolver to check the address of a failing destination */
+static void request_resolve(destination_t *dest)
+{
+    atomic_store_explicit(&dest->resolve_now, true, memory_order_relaxed);
+    if (resolver_task_handle)
+    {
+        xTaskNotifyGive(resolver_task_handle);
+    }
+}
+
+
+static void destination_close(destination_t *dest)
+{
+    if (dest->fd > 0)
+    {
+        shutdown(dest->fd, 2);
+        close(dest->fd);
+    }
+    dest->fd = 0;
+}
+
+
+#ifdef CONFIG_SYSLOG_TRANSPORT_TCP
+/* connect without blocking the caller for longer than TCP_CONNECT_TIMEOUT_MS */
+static bool destination_connect(destination_t *dest)
+{
+    const int flags = fcntl(dest->fd, F_GETFL, 0);
+    (void) fcntl(dest->fd, F_SETFL, flags | O_NONBLOCK);
+    int err = connect(dest->fd, (struct sockaddr *)&dest->peer.addr, dest->peer.len);
+    if ((err < 0) && (errno == EINPROGRESS))
+    {
+        fd_set write_fds;
+        FD_ZERO(&write_fds);
+        FD_SET(dest->fd, &write_fds);
+        struct timeval timeout = { .tv_sec = TCP_CONNECT_TIMEOUT_MS / 1000,
+                                   .tv_usec = (TCP_CONNECT_TIMEOUT_MS % 1000) * 1000 };
+        err = (select(dest->fd + 1, NULL, &write_fds, NULL, &timeout) > 0) ?
+              get_socket_error_code(dest->fd) : -1;
+    }
+    (void) fcntl(dest->fd, F_SETFL, flags);
+    return err == 0;
+}
+#endif
+
+
+static bool destination_open(destination_t *dest)
+{
+#ifdef CONFIG_SYSLOG_TRANSPORT_TCP
+    dest->fd = socket(dest->peer.addr.ss_family, SOCK_STREAM, 0);
+#else
+    dest->fd = socket(dest->peer.addr.ss_family, SOCK_DGRAM, 0);
+#endif
+    if (dest->fd <= 0)
+    {
+        ESP_LOGE(TAG, "Cannot open socket!");
+        dest->fd = 0;
+        return false;
+    }
+
+    struct timeval send_to = { .tv_sec = SEND_TIMEOUT_MS / 1000, .tv_usec = (SEND_TIMEOUT_MS % 1000) * 1000 };
+    int err = setsockopt(dest->fd, SOL_SOCKET, SO_SNDTIMEO, &send_to, sizeof(send_to));
+    if (err < 0)
+    {
+        ESP_LOGE(TAG, "Failed to set SO_SNDTIMEO. Error %d", err);
+        destination_close(dest);
+        return false;
+    }
+
+#ifdef CONFIG_SYSLOG_TRANSPORT_TCP
+    /* messages are coalesced already, so do not let Nagle delay them further */
+    const int enable = 1;
+    (void) setsockopt(dest->fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    (void) setsockopt(dest->fd, SOL_SOCKET, SO_KEEPALIVE, &enable, sizeof(enable));
+    if (!destination_connect(dest))
+    {
+        ESP_LOGW(TAG, "Cannot connect to syslog server %s", dest->host);
+        destination_close(dest);
+        return false;
+    }
+#endif
+    return true;
+}
+
+
+/**
+ * Check if messages can be sent to a destination. Sockets are re-created
+ * whenever the link came back or the server moved, and reopened (or
+ * reconnected) after an error with a backoff doubling from
+ * SOCKET_RETRY_MIN_MS to SOCKET_RETRY_MAX_MS. While the link is down, no
+ * attempts are made at all.
+ */
+static bool destination_ready(destination_t *dest)
+{
+    const TickType_t now = xTaskGetTickCount();
+    if (atomic_load_explicit(&dest->update_pending, memory_order_acquire))
+    {
+        /* the server moved: send to (or reconnect to) the new address */
+        dest->peer = dest->update;
+        atomic_store_explicit(&dest->update_pending, false, memory_order_release);
+        destination_close(dest);
+        dest->next_open_tick = now;
+    }
+    const unsigned int generation = atomic_load_explicit(&link_state.generation, memory_order_acquire);
+    if (dest->link_generation != generation)
+    {
+        /* sockets do not survive losing the IP address */
+        dest->link_generation = generation;
+        destination_close(dest);
+        dest->retry_ms = SOCKET_RETRY_MIN_MS;
+        dest->next_open_tick = now;
+    }
+    if (!atomic_load_explicit(&link_state.up, memory_order_relaxed))
+    {
+        return false;
+    }
+    if ((dest->fd <= 0) && (dest->peer.len > 0) && ((int32_t)(now - dest->next_open_tick) >= 0))
+    {
+        dest->next_open_tick = now + pdMS_TO_TICKS(dest->retry_ms);
+        if (destination_open(dest))
+        {
+            atomic_fetch_add_explicit(&dest->stats.reopens, 1, memory_order_relaxed);
+            ESP_LOGI(TAG, "Socket to syslog server %s reopened", dest->host);
+            dest->retry_ms = SOCKET_RETRY_MIN_MS;
         }
         else
         {
-            ESP_LOGE(TAG, "Cannot resolve syslog host name '%s'", host);
-            syslog_socket_close();
+            dest->retry_ms = min(dest->retry_ms * 2, (uint32_t)SOCKET_RETRY_MAX_MS);
+            request_resolve(dest);
         }
     }
+    return dest->fd > 0;
+}
+
+
+/**
+ * Follow the link: losing the connection or the IP address takes it down,
+ * getting an address brings it up again. Runs in the event loop task.
+ */
+static void link_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    (void) arg;
+    (void) event_data;
+    const bool up = (event_base == IP_EVENT) && (event_id == IP_EVENT_STA_GOT_IP);
+    if (up == atomic_load_explicit(&link_state.up, memory_order_relaxed))
+    {
+        return;
+    }
+    if (up)
+    {
+        atomic_store_explicit(&link_state.up_since_ms, (uint32_t)(esp_timer_get_time() / 1000), memory_order_relaxed);
+        atomic_store_explicit(&link_state.recovering, true, memory_order_relaxed);
+    }
     else
     {
-       ESP_LOGE(TAG, "Cannot open socket!");
+        atomic_fetch_add_explicit(&link_state.losses, 1, memory_order_relaxed);
+    }
+    atomic_store_explicit(&link_state.up, up, memory_order_relaxed);
+    atomic_fetch_add_explicit(&link_state.generation, 1, memory_order_release);
+    ESP_LOGI(TAG, "Link %s", up ? "up" : "down");
+
+    if (up)
+    {
+        /* the network may be a different one now */
+        const size_t count = atomic_load_explicit(&destination_count, memory_order_acquire);
+        for (size_t i = 0; i < count; i++)
+        {
+            request_resolve(&destinations[i]);
+        }
     }
 }
 
 
-char *build_syslog_client_header(int severity, const char *app_name, const char *task_name)
+/* account the time from restoring the link to the first delivered message */
+static void link_delivered()
+{
+    if (atomic_load_explicit(&link_state.recovering, memory_order_relaxed) &&
+        atomic_exchange_explicit(&link_state.recovering, false, memory_order_relaxed))
+    {
+        const uint32_t elapsed_ms = (uint32_t)(esp_timer_get_time() / 1000) -
+                                    atomic_load_explicit(&link_state.up_since_ms, memory_order_relaxed);
+        atomic_fetch_add_explicit(&link_state.recoveries, 1, memory_order_relaxed);
+        atomic_store_explicit(&link_state.recovery_ms_last, elapsed_ms, memory_order_relaxed);
+        if (elapsed_ms > atomic_load_explicit(&link_state.recovery_ms_max, memory_order_relaxed))
+        {
+            atomic_store_explicit(&link_state.recovery_ms_max, elapsed_ms, memory_order_relaxed);
+        }
+        ESP_LOGI(TAG, "First message delivered %u ms after the link came back", (unsigned)elapsed_ms);
+    }
+}
+
+
+/* check if any destination can be sent to */
+static bool syslog_socket_ready()
+{
+    bool ready = false;
+    const size_t count = atomic_load_explicit(&destination_count, memory_order_acquire);
+    for (size_t i = 0; i < count; i++)
+    {
+        ready |= destination_ready(&destinations[i]);
+    }
+    return ready;
+}
+
+
+void syslog_client_start(int facility)
+{
+#ifdef CONFIG_SYSLOG_BATCHING
+    if (batch_lock == NULL)
+    {
+#ifdef CONFIG_SYSLOG_STATIC_MEMORY
+        static StaticSemaphore_t batch_lock_buffer;
+        batch_lock = xSemaphoreCreateMutexStatic(&batch_lock_buffer);
+        static_mem_reserve("batch buffers", sizeof(batch_buf) + sizeof(batch_lock_buffer));
+#ifdef CONFIG_SYSLOG_BATCH_COMPRESSION
+        static_mem_reserve("compression buffers", sizeof(lz4_state) + sizeof(compressed_buf));
+#endif
+#else
+        batch_lock = xSemaphoreCreateMutex();
+#endif
+        assert(batch_lock);
+    }
+#endif
+
+    esp_netif_t* netif = esp_netif_get_handle_from_ifkey(wifi_sta_if_key);
+    if (esp_netif_get_hostname(netif, &syslog_own_hostname) != ESP_OK)
+    {
+        syslog_own_hostname = SYSLOG_NILVALUE;
+    }
+    syslog_facility = facility;
+
+    esp_netif_ip_info_t ip_info;
+    atomic_store_explicit(&link_state.up, (esp_netif_get_ip_info(netif, &ip_info) == ESP_OK) && (ip_info.ip.addr != 0),
+                          memory_order_relaxed);
+    ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, link_event_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_LOST_IP, link_event_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, link_event_handler, NULL));
+
+    if (resolver_task_handle == NULL)
+    {
+#ifdef CONFIG_SYSLOG_STATIC_MEMORY
+        static StackType_t resolver_task_stack[RESOLVER_TASK_STACK_SIZE];
+        static StaticTask_t resolver_task_buffer;
+        static_mem_reserve("resolver task", sizeof(resolver_task_stack) + sizeof(resolver_task_buffer));
+        resolver_task_handle = xTaskCreateStatic(resolver_task, "syslog_resolver", RESOLVER_TASK_STACK_SIZE,
+                                                 NULL, RESOLVER_TASK_PRIORITY, resolver_task_stack,
+                                                 &resolver_task_buffer);
+#else
+        xTaskCreate(resolver_task, "syslog_resolver", RESOLVER_TASK_STACK_SIZE,
+                    NULL, RESOLVER_TASK_PRIORITY, &resolver_task_handle);
+#endif
+    }
+}
+
+
+/**
+ * Add a syslog server (host name, IPv4 or IPv6 address) all messages are sent
+ * to, with an optional static address to fall back to. It is resolved once
+ * here, and from then on in the background. To be called after
+ * syslog_client_start() and before sending.
+ */
+bool syslog_client_add_destination(const char *host, const char *fallback, unsigned int port)
+{
+    const size_t count = atomic_load_explicit(&destination_count, memory_order_relaxed);
+    if (count >= SYSLOG_CLIENT_MAX_DESTINATIONS)
+    {
+        ESP_LOGE(TAG, "Cannot send to more than %d syslog servers", SYSLOG_CLIENT_MAX_DESTINATIONS);
+        return false;
+    }
+    destination_t *dest = &destinations[count];
+    bzero(dest, sizeof(*dest));
+    dest->host = host;
+    dest->fallback = fallback;
+    dest->port = port;
+    dest->retry_ms = SOCKET_RETRY_MIN_MS;
+    dest->link_generation = atomic_load_explicit(&link_state.generation, memory_order_acquire);
+    atomic_init(&dest->resolve_now, false);
+    atomic_init(&dest->update_pending, false);
+    atomic_init(&dest->stats.sent, 0);
+    atomic_init(&dest->stats.enomem_retries, 0);
+    atomic_init(&dest->stats.failures, 0);
+    atomic_init(&dest->stats.reopens, 0);
+    atomic_init(&dest->stats.resolutions, 0);
+    atomic_init(&dest->stats.resolve_failures, 0);
+    atomic_init(&dest->stats.resolve_ms_max, 0);
+    atomic_init(&dest->stats.address_changes, 0);
+    atomic_init(&dest->stats.resolved_by, RESOLVED_NONE);
+
+    refresh_destination(dest);
+    if (atomic_load_explicit(&dest->update_pending, memory_order_relaxed))
+    {
+        dest->peer = dest->update;
+        atomic_store_explicit(&dest->update_pending, false, memory_order_relaxed);
+    }
+    if ((dest->peer.len > 0) && destination_open(dest))
+    {
+        ESP_LOGI(TAG, "Remote logging to %s:%u set up successfully", host, port);
+    }
+    else
+    {
+        dest->next_open_tick = xTaskGetTickCount() + pdMS_TO_TICKS(dest->retry_ms);
+    }
+    atomic_store_explicit(&destination_count, count + 1, memory_order_release);
+    if (resolver_task_handle)
+    {
+        xTaskNotifyGive(resolver_task_handle);
+    }
+    return true;
+}
+
+
+/**
+ * Format the header template for the given severity into dst, like snprintf:
+ * the result is truncated to size and the untruncated length returned.
+ */
+size_t syslog_client_format_header(char *dst, size_t size, int severity,
+                                   const char *app_name, const char *task_name)
 {
     /* check validity of app_name and task_name */
     const char *app_name_use = (app_name && *app_name) ? app_name : SYSLOG_NILVALUE;
     const char *task_name_use = (task_name && *task_name) ? task_name : SYSLOG_NILVALUE;
 
-    size_t max_header_size = strlen(SYSLOG_TEMPLATE) +
-                             strlen(syslog_own_hostname) +
-                             strlen(app_name_use) +
-                             strlen(task_name_use) + 1;
+    const int len = snprintf(dst, size, SYSLOG_TEMPLATE,
+                             syslog_facility | severity, syslog_own_hostname,
+                             app_name_use, task_name_use);
+    return max(len, 0);
+}
+
+
+char *build_syslog_client_header(int severity, const char *app_name, const char *task_name)
+{
+    size_t max_header_size = syslog_client_format_header(NULL, 0, severity, app_name, task_name) + 1;
     char *syslog_header = (char *)malloc(max_header_size);
     assert(syslog_header);
-    (void) snprintf(syslog_header, max_header_size, SYSLOG_TEMPLATE,
-                    syslog_facility | severity, syslog_own_hostname,
-                    app_name_use, task_name_use);
+    (void) syslog_client_format_header(syslog_header, max_header_size, severity, app_name, task_name);
 
     ESP_LOGD(TAG, "Intermediate template '%s'", syslog_header);
 
@@ -220,46 +737,506 @@ char *build_syslog_client_header(int severity, const char *app_name, const char
 }
 
 
-void syslog_client_send_with_header(const char *str, int len)
+static bool destination_sendmsg(destination_t *dest, const struct iovec *iov, int iovcnt)
 {
-    bool retry = true;
-    int err;
-    if (len < 0)
-    {
-        len = strlen(str);
-    }
-    while (retry)
+    int err = 0;
+    /* only the descriptors are copied, as a stream socket may consume them */
+    struct iovec remaining[iovcnt];
+    memcpy(remaining, iov, iovcnt * sizeof(*iov));
+    struct msghdr msg = {
+#ifndef CONFIG_SYSLOG_TRANSPORT_TCP
+        .msg_name = &dest->peer.addr,
+        .msg_namelen = dest->peer.len,
+#endif
+        .msg_iov = remaining,
+        .msg_iovlen = iovcnt,
+    };
+    unsigned int retries = 0;
+    bool partial = false;       /* a part of the message is in the stream already */
+#ifdef CONFIG_SYSLOG_TRACE
+    const uint32_t start = esp_cpu_get_cycle_count();
+#endif
+    while (msg.msg_iovlen > 0)
     {
-        err = sendto(syslog_fd, str, len, 0, (struct sockaddr *)&dest_addr, sizeof(dest_addr));
-        if ((err < 0) && (errno == ENOMEM))
+        err = sendmsg(dest->fd, &msg, 0);
+        if (err < 0)
         {
+            if ((errno != ENOMEM) || (retries >= SEND_MAX_ENOMEM_RETRIES))
+            {
+                break;
+            }
             /* let network stack empty out its send buffers,
                see https://docs.espressif.com/projects/esp-idf/en/latest/esp32/api-guides/lwip.html#limitations */
+            atomic_fetch_add_explicit(&dest->stats.enomem_retries, 1, memory_order_relaxed);
+            retries += 1;
             vTaskDelay(1);
+            continue;
         }
-        else
+#ifdef CONFIG_SYSLOG_TRANSPORT_TCP
+        /* a stream socket may accept only a part, so skip what was written */
+        partial = true;
+        size_t written = err;
+        while ((msg.msg_iovlen > 0) && (written >= msg.msg_iov->iov_len))
+        {
+            written -= msg.msg_iov->iov_len;
+            msg.msg_iov += 1;
+            msg.msg_iovlen -= 1;
+        }
+        if (msg.msg_iovlen > 0)
         {
-            retry = false;
+            msg.msg_iov->iov_base = (char *)msg.msg_iov->iov_base + written;
+            msg.msg_iov->iov_len -= written;
         }
+#else
+        break;
+#endif
+    }
+#ifdef CONFIG_SYSLOG_TRACE
+    trace_record(TRACE_SEND, esp_cpu_get_cycle_count() - start);
+#endif
+    if ((err < 0) && (errno == ENOMEM) && !partial)
+    {
+        /* the socket is fine, the message goes to the spool */
+        atomic_fetch_add_explicit(&dest->stats.failures, 1, memory_order_relaxed);
+        ESP_LOGW(TAG, "sendmsg to %s gave up after %u ENOMEM retries", dest->host, retries);
+        return false;
     }
     if (err < 0)
     {
-        show_socket_error_reason(syslog_fd);
-        ESP_LOGE(TAG, "sendto failed with %d", err);
-        syslog_client_stop();   /* FIXME: */
+        show_socket_error_reason(dest->fd);
+        atomic_fetch_add_explicit(&dest->stats.failures, 1, memory_order_relaxed);
+        ESP_LOGE(TAG, "sendmsg to %s failed with %d", dest->host, err);
+        /* reopen (or reconnect) on one of the next sends, the server may have moved */
+        destination_close(dest);
+        dest->next_open_tick = xTaskGetTickCount() + pdMS_TO_TICKS(dest->retry_ms);
+        dest->retry_ms = min(dest->retry_ms * 2, (uint32_t)SOCKET_RETRY_MAX_MS);
+        request_resolve(dest);
+        return false;
     }
+    atomic_fetch_add_explicit(&dest->stats.sent, 1, memory_order_relaxed);
+    link_delivered();
+    return true;
 }
 
 
-void syslog_client_stop()
+/**
+ * Send one message (or batch) to every healthy destination, from the same
+ * fragments. Returns true if at least one destination took it.
+ */
+static bool syslog_client_sendmsg(struct iovec *iov, int iovcnt)
+{
+    bool sent = false;
+    const size_t count = atomic_load_explicit(&destination_count, memory_order_acquire);
+    for (size_t i = 0; i < count; i++)
+    {
+        destination_t *dest = &destinations[i];
+        if (destination_ready(dest) && destination_sendmsg(dest, iov, iovcnt))
+        {
+            sent = true;
+        }
+    }
+    return sent;
+}
+
+
+#ifdef CONFIG_SYSLOG_BATCH_COMPRESSION
+/**
+ * Compress the current batch into a frame: 0xff 'Z', the uncompressed and the
+ * compressed size (16 bits each, little endian), and one LZ4 block. See
+ * tools/syslog_relay.py for the receiving side. Returns 0 if the frame would
+ * not be smaller than the batch.
+ */
+static size_t syslog_batch_compress()
+{
+    if (batch_len <= COMPRESSED_HEADER_LEN)
+    {
+        return 0;
+    }
+    const int64_t start_us = esp_timer_get_time();
+    const size_t block_len = lz4_compress_block(&lz4_state, batch_buf, batch_len,
+                                                compressed_buf + COMPRESSED_HEADER_LEN,
+                                                batch_len - COMPRESSED_HEADER_LEN);
+    const size_t frame_len = (block_len > 0) ? COMPRESSED_HEADER_LEN + block_len : 0;
+    if (frame_len > 0)
+    {
+        memcpy(compressed_buf, COMPRESSED_MAGIC, 2);
+        compressed_buf[2] = (char)batch_len;
+        compressed_buf[3] = (char)(batch_len >> 8);
+        compressed_buf[4] = (char)block_len;
+        compressed_buf[5] = (char)(block_len >> 8);
+    }
+    atomic_fetch_add_explicit(&client_stats.compress_us, esp_timer_get_time() - start_us, memory_order_relaxed);
+    atomic_fetch_add_explicit(&client_stats.batch_bytes, batch_len, memory_order_relaxed);
+    atomic_fetch_add_explicit(&client_stats.compressed_bytes, (frame_len > 0) ? frame_len : batch_len, memory_order_relaxed);
+    return frame_len;
+}
+#endif
+
+
+#ifdef CONFIG_SYSLOG_BATCHING
+/**
+ * Send the current batch. A batch which cannot be sent is kept as it is, and
+ * sent again before another message is accepted, so that its messages are
+ * not lost but neither overtaken by the ones spooled meanwhile. Returns false
+ * if the batch was kept.
+ */
+static bool syslog_batch_flush_locked()
+{
+    if (batch_len == 0)
+    {
+        return true;
+    }
+    struct iovec iov = { .iov_base = batch_buf, .iov_len = batch_len };
+#ifdef CONFIG_SYSLOG_BATCH_COMPRESSION
+    if (!batch_kept)
+    {
+        compressed_len = syslog_batch_compress();
+    }
+    if (compressed_len > 0)
+    {
+        iov.iov_base = compressed_buf;
+        iov.iov_len = compressed_len;
+    }
+#endif
+    batch_kept = !syslog_client_sendmsg(&iov, 1);
+    if (!batch_kept)
+    {
+        batch_len = 0;
+        batch_lines = 0;
+    }
+    return !batch_kept;
+}
+
+
+#ifdef CONFIG_SYSLOG_BATCH_FRAMING_OCTET_COUNTING
+static size_t format_octet_count(char *dst, size_t value)
+{
+    const size_t n = format_decimal(dst, value);
+    dst[n] = ' ';
+    return n + 1;
+}
+#endif
+
+
+/**
+ * Append one message (given as fragments) to the current batch. The batch is
+ * sent before it would overflow and as soon as it holds the maximum number
+ * of messages. Messages are refused while the socket is down or an earlier
+ * batch could not be sent yet, so that the caller spools them.
+ */
+static bool syslog_batch_append(struct iovec *iov, int iovcnt)
+{
+    bool accepted = true;
+    size_t msg_len = 0;
+    for (int i = 0; i < iovcnt; i++)
+    {
+        msg_len += iov[i].iov_len;
+    }
+#ifdef CONFIG_SYSLOG_BATCH_FRAMING_OCTET_COUNTING
+    const size_t framing_len = 5 + 1;       /* worst case of "<len> " */
+#else
+    const size_t framing_len = 1;           /* "\n" */
+#endif
+
+    xSemaphoreTake(batch_lock, portMAX_DELAY);
+    if ((batch_kept || (batch_len + framing_len + msg_len > sizeof(batch_buf))) &&
+        !syslog_batch_flush_locked())
+    {
+        accepted = false;
+    }
+    else if (!syslog_socket_ready())
+    {
+        accepted = false;
+    }
+    else if (framing_len + msg_len > sizeof(batch_buf))
+    {
+        /* does not fit into any batch -> send it framed on its own */
+        struct iovec framed[iovcnt + 2];
+        char prefix[framing_len];
+        framed[0].iov_base = prefix;
+        framed[0].iov_len = 0;
+        memcpy(&framed[1], iov, iovcnt * sizeof(*iov));
+        framed[iovcnt + 1].iov_base = "\n";
+        framed[iovcnt + 1].iov_len = 0;
+#ifdef CONFIG_SYSLOG_BATCH_FRAMING_OCTET_COUNTING
+        framed[0].iov_len = format_octet_count(prefix, msg_len);
+#else
+        framed[iovcnt + 1].iov_len = 1;
+#endif
+        accepted = syslog_client_sendmsg(framed, iovcnt + 2);
+    }
+    else
+    {
+        char *dst = batch_buf + batch_len;
+#ifdef CONFIG_SYSLOG_BATCH_FRAMING_OCTET_COUNTING
+        dst += format_octet_count(dst, msg_len);
+#endif
+        for (int i = 0; i < iovcnt; i++)
+        {
+            memcpy(dst, iov[i].iov_base, iov[i].iov_len);
+            dst += iov[i].iov_len;
+        }
+#ifndef CONFIG_SYSLOG_BATCH_FRAMING_OCTET_COUNTING
+        *dst++ = '\n';
+#endif
+        batch_len = dst - batch_buf;
+
+        if (batch_lines == 0)
+        {
+            batch_start = xTaskGetTickCount();
+        }
+        batch_lines += 1;
+        if (batch_lines >= CONFIG_SYSLOG_BATCH_MAX_LINES)
+        {
+            (void) syslog_batch_flush_locked();
+        }
+    }
+    xSemaphoreGive(batch_lock);
+    return accepted;
+}
+#endif
+
+
+static bool syslog_client_send_iov(struct iovec *iov, int iovcnt)
+{
+#ifdef CONFIG_SYSLOG_BATCHING
+    return syslog_batch_append(iov, iovcnt);
+#else
+    return syslog_client_sendmsg(iov, iovcnt);
+#endif
+}
+
+
+/* add the fragments of a (possibly wrapped) line span */
+static inline int append_span_iov(struct iovec *iov, int iovcnt, const line_span_t *span)
+{
+    iov[iovcnt++] = (struct iovec) { .iov_base = (void *)span->seg[0], .iov_len = span->len[0] };
+    if (span->len[1] > 0)
+    {
+        iov[iovcnt++] = (struct iovec) { .iov_base = (void *)span->seg[1], .iov_len = span->len[1] };
+    }
+    return iovcnt;
+}
+
+
+/**
+ * Send a header fragment followed by the one or two segments of a span, e.g.
+ * straight out of a line ring, gathered into one message without copying.
+ * Returns false if it could not be sent (or batched).
+ */
+bool syslog_client_send_with_header(const char *header, size_t header_len, const line_span_t *span)
+{
+    struct iovec iov[3];
+    int iovcnt = 0;
+    if (header_len > 0)
+    {
+        iov[iovcnt++] = (struct iovec) { .iov_base = (void *)header, .iov_len = header_len };
+    }
+    iovcnt = append_span_iov(iov, iovcnt, span);
+    return syslog_client_send_iov(iov, iovcnt);
+}
+
+
+/**
+ * Send a span as it is, without header or framing: one datagram per span via
+ * UDP, or a plain byte stream via TCP. Raw chunks are not batched, they are
+ * about as large as a batch anyway. Returns false if it could not be sent.
+ */
+bool syslog_client_send_raw(const line_span_t *span)
+{
+    struct iovec iov[2];
+    const int iovcnt = append_span_iov(iov, 0, span);
+    return syslog_client_sendmsg(iov, iovcnt);
+}
+
+
+static inline char *append_str(char *dst, const char *str)
+{
+    const size_t len = strlen(str);
+    memcpy(dst, str, len);
+    return dst + len;
+}
+
+
+static inline char *append_param(char *dst, const char *name, uint32_t value)
+{
+    dst = append_str(dst, name);
+    dst = append_str(dst, "=\"");
+    dst += format_decimal(dst, value);
+    *dst++ = '"';
+    return dst;
+}
+
+
+/**
+ * Build the STRUCTURED-DATA of a message: the RFC 5424 "meta" element with
+ * the sequence number, the part of a split line, and, if given, the drop
+ * counters of its source. dst must hold SYSLOG_SD_MAX_LEN characters.
+ */
+size_t syslog_client_build_sd(char *dst, const line_record_t *record, const syslog_drop_counters_t *counters)
+{
+    char *p = dst;
+    p = append_str(p, "[meta ");
+    p = append_param(p, "sequenceId", record->seq);
+    *p++ = ']';
+    if (record->span.part > 0)
+    {
+        p = append_str(p, "[" SYSLOG_SD_ID_FRAGMENT);
+        p = append_param(p, " id", record->fragment_id);
+        p = append_param(p, " part", record->span.part);
+        p = append_param(p, " more", record->span.more);
+        *p++ = ']';
+    }
+    if (counters)
+    {
+        p = append_str(p, "[" SYSLOG_SD_ID_DROPS);
+        p = append_param(p, " flushedBytes", counters->flushed_bytes);
+        p = append_param(p, " fifoOverflows", counters->fifo_overflows);
+        p = append_param(p, " frameErrors", counters->frame_errors);
+        p = append_param(p, " splitLines", counters->split_lines);
+        *p++ = ']';
+    }
+    return p - dst;
+}
+
+
+/**
+ * Send a line straight out of the line ring, gathering the header, the
+ * capture timestamp, the structured data and the (possibly wrapped) line into
+ * one datagram without copying. The timestamp and the structured data replace
+ * the NILVALUE placeholders of the header. Returns false if the line could
+ * not be sent (or batched). Only to be called from the sender task.
+ */
+bool syslog_client_send_record(const char *header, size_t header_len,
+                               const char *sd, size_t sd_len,
+                               const line_record_t *record)
 {
-    syslog_socket_close();
+    static timestamp_cache_t timestamp_cache;
+    char timestamp[TIMESTAMP_MAX_LEN];
+    struct iovec iov[7];
+    int iovcnt = 0;
+    size_t pos = 0;
 
-    if (syslog_header && false)    /* FIXME: */
+    /* the timestamp field follows the first space, the structured data field
+       is the last one, see SYSLOG_TEMPLATE */
+    const char *ts_field = memchr(header, ' ', header_len);
+    const size_t sd_pos = header_len - strlen(SYSLOG_BOM) - strlen(SYSLOG_SP) - strlen(SYSLOG_STRUCTURED_DATA);
+    if ((record->timestamp_us > 0) && ts_field)
+    {
+        const size_t ts_pos = ts_field + 1 - header;
+        iov[iovcnt++] = (struct iovec) { .iov_base = (void *)header, .iov_len = ts_pos };
+        iov[iovcnt++] = (struct iovec) { .iov_base = timestamp,
+                                         .iov_len = timestamp_format(&timestamp_cache, record->timestamp_us, timestamp) };
+        pos = ts_pos + strlen(SYSLOG_TIMESTAMP);
+    }
+    if ((sd_len > 0) && (sd_pos >= pos) && (sd_pos < header_len))
+    {
+        iov[iovcnt++] = (struct iovec) { .iov_base = (void *)(header + pos), .iov_len = sd_pos - pos };
+        iov[iovcnt++] = (struct iovec) { .iov_base = (void *)sd, .iov_len = sd_len };
+        pos = sd_pos + strlen(SYSLOG_STRUCTURED_DATA);
+    }
+    iov[iovcnt++] = (struct iovec) { .iov_base = (void *)(header + pos), .iov_len = header_len - pos };
+    iovcnt = append_span_iov(iov, iovcnt, &record->span);
+    return syslog_client_send_iov(iov, iovcnt);
+}
+
+
+/**
+ * Check if the socket is (or could be re-)opened.
+ */
+bool syslog_client_ready()
+{
+    return syslog_socket_ready();
+}
+
+
+/**
+ * Send a pending batch whose deadline has passed, or retry a kept one.
+ * Returns the number of ticks until the next deadline, which callers use as
+ * their maximum blocking time.
+ */
+TickType_t syslog_client_poll()
+{
+    TickType_t wait = portMAX_DELAY;
+#ifdef CONFIG_SYSLOG_BATCHING
+    xSemaphoreTake(batch_lock, portMAX_DELAY);
+    if (batch_lines > 0)
+    {
+        const TickType_t max_delay = max(pdMS_TO_TICKS(CONFIG_SYSLOG_BATCH_MAX_DELAY_MS), (TickType_t)1);
+        const TickType_t elapsed = xTaskGetTickCount() - batch_start;
+        if (elapsed >= max_delay)
+        {
+            if (!syslog_batch_flush_locked())
+            {
+                wait = max(pdMS_TO_TICKS(SOCKET_RETRY_MIN_MS), (TickType_t)1);
+            }
+        }
+        else
+        {
+            wait = max_delay - elapsed;
+        }
+    }
+    xSemaphoreGive(batch_lock);
+#endif
+    return wait;
+}
+
+
+void syslog_client_get_stats(syslog_client_stats_t *stats)
+{
+    stats->enomem_retries = 0;
+    stats->send_errors = 0;
+    stats->reopens = 0;
+    stats->link_up = atomic_load_explicit(&link_state.up, memory_order_relaxed);
+    stats->link_losses = atomic_load_explicit(&link_state.losses, memory_order_relaxed);
+    stats->recoveries = atomic_load_explicit(&link_state.recoveries, memory_order_relaxed);
+    stats->recovery_ms_last = atomic_load_explicit(&link_state.recovery_ms_last, memory_order_relaxed);
+    stats->recovery_ms_max = atomic_load_explicit(&link_state.recovery_ms_max, memory_order_relaxed);
+    const size_t count = atomic_load_explicit(&destination_count, memory_order_acquire);
+    for (size_t i = 0; i < count; i++)
+    {
+        destination_t *dest = &destinations[i];
+        stats->enomem_retries += atomic_load_explicit(&dest->stats.enomem_retries, memory_order_relaxed);
+        stats->send_errors += atomic_load_explicit(&dest->stats.failures, memory_order_relaxed);
+        stats->reopens += atomic_load_explicit(&dest->stats.reopens, memory_order_relaxed);
+    }
+    stats->batch_bytes = atomic_load_explicit(&client_stats.batch_bytes, memory_order_relaxed);
+    stats->compressed_bytes = atomic_load_explicit(&client_stats.compressed_bytes, memory_order_relaxed);
+    stats->compress_us = atomic_load_explicit(&client_stats.compress_us, memory_order_relaxed);
+}
+
+
+/**
+ * Get the counters of up to max destinations, returns their number.
+ */
+size_t syslog_client_get_destination_stats(syslog_destination_stats_t *stats, size_t max)
+{
+    const size_t count = atomic_load_explicit(&destination_count, memory_order_acquire);
+    size_t i;
+    for (i = 0; (i < count) && (i < max); i++)
+    {
+        destination_t *dest = &destinations[i];
+        stats[i].host = dest->host;
+        stats[i].connected = dest->fd > 0;
+        stats[i].sent = atomic_load_explicit(&dest->stats.sent, memory_order_relaxed);
+        stats[i].enomem_retries = atomic_load_explicit(&dest->stats.enomem_retries, memory_order_relaxed);
+        stats[i].failures = atomic_load_explicit(&dest->stats.failures, memory_order_relaxed);
+        stats[i].reopens = atomic_load_explicit(&dest->stats.reopens, memory_order_relaxed);
+        stats[i].resolved_by = resolved_by_names[atomic_load_explicit(&dest->stats.resolved_by, memory_order_relaxed)];
+        stats[i].resolutions = atomic_load_explicit(&dest->stats.resolutions, memory_order_relaxed);
+        stats[i].resolve_failures = atomic_load_explicit(&dest->stats.resolve_failures, memory_order_relaxed);
+        stats[i].resolve_ms_max = atomic_load_explicit(&dest->stats.resolve_ms_max, memory_order_relaxed);
+        stats[i].address_changes = atomic_load_explicit(&dest->stats.address_changes, memory_order_relaxed);
+    }
+    return i;
+}
+
+
+void syslog_client_stop()
+{
+    const size_t count = atomic_load_explicit(&destination_count, memory_order_acquire);
+    for (size_t i = 0; i < count; i++)
     {
-        char *temp = syslog_header;
-        syslog_header = NULL;
-        syslog_header_len = 0;
-        free(temp);
+        destination_close(&destinations[i]);
     }
 }
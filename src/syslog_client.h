@@ -1,5 +1,13 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "line_queue.h"
+
 /* severities */
 #define SYSLOG_EMERG       0       /* system is unusable */
 #define SYSLOG_ALERT       1       /* action must be taken immediately */
@@ -33,10 +41,77 @@
 #define SYSLOG_LOCAL6      (22<<3) /* reserved for local use */
 #define SYSLOG_LOCAL7      (23<<3) /* reserved for local use */
 
-void syslog_client_start(const char *host, unsigned int port, int facility);
+/* drop accounting of a source, reported as structured data */
+typedef struct
+{
+    uint32_t flushed_bytes;     /* discarded by flushing the UART input */
+    uint32_t fifo_overflows;
+    uint32_t frame_errors;
+    uint32_t split_lines;
+} syslog_drop_counters_t;
+
+#define SYSLOG_SD_MAX_LEN 224
+#define SYSLOG_HEADER_MAX_LEN 128   /* for headers formatted into static buffers */
+
+#define SYSLOG_CLIENT_MAX_DESTINATIONS 4
+
+/* transport counters since start, summed over all destinations */
+typedef struct
+{
+    uint32_t enomem_retries;    /* sends delayed until lwIP had buffers again */
+    uint32_t send_errors;
+    uint32_t reopens;           /* sockets (or connections) re-established */
+    uint32_t batch_bytes;       /* batches before compression */
+    uint32_t compressed_bytes;  /* batches as sent after compression */
+    uint32_t compress_us;       /* CPU time spent compressing */
+    bool link_up;               /* connected with an IP address */
+    uint32_t link_losses;
+    uint32_t recoveries;
+    uint32_t recovery_ms_last;  /* link restored to first message delivered */
+    uint32_t recovery_ms_max;
+} syslog_client_stats_t;
+
+/* counters of one destination since start */
+typedef struct
+{
+    const char *host;
+    bool connected;             /* its socket is open */
+    uint32_t sent;              /* messages (or batches) taken by the socket */
+    uint32_t enomem_retries;
+    uint32_t failures;          /* messages lost for this destination */
+    uint32_t reopens;
+    const char *resolved_by;    /* "DNS", "mDNS", "static" or "unresolved" */
+    uint32_t resolutions;
+    uint32_t resolve_failures;
+    uint32_t resolve_ms_max;    /* slowest resolution */
+    uint32_t address_changes;
+} syslog_destination_stats_t;
+
+void syslog_client_start(int facility);
+
+bool syslog_client_add_destination(const char *host, const char *fallback, unsigned int port);
+
+size_t syslog_client_format_header(char *dst, size_t size, int severity,
+                                   const char *app_name, const char *task_name);
 
 char *build_syslog_client_header(int severity, const char *app_name, const char *task_name);
 
-void syslog_client_send_with_header(const char *str, int len);
+bool syslog_client_send_with_header(const char *header, size_t header_len, const line_span_t *span);
+
+bool syslog_client_send_raw(const line_span_t *span);
+
+size_t syslog_client_build_sd(char *dst, const line_record_t *record, const syslog_drop_counters_t *counters);
+
+bool syslog_client_send_record(const char *header, size_t header_len,
+                               const char *sd, size_t sd_len,
+                               const line_record_t *record);
+
+TickType_t syslog_client_poll();
+
+bool syslog_client_ready();
+
+void syslog_client_get_stats(syslog_client_stats_t *stats);
+
+size_t syslog_client_get_destination_stats(syslog_destination_stats_t *stats, size_t max);
 
 void syslog_client_stop();
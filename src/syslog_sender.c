@@ -0,0 +1,805 @@
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "esp_rom_sys.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+
+#include "sdkconfig.h"
+#include "histogram.h"
+#include "ps_policy.h"
+#include "sanitize.h"
+#include "spool.h"
+#include "static_mem.h"
+#include "syslog_client.h"
+#include "syslog_sender.h"
+#include "timestamp.h"
+#include "trace.h"
+#include "wifi_helper.h"
+
+#define SENDER_TASK_PRIORITY 12         /*!< below the LwIP and Wifi tasks */
+#define SENDER_TASK_STACK_SIZE 4096
+#define SENDER_QUOTA 8                  /*!< lines per source and round */
+#define SENDER_STATS_INTERVAL_MS (CONFIG_SYSLOG_STATS_INTERVAL * 1000)
+#define POWER_SAVE_INTERVAL_MS 250      /*!< evaluation of the power save policy */
+#define SPOOL_RETRY_MS 250              /*!< replay attempts while the server is unreachable */
+
+#define max(a,b) \
+   ({ __typeof__ (a) _a = (a); \
+       __typeof__ (b) _b = (b); \
+     _a > _b ? _a : _b; })
+
+#define min(a,b) \
+   ({ __typeof__ (a) _a = (a); \
+       __typeof__ (b) _b = (b); \
+     _a < _b ? _a : _b; })
+
+static const char *TAG = "syslog_sender";
+
+static syslog_source_t *sources[SYSLOG_SENDER_MAX_SOURCES];
+static atomic_size_t source_count;
+static TaskHandle_t sender_task_handle = NULL;
+
+/* throughput and capture-to-send latency since the last stats output */
+static histogram_t latency_histogram;
+#ifdef CONFIG_SYSLOG_IDLE_FLUSH
+static histogram_t partial_latency_histogram;   /* of incomplete lines, from their last byte */
+#endif
+static uint32_t lines_sent = 0;
+static uint32_t bytes_sent = 0;
+static TickType_t stats_start = 0;
+
+#ifdef CONFIG_SYSLOG_WIFI_ADAPTIVE_PS
+static ps_policy_t ps_policy;
+static uint32_t ps_sent_bytes = 0;              /* running total for the policy */
+static TickType_t ps_last_tick = 0;
+static histogram_t ps_latency_histogram[PS_POLICY_MODES];
+static const char *ps_mode_names[PS_POLICY_MODES] = { "save", "performance" };
+#endif
+
+#ifdef CONFIG_SYSLOG_STATS_EXPORT
+static char *stats_header = NULL;
+static size_t stats_header_len = 0;
+#endif
+
+#ifdef CONFIG_SYSLOG_STATIC_MEMORY
+static StackType_t sender_task_stack[SENDER_TASK_STACK_SIZE];
+static StaticTask_t sender_task_buffer;
+#endif
+
+
+/**
+ * Log one line of the stats and send it to the syslog server as well, unless
+ * disabled. Stats are neither spooled nor retried.
+ */
+static void report_stats(const char *text, int len)
+{
+    ESP_LOGI(TAG, "%s", text);
+#ifndef CONFIG_SYSLOG_STATS_EXPORT
+    (void) len;
+#else
+    if (stats_header && (len > 0))
+    {
+        line_record_t record = { .timestamp_us = timestamp_now() };
+        record.span.seg[0] = text;
+        record.span.len[0] = strnlen(text, len);
+        (void) syslog_client_send_record(stats_header, stats_header_len, NULL, 0, &record);
+    }
+#endif
+}
+
+
+static void count_sent(const line_record_t *record, bool live)
+{
+    lines_sent += 1;
+    bytes_sent += line_span_len(&record->span);
+#ifdef CONFIG_SYSLOG_WIFI_ADAPTIVE_PS
+    ps_sent_bytes += line_span_len(&record->span);
+#endif
+    if (live && (record->timestamp_us > 0))
+    {
+        const int64_t latency_us = timestamp_now() - record->timestamp_us;
+        const uint32_t latency = (latency_us > 0) ? (uint32_t)min(latency_us, (int64_t)UINT32_MAX) : 0;
+        histogram_t *histogram = &latency_histogram;
+#ifdef CONFIG_SYSLOG_IDLE_FLUSH
+        histogram = record->partial ? &partial_latency_histogram : histogram;
+#endif
+        histogram_add(histogram, latency);
+#ifdef CONFIG_SYSLOG_WIFI_ADAPTIVE_PS
+        histogram_add(&ps_latency_histogram[ps_policy.mode], latency);
+#endif
+    }
+}
+
+
+/**
+ * Build the structured data of a line: its sequence number, plus the drop
+ * counters of its source if they changed since they were last sent.
+ */
+#ifndef CONFIG_SYSLOG_MESSAGE_FORMAT_RAW
+static size_t build_sd(syslog_source_t *source, const line_record_t *record, char *sd)
+{
+    const syslog_drop_counters_t counters = {
+        .flushed_bytes = atomic_load_explicit(&source->drops.flushed_bytes, memory_order_relaxed),
+        .fifo_overflows = atomic_load_explicit(&source->drops.fifo_overflows, memory_order_relaxed),
+        .frame_errors = atomic_load_explicit(&source->drops.frame_errors, memory_order_relaxed),
+        .split_lines = atomic_load_explicit(&source->drops.split_lines, memory_order_relaxed),
+    };
+    const bool changed = memcmp(&counters, &source->reported, sizeof(counters)) != 0;
+    if (changed)
+    {
+        source->reported = counters;
+    }
+    return syslog_client_build_sd(sd, record, changed ? &counters : NULL);
+}
+
+
+static bool send_record(syslog_source_t *source, const line_record_t *record)
+{
+    char sd[SYSLOG_SD_MAX_LEN];
+    const size_t sd_len = build_sd(source, record, sd);
+    const uint8_t severity = record->severity;
+    return syslog_client_send_record(source->header[severity], source->header_len[severity], sd, sd_len, record);
+}
+#else
+/* raw chunks go out as they were received */
+static bool send_record(syslog_source_t *source, const line_record_t *record)
+{
+    (void) source;
+    return syslog_client_send_raw(&record->span);
+}
+#endif
+
+
+#ifdef CONFIG_SYSLOG_SPOOL
+static unsigned int replay_credit = 0;
+static unsigned int replay_live = 0;    /* raw chunks spooled behind the backlog, replayed on top of the rate */
+static TickType_t replay_tick = 0;
+#endif
+
+
+/**
+ * Send a line right away, or spool it if it cannot be sent. Lines do not wait
+ * for the spooled ones, only replaying those is rate-limited: the collector
+ * orders them by their sequence id. Raw chunks have none, so they are
+ * spooled behind the backlog, which then replays them in addition to its
+ * rate.
+ */
+static void deliver(uint8_t index, syslog_source_t *source, const line_record_t *record)
+{
+#if defined(CONFIG_SYSLOG_MESSAGE_FORMAT_RAW) && defined(CONFIG_SYSLOG_SPOOL)
+    if (!spool_empty())
+    {
+        spool_put(index, record);
+        replay_live += 1;
+        return;
+    }
+#endif
+    if (send_record(source, record))
+    {
+        count_sent(record, true);
+    }
+    else
+    {
+        spool_put(index, record);
+    }
+}
+
+
+#ifdef CONFIG_SYSLOG_DEDUPE
+/* cost of the duplicate check since the last stats output */
+static uint32_t dedupe_cycles = 0;
+static uint32_t dedupe_lines = 0;
+
+/**
+ * Send the summaries of suppressed repeats which are due: those whose window
+ * expired, or all of them before a different line is sent. A summary carries
+ * the sequence number of the last repeat it stands for.
+ */
+static void send_summaries(uint8_t index, syslog_source_t *source, bool all)
+{
+    static char text[DEDUPE_SAMPLE_LEN + 48];
+    dedupe_entry_t entry;
+    while (dedupe_take_summary(&source->dedupe, xTaskGetTickCount(), all, &entry))
+    {
+        line_record_t record = {
+            .timestamp_us = entry.last_timestamp_us,
+            .seq = entry.last_seq,
+            .severity = entry.severity,
+        };
+        size_t sample_len = strnlen(entry.sample, sizeof(entry.sample));
+#ifdef CONFIG_SYSLOG_UTF8
+        /* the sample may end in the middle of a character */
+        sample_len = sanitize_utf8_prefix(entry.sample, sample_len);
+#endif
+        const int len = snprintf(text, sizeof(text), "[last message repeated %u times: %.*s%s]",
+                                 (unsigned)entry.count, (int)sample_len, entry.sample,
+                                 (entry.len > sample_len) ? "..." : "");
+        record.span.seg[0] = text;
+        record.span.len[0] = min((size_t)max(len, 0), sizeof(text) - 1);
+        deliver(index, source, &record);
+    }
+}
+#endif
+
+
+/**
+ * Send up to quota queued lines of one source. Lines which cannot be sent go
+ * to the spool. Returns true if there are more lines left.
+ */
+static bool send_from_source(uint8_t index, syslog_source_t *source, unsigned int quota)
+{
+    const line_record_t *record;
+    while ((quota > 0) && ((record = line_queue_front(&source->queue)) != NULL))
+    {
+#ifdef CONFIG_SYSLOG_TRACE
+        trace_record(TRACE_HANDOFF, (uint32_t)esp_timer_get_time() - record->queued_us);
+        const uint32_t taken = esp_cpu_get_cycle_count();
+#endif
+        /* an empty last part still completes its line */
+        if ((line_span_len(&record->span) > 0) || (record->span.part > 0))
+        {
+#ifdef CONFIG_SYSLOG_DEDUPE
+            send_summaries(index, source, false);
+            const uint32_t start = esp_cpu_get_cycle_count();
+            const bool repeated = (record->span.part == 0) &&
+                                  dedupe_check(&source->dedupe, record, xTaskGetTickCount());
+            dedupe_cycles += esp_cpu_get_cycle_count() - start;
+            dedupe_lines += 1;
+            if (!repeated)
+            {
+                send_summaries(index, source, true);
+                deliver(index, source, record);
+            }
+#else
+            deliver(index, source, record);
+#endif
+        }
+#ifdef CONFIG_SYSLOG_TRACE
+        trace_record(TRACE_DELIVER, esp_cpu_get_cycle_count() - taken);
+#endif
+        line_ring_release(&source->ring, &record->span);
+        line_queue_pop(&source->queue);
+        quota -= 1;
+    }
+    return line_queue_front(&source->queue) != NULL;
+}
+
+
+#ifdef CONFIG_SYSLOG_SPOOL
+/* tell the collector about lines lost while the spool was full */
+static void report_evicted()
+{
+    const size_t count = atomic_load_explicit(&source_count, memory_order_acquire);
+    for (size_t i = 0; i < count; i++)
+    {
+        const uint32_t evicted = spool_take_evicted(i);
+        if (evicted > 0)
+        {
+            char text[48];
+            line_span_t span = { .seg = { text } };
+            span.len[0] = snprintf(text, sizeof(text), "[spool full, %u lines lost]", (unsigned)evicted);
+            ESP_LOGW(TAG, "%s: %s", sources[i]->name, text);
+#ifndef CONFIG_SYSLOG_MESSAGE_FORMAT_RAW
+            /* not in raw mode, it would corrupt the byte stream */
+            (void) syslog_client_send_with_header(sources[i]->header[SYSLOG_WARNING],
+                                                  sources[i]->header_len[SYSLOG_WARNING], &span);
+#else
+            (void) span;
+#endif
+        }
+    }
+}
+
+
+/**
+ * Send spooled lines (with their original capture time) while the socket is
+ * up, but not faster than the configured replay rate plus the raw chunks
+ * spooled behind them. Returns true if lines are left.
+ */
+static bool replay_spool()
+{
+    const TickType_t now = xTaskGetTickCount();
+    const TickType_t elapsed = min(now - replay_tick, pdMS_TO_TICKS(1000));
+    const unsigned int gained = elapsed * portTICK_PERIOD_MS * CONFIG_SYSLOG_SPOOL_REPLAY_RATE / 1000;
+    if (gained > 0)
+    {
+        replay_credit = min(replay_credit + gained, (unsigned int)CONFIG_SYSLOG_SPOOL_REPLAY_RATE);
+        replay_tick = now;
+    }
+
+    uint8_t index;
+    line_record_t record;
+    while (((replay_credit > 0) || (replay_live > 0)) && syslog_client_ready() && spool_peek(&index, &record))
+    {
+        if ((index < atomic_load_explicit(&source_count, memory_order_acquire)) &&
+            !send_record(sources[index], &record))
+        {
+            break;
+        }
+        count_sent(&record, false);
+        spool_pop();
+        if (replay_live > 0)
+        {
+            replay_live -= 1;
+        }
+        else
+        {
+            replay_credit -= 1;
+        }
+        if (spool_empty())
+        {
+            replay_live = 0;
+            report_evicted();
+        }
+    }
+    return !spool_empty();
+}
+#endif
+
+
+#ifdef CONFIG_SYSLOG_WIFI_ADAPTIVE_PS
+/* bytes captured but not yet sent (or spooled) by all sources */
+static uint32_t queued_bytes()
+{
+    uint32_t queued = 0;
+    const size_t count = atomic_load_explicit(&source_count, memory_order_acquire);
+    for (size_t i = 0; i < count; i++)
+    {
+        syslog_source_t *source = sources[i];
+        queued += atomic_load_explicit(&source->captured.bytes, memory_order_relaxed) -
+                  (uint32_t)atomic_load_explicit(&source->ring.tail, memory_order_relaxed);
+    }
+    return queued;
+}
+
+
+/**
+ * Let the policy pick the Wi-Fi power save mode every POWER_SAVE_INTERVAL_MS.
+ * Returns the time until the next evaluation is needed: while the radio is
+ * kept on, the policy must see the traffic calm down.
+ */
+static TickType_t update_power_save()
+{
+    const TickType_t now = xTaskGetTickCount();
+    const TickType_t interval = pdMS_TO_TICKS(POWER_SAVE_INTERVAL_MS);
+    if (now - ps_last_tick >= interval)
+    {
+        ps_last_tick = now;
+        if (ps_policy_update(&ps_policy, now * portTICK_PERIOD_MS, ps_sent_bytes, queued_bytes()))
+        {
+            ESP_LOGI(TAG, "Wi-Fi power save mode: %s", ps_mode_names[ps_policy.mode]);
+            wifi_set_power_save(ps_policy.mode == PS_POLICY_SAVE);
+        }
+    }
+    return (ps_policy.mode == PS_POLICY_PERFORMANCE) ? interval - (now - ps_last_tick) : portMAX_DELAY;
+}
+#endif
+
+
+static void sender_task(void *pvParameters)
+{
+    (void) pvParameters;
+    TickType_t last_stats = xTaskGetTickCount();
+    stats_start = last_stats;
+
+    spool_init();
+#ifdef CONFIG_SYSLOG_WIFI_ADAPTIVE_PS
+    const ps_policy_config_t ps_config = {
+        .high_rate = CONFIG_SYSLOG_WIFI_PS_HIGH_RATE,
+        .low_rate = CONFIG_SYSLOG_WIFI_PS_LOW_RATE,
+        .high_queued = CONFIG_SYSLOG_WIFI_PS_HIGH_QUEUED,
+        .hold_ms = CONFIG_SYSLOG_WIFI_PS_HOLD_MS,
+    };
+    ps_last_tick = xTaskGetTickCount();
+    ps_policy_init(&ps_policy, &ps_config, ps_last_tick * portTICK_PERIOD_MS, ps_sent_bytes);
+#endif
+
+    for (;;)
+    {
+        const TickType_t stats_interval = pdMS_TO_TICKS(SENDER_STATS_INTERVAL_MS);
+        const TickType_t since_stats = xTaskGetTickCount() - last_stats;
+        TickType_t wait = syslog_client_poll();
+        if (since_stats >= stats_interval)
+        {
+            syslog_sender_log_stats();
+            last_stats += since_stats;
+            wait = 0;
+        }
+        else if (wait > stats_interval - since_stats)
+        {
+            wait = stats_interval - since_stats;
+        }
+
+#ifdef CONFIG_SYSLOG_SPOOL
+        if (!spool_empty())
+        {
+            /* keep replaying at the configured rate, retry less often while the server is unreachable */
+            const TickType_t replay_interval = max(pdMS_TO_TICKS(1000 / CONFIG_SYSLOG_SPOOL_REPLAY_RATE), (TickType_t)1);
+            wait = min(wait, syslog_client_ready() ? replay_interval : pdMS_TO_TICKS(SPOOL_RETRY_MS));
+        }
+#endif
+
+#ifdef CONFIG_SYSLOG_DEDUPE
+        for (size_t i = 0; i < atomic_load_explicit(&source_count, memory_order_acquire); i++)
+        {
+            wait = min(wait, dedupe_poll(&sources[i]->dedupe, xTaskGetTickCount()));
+        }
+#endif
+
+#ifdef CONFIG_SYSLOG_WIFI_ADAPTIVE_PS
+        wait = min(wait, update_power_save());
+#endif
+
+        (void) ulTaskNotifyTake(pdTRUE, wait);
+
+#ifdef CONFIG_SYSLOG_SPOOL
+        (void) replay_spool();
+#endif
+
+        /* serve all sources round-robin until all queues are empty */
+        bool pending = true;
+        while (pending)
+        {
+            pending = false;
+            const size_t count = atomic_load_explicit(&source_count, memory_order_acquire);
+            for (size_t i = 0; i < count; i++)
+            {
+                pending |= send_from_source(i, sources[i], SENDER_QUOTA);
+            }
+        }
+
+#ifdef CONFIG_SYSLOG_DEDUPE
+        for (size_t i = 0; i < atomic_load_explicit(&source_count, memory_order_acquire); i++)
+        {
+            send_summaries(i, sources[i], false);
+        }
+#endif
+    }
+}
+
+
+/**
+ * Start the task which sends all captured lines. It is meant to run on the
+ * CPU core of the Wifi driver.
+ */
+void syslog_sender_start(BaseType_t core_id, const char *app_name)
+{
+#ifndef CONFIG_SYSLOG_STATS_EXPORT
+    (void) app_name;        /* only names the stats messages */
+#endif
+    if (sender_task_handle == NULL)
+    {
+#ifdef CONFIG_SYSLOG_STATIC_MEMORY
+#ifdef CONFIG_SYSLOG_STATS_EXPORT
+        static char stats_header_buf[SYSLOG_HEADER_MAX_LEN];
+        stats_header_len = syslog_client_format_header(stats_header_buf, sizeof(stats_header_buf),
+                                                       SYSLOG_INFO, app_name, "stats");
+        if (stats_header_len < sizeof(stats_header_buf))
+        {
+            stats_header = stats_header_buf;
+        }
+        else
+        {
+            stats_header = build_syslog_client_header(SYSLOG_INFO, app_name, "stats");
+            static_mem_count_fallback("stats header", stats_header_len + 1);
+        }
+        static_mem_reserve("stats header", sizeof(stats_header_buf));
+#endif
+        static_mem_reserve("sender task", sizeof(sender_task_stack) + sizeof(sender_task_buffer));
+        sender_task_handle = xTaskCreateStaticPinnedToCore(sender_task, "syslog_sender", SENDER_TASK_STACK_SIZE,
+                                                           NULL, SENDER_TASK_PRIORITY, sender_task_stack,
+                                                           &sender_task_buffer, core_id);
+#else
+#ifdef CONFIG_SYSLOG_STATS_EXPORT
+        stats_header = build_syslog_client_header(SYSLOG_INFO, app_name, "stats");
+        stats_header_len = strlen(stats_header);
+#endif
+        xTaskCreatePinnedToCore(sender_task, "syslog_sender", SENDER_TASK_STACK_SIZE,
+                                NULL, SENDER_TASK_PRIORITY, &sender_task_handle, core_id);
+#endif
+    }
+}
+
+
+bool syslog_sender_add_source(syslog_source_t *source)
+{
+    const size_t count = atomic_load_explicit(&source_count, memory_order_relaxed);
+    if (count >= SYSLOG_SENDER_MAX_SOURCES)
+    {
+        ESP_LOGE(TAG, "Cannot add more than %d sources", SYSLOG_SENDER_MAX_SOURCES);
+        return false;
+    }
+    source->task = NULL;
+    source->next_seq = 1;
+    source->fragment_id = 0;
+    source->fragment_severity = SYSLOG_INFO;
+    atomic_init(&source->captured.lines, 0);
+    atomic_init(&source->captured.bytes, 0);
+    atomic_init(&source->captured.partial_lines, 0);
+    atomic_init(&source->drops.flushed_bytes, 0);
+    atomic_init(&source->drops.fifo_overflows, 0);
+    atomic_init(&source->drops.frame_errors, 0);
+    atomic_init(&source->drops.split_lines, 0);
+    atomic_init(&source->tuning.rx_full_threshold, 0);
+    atomic_init(&source->tuning.rx_timeout, 0);
+    atomic_init(&source->tuning.raised, 0);
+    atomic_init(&source->tuning.lowered, 0);
+    atomic_init(&source->tuning.backoffs, 0);
+    atomic_init(&source->sanitized.stripped, 0);
+    atomic_init(&source->sanitized.repaired, 0);
+    atomic_init(&source->sanitized.bytes, 0);
+    atomic_init(&source->sanitized.cycles, 0);
+    memset(&source->reported, 0, sizeof(source->reported));
+#ifdef CONFIG_SYSLOG_DEDUPE
+    dedupe_init(&source->dedupe);
+#endif
+    sources[count] = source;
+    atomic_store_explicit(&source_count, count + 1, memory_order_release);
+    return true;
+}
+
+
+/**
+ * Take the sequence number for the next line of a source, counting from 1 to
+ * 2147483647 and wrapping around as specified by RFC 5424 section 7.3.1.
+ * Only to be called by the producer.
+ */
+uint32_t syslog_source_next_seq(syslog_source_t *source)
+{
+    const uint32_t seq = source->next_seq;
+    source->next_seq = (seq < INT32_MAX) ? seq + 1 : 1;
+    return seq;
+}
+
+
+/**
+ * Wake up the sender after lines were queued.
+ */
+void syslog_sender_notify()
+{
+    if (sender_task_handle)
+    {
+        xTaskNotifyGive(sender_task_handle);
+    }
+}
+
+
+#ifdef CONFIG_SYSLOG_TRACE
+/**
+ * Report the stage durations traced since the last call: per stage the
+ * median and 99th percentile, and the non-empty power-of-two buckets of its
+ * histogram as "<upper bound:count".
+ */
+static void report_trace(char *text, size_t size)
+{
+    static histogram_t histograms[TRACE_STAGES];
+    uint32_t lost = 0;
+    trace_collect(histograms, &lost);
+    const uint32_t ticks_per_us = max(esp_rom_get_cpu_ticks_per_us(), (uint32_t)1);
+
+    for (int stage = 0; stage < TRACE_STAGES; stage++)
+    {
+        histogram_t *histogram = &histograms[stage];
+        const bool in_cycles = trace_stage_in_cycles(stage);
+        const uint32_t p99 = histogram_percentile(histogram, 99);
+        int len = snprintf(text, size, "trace %s: %u samples, p50 < %u %s, p99 < %u %s (%u us), histogram",
+                           trace_stage_name(stage), (unsigned)histogram->total,
+                           (unsigned)histogram_percentile(histogram, 50), in_cycles ? "cycles" : "us",
+                           (unsigned)p99, in_cycles ? "cycles" : "us",
+                           (unsigned)(in_cycles ? p99 / ticks_per_us : p99));
+        for (int bucket = 0; (bucket < HISTOGRAM_BUCKETS) && (len >= 0) && ((size_t)len < size); bucket++)
+        {
+            if (histogram->count[bucket] > 0)
+            {
+                len += snprintf(text + len, size - len, " <%u:%u",
+                                (unsigned)histogram_bucket_bound(bucket), (unsigned)histogram->count[bucket]);
+            }
+        }
+        report_stats(text, min(len, (int)size - 1));
+        histogram_reset(histogram);
+    }
+    if (lost > 0)
+    {
+        const int len = snprintf(text, size, "trace: %u entries overwritten before they were collected",
+                                 (unsigned)lost);
+        report_stats(text, len);
+    }
+}
+#endif
+
+
+void syslog_sender_log_stats()
+{
+    static char text[320];
+    int len;
+
+    const size_t count = atomic_load_explicit(&source_count, memory_order_acquire);
+    for (size_t i = 0; i < count; i++)
+    {
+        syslog_source_t *source = sources[i];
+        len = snprintf(text, sizeof(text),
+                       "%s: captured %u lines (%u bytes, %u incomplete on idle), split %u lines, flushed %u bytes, "
+                       "%u fifo overflows, %u frame errors, queue max %u/%u lines, "
+                       "ring max %u/%u bytes, stack free %u bytes",
+                       source->name,
+                       atomic_load_explicit(&source->captured.lines, memory_order_relaxed),
+                       atomic_load_explicit(&source->captured.bytes, memory_order_relaxed),
+                       atomic_load_explicit(&source->captured.partial_lines, memory_order_relaxed),
+                       atomic_load_explicit(&source->drops.split_lines, memory_order_relaxed),
+                       atomic_load_explicit(&source->drops.flushed_bytes, memory_order_relaxed),
+                       atomic_load_explicit(&source->drops.fifo_overflows, memory_order_relaxed),
+                       atomic_load_explicit(&source->drops.frame_errors, memory_order_relaxed),
+                       (unsigned)source->queue.high_water,
+                       (unsigned)(source->queue.mask + 1),
+                       (unsigned)source->ring_high_water,
+                       (unsigned)(source->ring.mask + 1),
+                       source->task ? (unsigned)uxTaskGetStackHighWaterMark(source->task) : 0);
+        report_stats(text, len);
+
+#ifdef CONFIG_SYSLOG_SANITIZE
+        const uint32_t sanitized_bytes = atomic_exchange_explicit(&source->sanitized.bytes, 0, memory_order_relaxed);
+        const uint32_t sanitize_cycles = atomic_exchange_explicit(&source->sanitized.cycles, 0, memory_order_relaxed);
+        const uint32_t centicycles = (uint32_t)((uint64_t)sanitize_cycles * 100 / max(sanitized_bytes, (uint32_t)1));
+        len = snprintf(text, sizeof(text),
+                       "%s: stripped %u bytes of escape sequences and control characters, "
+                       "replaced %u invalid UTF-8 bytes, %u.%02u cycles per byte",
+                       source->name,
+                       atomic_load_explicit(&source->sanitized.stripped, memory_order_relaxed),
+                       atomic_load_explicit(&source->sanitized.repaired, memory_order_relaxed),
+                       (unsigned)(centicycles / 100), (unsigned)(centicycles % 100));
+        report_stats(text, len);
+#endif
+
+#ifdef CONFIG_SYSLOG_UART_ADAPTIVE
+        len = snprintf(text, sizeof(text),
+                       "%s: rx fifo threshold %u bytes, rx timeout %u symbols, "
+                       "raised %u times, lowered %u times, %u overflow backoffs",
+                       source->name,
+                       atomic_load_explicit(&source->tuning.rx_full_threshold, memory_order_relaxed),
+                       atomic_load_explicit(&source->tuning.rx_timeout, memory_order_relaxed),
+                       atomic_load_explicit(&source->tuning.raised, memory_order_relaxed),
+                       atomic_load_explicit(&source->tuning.lowered, memory_order_relaxed),
+                       atomic_load_explicit(&source->tuning.backoffs, memory_order_relaxed));
+        report_stats(text, len);
+#endif
+    }
+
+#ifdef CONFIG_SYSLOG_SPOOL
+    spool_stats_t spool_stats;
+    spool_get_stats(&spool_stats);
+    len = snprintf(text, sizeof(text),
+                   "spool: %u lines (%u bytes) in RAM, %u lines in flash, %u lines evicted, %u lines truncated",
+                   (unsigned)spool_stats.ram_lines, (unsigned)spool_stats.ram_bytes,
+                   (unsigned)spool_stats.flash_lines, (unsigned)spool_stats.evicted,
+                   (unsigned)spool_stats.truncated);
+    report_stats(text, len);
+#endif
+
+    syslog_client_stats_t client_stats;
+    syslog_client_get_stats(&client_stats);
+    const TickType_t now = xTaskGetTickCount();
+    const uint32_t elapsed_ms = max((now - stats_start) * portTICK_PERIOD_MS, (TickType_t)1);
+    len = snprintf(text, sizeof(text),
+                   "sender: sent %u lines (%u lines/s, %u bytes/s), capture to send latency p50 < %u us, "
+                   "p99 < %u us, %u ENOMEM retries, %u send errors, %u reopens, "
+                   "heap free %u bytes (min %u), stack free %u bytes",
+                   (unsigned)lines_sent,
+                   (unsigned)((uint64_t)lines_sent * 1000 / elapsed_ms),
+                   (unsigned)((uint64_t)bytes_sent * 1000 / elapsed_ms),
+                   (unsigned)histogram_percentile(&latency_histogram, 50),
+                   (unsigned)histogram_percentile(&latency_histogram, 99),
+                   (unsigned)client_stats.enomem_retries,
+                   (unsigned)client_stats.send_errors,
+                   (unsigned)client_stats.reopens,
+                   (unsigned)esp_get_free_heap_size(),
+                   (unsigned)esp_get_minimum_free_heap_size(),
+                   (unsigned)uxTaskGetStackHighWaterMark(NULL));
+    report_stats(text, len);
+
+#ifdef CONFIG_SYSLOG_IDLE_FLUSH
+    len = snprintf(text, sizeof(text),
+                   "idle flush: sent %u incomplete lines, last byte to send latency p50 < %u us, p99 < %u us",
+                   (unsigned)partial_latency_histogram.total,
+                   (unsigned)histogram_percentile(&partial_latency_histogram, 50),
+                   (unsigned)histogram_percentile(&partial_latency_histogram, 99));
+    report_stats(text, len);
+#endif
+
+    len = snprintf(text, sizeof(text),
+                   "link: %s, lost %u times, recovered %u times, first message delivered %u ms "
+                   "after the last recovery (max %u ms)",
+                   client_stats.link_up ? "up" : "down",
+                   (unsigned)client_stats.link_losses,
+                   (unsigned)client_stats.recoveries,
+                   (unsigned)client_stats.recovery_ms_last,
+                   (unsigned)client_stats.recovery_ms_max);
+    report_stats(text, len);
+
+    syslog_destination_stats_t dest_stats[SYSLOG_CLIENT_MAX_DESTINATIONS];
+    const size_t dest_count = syslog_client_get_destination_stats(dest_stats, SYSLOG_CLIENT_MAX_DESTINATIONS);
+    for (size_t i = 0; i < dest_count; i++)
+    {
+        len = snprintf(text, sizeof(text),
+                       "destination %s: %s, sent %u messages, %u ENOMEM retries, %u failures, %u reopens, "
+                       "address by %s, %u resolutions (%u failed, max %u ms), %u address changes",
+                       dest_stats[i].host, dest_stats[i].connected ? "up" : "down",
+                       (unsigned)dest_stats[i].sent, (unsigned)dest_stats[i].enomem_retries,
+                       (unsigned)dest_stats[i].failures, (unsigned)dest_stats[i].reopens,
+                       dest_stats[i].resolved_by, (unsigned)dest_stats[i].resolutions,
+                       (unsigned)dest_stats[i].resolve_failures, (unsigned)dest_stats[i].resolve_ms_max,
+                       (unsigned)dest_stats[i].address_changes);
+        report_stats(text, len);
+    }
+
+#ifdef CONFIG_SYSLOG_STATIC_MEMORY
+    static_mem_stats_t mem_stats;
+    static_mem_get_stats(&mem_stats);
+    len = snprintf(text, sizeof(text),
+                   "memory: %u bytes reserved statically, %u fallback allocations (%u bytes), "
+                   "heap min free %u bytes",
+                   (unsigned)mem_stats.reserved_bytes, (unsigned)mem_stats.fallbacks,
+                   (unsigned)mem_stats.fallback_bytes,
+                   (unsigned)esp_get_minimum_free_heap_size());
+    report_stats(text, len);
+#endif
+
+#ifdef CONFIG_SYSLOG_DEDUPE
+    uint32_t suppressed = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        suppressed += sources[i]->dedupe.suppressed;
+    }
+    len = snprintf(text, sizeof(text), "dedupe: %u repeated lines suppressed, %u cycles per line",
+                   (unsigned)suppressed, (unsigned)(dedupe_cycles / max(dedupe_lines, (uint32_t)1)));
+    report_stats(text, len);
+    dedupe_cycles = 0;
+    dedupe_lines = 0;
+#endif
+
+#ifdef CONFIG_SYSLOG_WIFI_ADAPTIVE_PS
+    len = snprintf(text, sizeof(text),
+                   "power save: %s, %u switches to performance, %u to save, latency p50 < %u us "
+                   "p99 < %u us in save mode, p50 < %u us p99 < %u us in performance mode",
+                   ps_mode_names[ps_policy.mode],
+                   (unsigned)ps_policy.transitions[PS_POLICY_PERFORMANCE],
+                   (unsigned)ps_policy.transitions[PS_POLICY_SAVE],
+                   (unsigned)histogram_percentile(&ps_latency_histogram[PS_POLICY_SAVE], 50),
+                   (unsigned)histogram_percentile(&ps_latency_histogram[PS_POLICY_SAVE], 99),
+                   (unsigned)histogram_percentile(&ps_latency_histogram[PS_POLICY_PERFORMANCE], 50),
+                   (unsigned)histogram_percentile(&ps_latency_histogram[PS_POLICY_PERFORMANCE], 99));
+    report_stats(text, len);
+    for (int mode = 0; mode < PS_POLICY_MODES; mode++)
+    {
+        histogram_reset(&ps_latency_histogram[mode]);
+    }
+#endif
+
+#ifdef CONFIG_SYSLOG_BATCH_COMPRESSION
+    const uint32_t batch_kb = max(client_stats.batch_bytes / 1024, (uint32_t)1);
+    len = snprintf(text, sizeof(text),
+                   "compression: %u bytes to %u bytes (%u%%), %u us per KB",
+                   (unsigned)client_stats.batch_bytes,
+                   (unsigned)client_stats.compressed_bytes,
+                   (unsigned)((uint64_t)client_stats.compressed_bytes * 100 / max(client_stats.batch_bytes, (uint32_t)1)),
+                   (unsigned)(client_stats.compress_us / batch_kb));
+    report_stats(text, len);
+#endif
+
+#ifdef CONFIG_SYSLOG_TRACE
+    report_trace(text, sizeof(text));
+#endif
+
+    histogram_reset(&latency_histogram);
+#ifdef CONFIG_SYSLOG_IDLE_FLUSH
+    histogram_reset(&partial_latency_histogram);
+#endif
+    lines_sent = 0;
+    bytes_sent = 0;
+    stats_start = now;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "sdkconfig.h"
+
+#include "dedupe.h"
+#include "line_ring.h"
+#include "line_queue.h"
+#include "severity.h"
+#include "spool.h"
+#include "syslog_client.h"
+
+#define SYSLOG_SENDER_MAX_SOURCES SPOOL_MAX_SOURCES
+
+/**
+ * A capture source: its syslog headers (one per severity) as well as the line ring and queue
+ * shared between the capturing task (producer) and the sender (consumer).
+ * The counters are only increased by the producer. The drop counters are
+ * reported by the sender along with the next message whenever one of them
+ * changed.
+ */
+typedef struct
+{
+    const char *name;
+    const char *header[SEVERITY_COUNT];
+    size_t header_len[SEVERITY_COUNT];
+    line_ring_t ring;
+    line_queue_t queue;
+    size_t ring_high_water;     /* maximum ring fill seen by the producer */
+    TaskHandle_t task;          /* the capturing task */
+    uint32_t next_seq;          /* sequence number of the next line (producer) */
+    uint32_t fragment_id;       /* of the line currently being split (producer) */
+    uint8_t fragment_severity;
+    struct
+    {
+        atomic_uint lines;
+        atomic_uint bytes;
+        atomic_uint partial_lines;      /* incomplete lines flushed after the input went idle */
+    } captured;
+    struct
+    {
+        atomic_uint flushed_bytes;
+        atomic_uint fifo_overflows;
+        atomic_uint frame_errors;
+        atomic_uint split_lines;
+    } drops;
+    struct
+    {
+        atomic_uint rx_full_threshold;
+        atomic_uint rx_timeout;
+        atomic_uint raised;             /* thresholds raised for a higher rate */
+        atomic_uint lowered;            /* thresholds lowered for lower latency */
+        atomic_uint backoffs;           /* threshold halved after a FIFO overflow */
+    } tuning;
+    struct
+    {
+        atomic_uint stripped;           /* escape sequences and control characters */
+        atomic_uint repaired;           /* invalid UTF-8 bytes replaced */
+        atomic_uint bytes;              /* examined since the last stats output */
+        atomic_uint cycles;             /* spent since the last stats output */
+    } sanitized;
+    syslog_drop_counters_t reported;    /* drop counters last sent (sender) */
+#ifdef CONFIG_SYSLOG_DEDUPE
+    dedupe_t dedupe;                    /* recently sent lines (sender) */
+#endif
+} syslog_source_t;
+
+void syslog_sender_start(BaseType_t core_id, const char *app_name);
+
+bool syslog_sender_add_source(syslog_source_t *source);
+
+uint32_t syslog_source_next_seq(syslog_source_t *source);
+
+void syslog_sender_notify();
+
+void syslog_sender_log_stats();
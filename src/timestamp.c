@@ -0,0 +1,110 @@
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "sdkconfig.h"
+
+#include "esp_log.h"
+#include "esp_sntp.h"
+
+#include "timestamp.h"
+
+/* anything before is considered "not synchronized yet" */
+#define MIN_VALID_TIME 1577836800       /* 2020-01-01T00:00:00Z */
+
+static const char *TAG = "timestamp";
+
+
+static void time_sync_notification(struct timeval *tv)
+{
+    (void) tv;
+    ESP_LOGI(TAG, "System time synchronized via SNTP");
+}
+
+
+void timestamp_start_sync(const char *server)
+{
+    if (!server || !*server)
+    {
+        return;
+    }
+    ESP_LOGI(TAG, "Synchronizing time with %s", server);
+    esp_sntp_setoperatingmode(ESP_SNTP_OPMODE_POLL);
+    esp_sntp_setservername(0, server);
+    sntp_set_time_sync_notification_cb(time_sync_notification);
+    esp_sntp_init();
+}
+
+
+/**
+ * Current time in microseconds since the epoch, or 0 as long as the system
+ * time was not synchronized.
+ */
+int64_t timestamp_now()
+{
+#ifndef CONFIG_SYSLOG_TIMESTAMP
+    return 0;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    if (tv.tv_sec < MIN_VALID_TIME)
+    {
+        return 0;
+    }
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+
+static inline char *put_digits(char *dst, unsigned int value, int count)
+{
+    for (int i = count - 1; i >= 0; i--)
+    {
+        dst[i] = '0' + (value % 10);
+        value /= 10;
+    }
+    return dst + count;
+}
+
+
+/**
+ * Write an RFC 5424 timestamp in UTC with microsecond resolution (or the
+ * NILVALUE for time 0) and return its length. The date and time of day are
+ * only formatted once per second.
+ */
+size_t timestamp_format(timestamp_cache_t *cache, int64_t time_us, char *dst)
+{
+    if (time_us <= 0)
+    {
+        *dst = '-';
+        return 1;
+    }
+
+    const int64_t second = time_us / 1000000;
+    if (second != cache->second)
+    {
+        const time_t t = (time_t)second;
+        struct tm tm;
+        gmtime_r(&t, &tm);
+        char *p = cache->prefix;
+        p = put_digits(p, tm.tm_year + 1900, 4);
+        *p++ = '-';
+        p = put_digits(p, tm.tm_mon + 1, 2);
+        *p++ = '-';
+        p = put_digits(p, tm.tm_mday, 2);
+        *p++ = 'T';
+        p = put_digits(p, tm.tm_hour, 2);
+        *p++ = ':';
+        p = put_digits(p, tm.tm_min, 2);
+        *p++ = ':';
+        p = put_digits(p, tm.tm_sec, 2);
+        cache->second = second;
+    }
+
+    memcpy(dst, cache->prefix, sizeof(cache->prefix));
+    char *p = dst + sizeof(cache->prefix);
+    *p++ = '.';
+    p = put_digits(p, (unsigned int)(time_us % 1000000), 6);
+    *p++ = 'Z';
+    return p - dst;
+}
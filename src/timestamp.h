@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* "YYYY-MM-DDThh:mm:ss.uuuuuuZ" */
+#define TIMESTAMP_MAX_LEN 27
+
+/**
+ * Formatting cache holding the date and time part of the last second seen,
+ * so that consecutive timestamps only need their fraction digits written.
+ */
+typedef struct
+{
+    int64_t second;
+    char prefix[19];
+} timestamp_cache_t;
+
+void timestamp_start_sync(const char *server);
+
+int64_t timestamp_now();
+
+size_t timestamp_format(timestamp_cache_t *cache, int64_t time_us, char *dst);
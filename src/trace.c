@@ -0,0 +1,110 @@
+#include <stdatomic.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "sdkconfig.h"
+#include "trace.h"
+
+#ifdef CONFIG_SYSLOG_TRACE
+
+#define TRACE_RING_SIZE CONFIG_SYSLOG_TRACE_RING_SIZE     /*!< entries per core, a power of two */
+#define VALUE_BITS 28                                   /*!< an entry is the stage and the value */
+#define VALUE_MAX ((1u << VALUE_BITS) - 1)
+
+_Static_assert((TRACE_RING_SIZE & (TRACE_RING_SIZE - 1)) == 0, "SYSLOG_TRACE_RING_SIZE must be a power of two");
+
+#define min(a,b) \
+   ({ __typeof__ (a) _a = (a); \
+       __typeof__ (b) _b = (b); \
+     _a < _b ? _a : _b; })
+
+/* written by the tasks of one core, read by trace_collect() */
+typedef struct
+{
+    atomic_uint entries[TRACE_RING_SIZE];
+    atomic_uint tags[TRACE_RING_SIZE];  /* position + 1 of the entry once it was written */
+    atomic_uint head;       /* entries claimed */
+    uint32_t collected;     /* entries collected (reader) */
+} trace_ring_t;
+
+static trace_ring_t rings[portNUM_PROCESSORS];
+
+static const char *stage_names[TRACE_STAGES] = { "read", "frame", "handoff", "deliver", "send" };
+
+
+/**
+ * Record the duration of a stage in the ring of the current core. A slot is
+ * claimed with one atomic increment, so tasks preempting each other on the
+ * same core need no lock. Its tag is invalidated while the entry is written
+ * and set to the position + 1 afterwards, which no other lap of the slot
+ * uses. Values are saturated to 28 bits.
+ */
+void trace_record(trace_stage_t stage, uint32_t value)
+{
+    trace_ring_t *ring = &rings[xPortGetCoreID()];
+    const uint32_t pos = atomic_fetch_add_explicit(&ring->head, 1, memory_order_relaxed);
+    const size_t slot = pos & (TRACE_RING_SIZE - 1);
+    atomic_store_explicit(&ring->tags[slot], pos, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&ring->entries[slot],
+                          ((uint32_t)stage << VALUE_BITS) | min(value, VALUE_MAX), memory_order_relaxed);
+    atomic_store_explicit(&ring->tags[slot], pos + 1, memory_order_release);
+}
+
+
+/**
+ * Add the entries recorded since the last call to the histograms of their
+ * stages, and count the ones which were overwritten in the meantime. Slots
+ * which were claimed but not written yet, or are rewritten while being read,
+ * are skipped and counted as lost as well.
+ */
+void trace_collect(histogram_t histograms[TRACE_STAGES], uint32_t *lost)
+{
+    for (size_t core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        trace_ring_t *ring = &rings[core];
+        const uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        if (head - ring->collected > TRACE_RING_SIZE)
+        {
+            *lost += head - ring->collected - TRACE_RING_SIZE;
+            ring->collected = head - TRACE_RING_SIZE;
+        }
+        for (; ring->collected != head; ring->collected++)
+        {
+            const size_t slot = ring->collected & (TRACE_RING_SIZE - 1);
+            const uint32_t tag = ring->collected + 1;
+            if (atomic_load_explicit(&ring->tags[slot], memory_order_acquire) != tag)
+            {
+                *lost += 1;
+                continue;
+            }
+            const uint32_t entry = atomic_load_explicit(&ring->entries[slot], memory_order_relaxed);
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&ring->tags[slot], memory_order_relaxed) != tag)
+            {
+                *lost += 1;
+                continue;
+            }
+            const uint32_t stage = entry >> VALUE_BITS;
+            if (stage < TRACE_STAGES)
+            {
+                histogram_add(&histograms[stage], entry & VALUE_MAX);
+            }
+        }
+    }
+}
+
+
+const char *trace_stage_name(trace_stage_t stage)
+{
+    return (stage < TRACE_STAGES) ? stage_names[stage] : "?";
+}
+
+
+bool trace_stage_in_cycles(trace_stage_t stage)
+{
+    return stage != TRACE_HANDOFF;
+}
+
+#endif
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "histogram.h"
+
+/* the stages of a line, from the UART event to the socket */
+typedef enum
+{
+    TRACE_READ,         /* capture task woken by a UART event until the bytes were read */
+    TRACE_FRAME,        /* bytes read until their line was queued (framing, cleanup, classification) */
+    TRACE_HANDOFF,      /* line queued until taken by the sender, across the cores */
+    TRACE_DELIVER,      /* line taken until sent, batched or spooled */
+    TRACE_SEND,         /* a sendmsg call, including ENOMEM retries */
+    TRACE_STAGES
+} trace_stage_t;
+
+/**
+ * Latency tracing of the stages of each line. Every duration is recorded into
+ * a lock-free ring of the CPU core measuring it, in CPU cycles, except for
+ * the handoff between the cores, which is measured in microseconds as the
+ * cycle counters of the cores are not synchronized. Entries overwritten
+ * before they were collected are lost.
+ */
+void trace_record(trace_stage_t stage, uint32_t value);
+
+void trace_collect(histogram_t histograms[TRACE_STAGES], uint32_t *lost);
+
+const char *trace_stage_name(trace_stage_t stage);
+
+bool trace_stage_in_cycles(trace_stage_t stage);
@@ -0,0 +1,606 @@
+/**
+ * End-to-end benchmark of the bridge on the host. Runs app_main() with UART1
+ * on the simulated line of stubs/uart.c and the syslog server replaced by a
+ * receiver on localhost, replays a trace at a baud rate and reports:
+ *
+ *  - lines/s delivered and the bytes/s which went over the line,
+ *  - p50/p99/max latency from the newline entering the UART FIFO to the
+ *    datagram (or TCP segment) carrying the line being received,
+ *  - idle-to-delivery latency of a prompt without a newline,
+ *  - the UART_BUFFER_FULL and UART_FIFO_OVF events of the driver.
+ *
+ * Without --baud, the baud rate doubles from 115200 until both kinds of
+ * overflow occurred, which reports the rate at which each of them starts.
+ * Every trial runs in a child process, as the firmware cannot be restarted.
+ * Each replayed line gets "#L<8 digit number>" appended, which the receiver
+ * looks for in whatever it gets, so that framing, batching and raw chunks
+ * all are measured the same way. Over TCP, the receiver also checks the
+ * octet-counting framing of RFC 6587 wherever the reads split the stream.
+ * The times are those of the host, so they
+ * compare configurations and changes, not the ESP32 itself.
+ *
+ * With --dump, the received datagrams are written to a file one per line
+ * (the byte stream over TCP), e.g. for tools/syslog_loss.py.
+ *
+ * usage: bridge_bench [--quick] [--baud RATE] [--seconds S] [--lines N] [--trace FILE] [--dump FILE] [--verbose]
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lwip/sockets.h"
+#include "esp_timer.h"
+#include "host.h"
+
+#ifndef BENCH_VARIANT
+#define BENCH_VARIANT "default"
+#endif
+
+#define UART UART_NUM_1
+#define START_BAUD_RATE 115200
+#define MAX_BAUD_RATE (START_BAUD_RATE << 12)
+#define QUICK_BAUD_RATE 921600
+#define DEFAULT_MAX_LINES 50000
+#define READY_TIMEOUT_MS 5000
+#define SETTLE_TIMEOUT_MS 2000         /*!< no further delivery for this long ends a trial */
+#define TRIAL_TIMEOUT_S 120
+#define TOKEN_DIGITS 8
+#define MAX_LINE_LEN 256
+
+/* lines of printer firmware output, replayed unless --trace is given */
+static const char *const sample_trace[] = {
+    "echo:busy: processing",
+    "ok T:210.0 /210.0 B:60.0 /60.0 @:64 B@:32",
+    "I (123456) motion: G1 X120.500 Y80.250 E0.04210 F3000",
+    "X:120.50 Y:80.25 Z:2.40 E:0.00 Count X:9640 Y:6420 Z:960",
+    "W (123460) heater: bed temperature overshoot 0.8C",
+    "// action:notification Layer 12/240",
+    "ok",
+    "E (123470) sdcard: read retry 1 at sector 48213",
+};
+
+typedef struct
+{
+    int baud_rate;
+    bool ready;                 /* the first line made it through */
+    uint32_t lines;
+    uint32_t delivered;
+    double lines_per_s;
+    double line_bytes_per_s;    /* achieved on the simulated line */
+    double p50_ms;
+    double p99_ms;
+    double max_ms;
+    double idle_ms;             /* prompt, < 0 if not delivered */
+    uint32_t datagrams;         /* received (reads for TCP) */
+    uint32_t framing_errors;    /* TCP only */
+    host_uart_stats_t uart;
+} trial_result_t;
+
+void app_main(void);
+
+static const char *const *trace = sample_trace;
+static size_t trace_len = sizeof(sample_trace) / sizeof(sample_trace[0]);
+
+/* per line id: where it ends on the line, when that passed the UART, when it was received */
+static uint64_t *end_offset;
+static int64_t *arrival_us;
+static int64_t *received_us;
+static uint32_t id_count;
+static atomic_uint ids_written;
+static atomic_uint ids_received;
+static atomic_uint datagrams;
+static atomic_uint framing_errors;
+static FILE *dump_file = NULL;
+static uint64_t rx_offset;
+static uint32_t next_arrival;
+
+
+static int64_t now_us()
+{
+    return esp_timer_get_time();
+}
+
+
+static void sleep_ms(unsigned int ms)
+{
+    const struct timespec delay = { .tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000L };
+    nanosleep(&delay, NULL);
+}
+
+
+/* runs in the line thread of the simulated UART */
+static void on_uart_rx(uart_port_t port, const char *data, size_t len, int64_t time_us)
+{
+    rx_offset += len;
+    const uint32_t written = atomic_load_explicit(&ids_written, memory_order_acquire);
+    while ((next_arrival < written) && (end_offset[next_arrival] <= rx_offset))
+    {
+        arrival_us[next_arrival++] = time_us;
+    }
+}
+
+
+/* find "#L<digits>" tokens in the received stream, which may cut them anywhere */
+static void scan_received(const char *data, size_t len, int64_t time_us)
+{
+    static int state = 0;       /* 0: before '#', 1: before 'L', 2 + n: n digits seen */
+    static uint32_t id = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        const char c = data[i];
+        if ((state >= 2) && (c >= '0') && (c <= '9'))
+        {
+            id = id * 10 + (c - '0');
+            if (++state == 2 + TOKEN_DIGITS)
+            {
+                if ((id < id_count) && (received_us[id] == 0))
+                {
+                    received_us[id] = time_us;
+                    atomic_fetch_add_explicit(&ids_received, 1, memory_order_release);
+                }
+                state = 0;
+            }
+        }
+        else if ((state == 1) && (c == 'L'))
+        {
+            state = 2;
+            id = 0;
+        }
+        else
+        {
+            state = (c == '#') ? 1 : 0;
+        }
+    }
+}
+
+
+#ifdef CONFIG_SYSLOG_TRANSPORT_TCP
+/* split the stream into the messages of RFC 6587 octet counting: "<length> <message>" */
+static void scan_stream(const char *data, size_t len, int64_t time_us)
+{
+    static size_t remaining = 0;        /* bytes left of the current message */
+    static size_t length = 0;           /* the length read so far */
+    static size_t digits = 0;
+    size_t i = 0;
+    while (i < len)
+    {
+        if (remaining > 0)
+        {
+            const size_t n = (len - i < remaining) ? len - i : remaining;
+            scan_received(data + i, n, time_us);
+            remaining -= n;
+            i += n;
+            continue;
+        }
+        const char c = data[i++];
+        if ((c >= '0') && (c <= '9') && (digits < 6) && ((digits > 0) || (c != '0')))
+        {
+            length = length * 10 + (c - '0');
+            digits += 1;
+        }
+        else
+        {
+            if ((c != ' ') || (digits == 0))
+            {
+                atomic_fetch_add_explicit(&framing_errors, 1, memory_order_relaxed);
+            }
+            remaining = (c == ' ') ? length : 0;
+            length = 0;
+            digits = 0;
+        }
+    }
+}
+#endif
+
+
+static void *receiver_task(void *arg)
+{
+    int fd = *(int *)arg;
+#ifdef CONFIG_SYSLOG_TRANSPORT_TCP
+    const int listener = fd;
+    fd = accept(listener, NULL, NULL);
+#endif
+    static char buf[65536];
+    for (;;)
+    {
+        const ssize_t len = recv(fd, buf, sizeof(buf), 0);
+        if (len <= 0)
+        {
+            if ((len < 0) && (errno == EINTR))
+            {
+                continue;
+            }
+            break;
+        }
+        atomic_fetch_add_explicit(&datagrams, 1, memory_order_relaxed);
+        if (dump_file)
+        {
+            fwrite(buf, 1, len, dump_file);
+#ifndef CONFIG_SYSLOG_TRANSPORT_TCP
+            if (buf[len - 1] != '\n')
+            {
+                fputc('\n', dump_file);
+            }
+#endif
+        }
+#ifdef CONFIG_SYSLOG_TRANSPORT_TCP
+        scan_stream(buf, len, now_us());
+#else
+        scan_received(buf, len, now_us());
+#endif
+    }
+    return NULL;
+}
+
+
+/* a socket on a free port of localhost, which the firmware is set up to send to */
+static int open_receiver()
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t addr_len = sizeof(addr);
+#ifdef CONFIG_SYSLOG_TRANSPORT_TCP
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+#else
+    const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+#endif
+    const int rcvbuf = 8 << 20;
+    if ((fd < 0) ||
+        (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) < 0 &&
+         setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) < 0) ||
+        (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) ||
+        (getsockname(fd, (struct sockaddr *)&addr, &addr_len) < 0))
+    {
+        perror("receiver socket");
+        exit(2);
+    }
+#ifdef CONFIG_SYSLOG_TRANSPORT_TCP
+    if (listen(fd, 1) < 0)
+    {
+        perror("listen");
+        exit(2);
+    }
+#endif
+    host_syslog_port = ntohs(addr.sin_port);
+    return fd;
+}
+
+
+/* write line id to the UART, with the token the receiver looks for */
+static void write_line(uint32_t id, const char *text, bool newline)
+{
+    char line[MAX_LINE_LEN + 32];
+    const int len = snprintf(line, sizeof(line), "%.*s #L%0*u%s", MAX_LINE_LEN, text,
+                             TOKEN_DIGITS, (unsigned)id, newline ? "\n" : "");
+    end_offset[id] = ((id > 0) ? end_offset[id - 1] : 0) + len;
+    atomic_store_explicit(&ids_written, id + 1, memory_order_release);
+    host_uart_write(UART, line, len);
+}
+
+
+/* wait until line 0 came through */
+static bool wait_ready(unsigned int timeout_ms)
+{
+    for (unsigned int waited = 0; atomic_load(&ids_received) == 0; waited += 10)
+    {
+        if (waited >= timeout_ms)
+        {
+            return false;
+        }
+        sleep_ms(10);
+    }
+    return true;
+}
+
+
+/* wait until all lines arrived, or nothing arrived for a while */
+static void wait_settled(uint32_t count)
+{
+    unsigned int last = atomic_load(&ids_received);
+    for (unsigned int quiet = 0; (last < count) && (quiet < SETTLE_TIMEOUT_MS); quiet += 10)
+    {
+        sleep_ms(10);
+        const unsigned int received = atomic_load(&ids_received);
+        if (received != last)
+        {
+            last = received;
+            quiet = 0;
+        }
+    }
+}
+
+
+static int compare_int64(const void *a, const void *b)
+{
+    const int64_t x = *(const int64_t *)a;
+    const int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+
+static double percentile_ms(const int64_t *sorted, size_t count, unsigned int percent)
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+    const size_t index = (count * percent + 99) / 100;
+    return sorted[(index > 0) ? index - 1 : 0] / 1000.0;
+}
+
+
+/**
+ * Run the firmware and replay lines 1..lines at the baud rate, after line 0
+ * showed that the capture task is running, then a prompt without newline.
+ */
+static void run_trial(int baud_rate, uint32_t lines, trial_result_t *result)
+{
+    const uint32_t prompt = lines + 1;
+    id_count = lines + 2;
+    end_offset = calloc(id_count, sizeof(*end_offset));
+    arrival_us = calloc(id_count, sizeof(*arrival_us));
+    received_us = calloc(id_count, sizeof(*received_us));
+    memset(result, 0, sizeof(*result));
+    result->baud_rate = baud_rate;
+    result->lines = lines;
+    result->idle_ms = -1;
+
+    int fd = open_receiver();
+    pthread_t receiver;
+    pthread_create(&receiver, NULL, receiver_task, &fd);
+
+    host_uart_set_baud(UART, baud_rate);
+    host_uart_set_rx_hook(UART, on_uart_rx);
+    (void) esp_timer_get_time();
+    app_main();
+
+    write_line(0, "ready", true);
+    result->ready = wait_ready(READY_TIMEOUT_MS);
+    if (!result->ready)
+    {
+        return;
+    }
+
+    for (uint32_t id = 1; id <= lines; id++)
+    {
+        write_line(id, trace[(id - 1) % trace_len], true);
+    }
+    host_uart_wait_sent(UART);
+    wait_settled(lines + 1);
+    write_line(prompt, "ok>", false);
+    wait_settled(lines + 2);
+    host_uart_get_stats(UART, &result->uart);
+    result->datagrams = atomic_load(&datagrams);
+    result->framing_errors = atomic_load(&framing_errors);
+    if (dump_file)
+    {
+        fflush(dump_file);
+    }
+
+    int64_t *latencies = calloc(lines, sizeof(*latencies));
+    int64_t last_us = 0;
+    for (uint32_t id = 1; id <= lines; id++)
+    {
+        if (received_us[id] != 0)
+        {
+            latencies[result->delivered++] = received_us[id] - arrival_us[id];
+            last_us = (received_us[id] > last_us) ? received_us[id] : last_us;
+        }
+    }
+    qsort(latencies, result->delivered, sizeof(*latencies), compare_int64);
+    result->p50_ms = percentile_ms(latencies, result->delivered, 50);
+    result->p99_ms = percentile_ms(latencies, result->delivered, 99);
+    result->max_ms = percentile_ms(latencies, result->delivered, 100);
+    const double elapsed_s = (last_us - arrival_us[1]) / 1e6;
+    result->lines_per_s = (elapsed_s > 0) ? result->delivered / elapsed_s : 0;
+    const double line_s = (arrival_us[lines] - arrival_us[1]) / 1e6;
+    result->line_bytes_per_s = (line_s > 0) ? (end_offset[lines] - end_offset[0]) / line_s : 0;
+    if (received_us[prompt] != 0)
+    {
+        result->idle_ms = (received_us[prompt] - arrival_us[prompt]) / 1000.0;
+    }
+    free(latencies);
+}
+
+
+/* run a trial in a child process, false if it crashed or hung */
+static bool fork_trial(int baud_rate, uint32_t lines, trial_result_t *result)
+{
+    int fds[2];
+    if (pipe(fds) < 0)
+    {
+        perror("pipe");
+        exit(2);
+    }
+    fflush(stdout);
+    const pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(fds[0]);
+        alarm(TRIAL_TIMEOUT_S);
+        run_trial(baud_rate, lines, result);
+        _exit((write(fds[1], result, sizeof(*result)) == sizeof(*result)) ? 0 : 1);
+    }
+    close(fds[1]);
+    const bool complete = (read(fds[0], result, sizeof(*result)) == sizeof(*result));
+    close(fds[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    return complete && WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+}
+
+
+static uint32_t lines_for(int baud_rate, double seconds, uint32_t max_lines)
+{
+    size_t bytes = 0;
+    for (size_t i = 0; i < trace_len; i++)
+    {
+        bytes += strlen(trace[i]) + TOKEN_DIGITS + 4;
+    }
+    const double lines = seconds * baud_rate / 10 / ((double)bytes / trace_len);
+    return (lines < 10) ? 10 : (lines > max_lines) ? max_lines : (uint32_t)lines;
+}
+
+
+static void print_header(void)
+{
+    printf("%10s %7s %10s %10s %9s %8s %8s %8s %8s %7s %11s %8s\n", "baud", "lines", "lines/s", "line B/s",
+           "datagrams", "p50 ms", "p99 ms", "max ms", "idle ms", "lost", "buffer_full", "fifo_ovf");
+}
+
+
+static void print_result(const trial_result_t *result)
+{
+    if (!result->ready)
+    {
+        printf("%10d no line came through\n", result->baud_rate);
+        return;
+    }
+    printf("%10d %7u %10.0f %10.0f %9u %8.2f %8.2f %8.2f %8.1f %7u %11u %8u\n", result->baud_rate, result->lines,
+           result->lines_per_s, result->line_bytes_per_s, result->datagrams, result->p50_ms, result->p99_ms,
+           result->max_ms, result->idle_ms, result->lines - result->delivered, result->uart.buffer_full,
+           result->uart.fifo_overflows);
+}
+
+
+static void load_trace(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        perror(path);
+        exit(2);
+    }
+    static char **lines = NULL;
+    size_t count = 0;
+    char buf[MAX_LINE_LEN + 2];
+    while (fgets(buf, sizeof(buf), file))
+    {
+        buf[strcspn(buf, "\r\n")] = '\0';
+        lines = realloc(lines, (count + 1) * sizeof(*lines));
+        lines[count++] = strdup(buf);
+    }
+    fclose(file);
+    if (count == 0)
+    {
+        fprintf(stderr, "%s: no lines\n", path);
+        exit(2);
+    }
+    trace = (const char *const *)lines;
+    trace_len = count;
+}
+
+
+int main(int argc, char **argv)
+{
+    bool quick = false;
+    int baud_rate = 0;
+    double seconds = 1.0;
+    uint32_t max_lines = DEFAULT_MAX_LINES;
+
+    host_log_level = ESP_LOG_ERROR;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--quick") == 0)
+        {
+            quick = true;
+        }
+        else if ((strcmp(argv[i], "--baud") == 0) && (i + 1 < argc))
+        {
+            baud_rate = atoi(argv[++i]);
+        }
+        else if ((strcmp(argv[i], "--seconds") == 0) && (i + 1 < argc))
+        {
+            seconds = atof(argv[++i]);
+        }
+        else if ((strcmp(argv[i], "--lines") == 0) && (i + 1 < argc))
+        {
+            max_lines = atoi(argv[++i]);
+        }
+        else if ((strcmp(argv[i], "--trace") == 0) && (i + 1 < argc))
+        {
+            load_trace(argv[++i]);
+        }
+        else if ((strcmp(argv[i], "--dump") == 0) && (i + 1 < argc))
+        {
+            dump_file = fopen(argv[++i], "w");
+            if (dump_file == NULL)
+            {
+                perror(argv[i]);
+                return 2;
+            }
+        }
+        else if (strcmp(argv[i], "--verbose") == 0)
+        {
+            host_log_level = ESP_LOG_INFO;
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--quick] [--baud RATE] [--seconds S] [--lines N] [--trace FILE] [--dump FILE] "
+                    "[--verbose]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    trial_result_t result;
+    printf("bridge_bench (%s)\n", BENCH_VARIANT);
+    print_header();
+    if (quick || (baud_rate > 0))
+    {
+        baud_rate = (baud_rate > 0) ? baud_rate : QUICK_BAUD_RATE;
+        const bool complete = fork_trial(baud_rate, lines_for(baud_rate, seconds, max_lines), &result);
+        print_result(&result);
+        if (!complete || !result.ready)
+        {
+            printf("trial failed\n");
+            return 1;
+        }
+        if (result.framing_errors > 0)
+        {
+            printf("%u framing errors\n", result.framing_errors);
+            return 1;
+        }
+        // the smoke test: at this rate nothing may be lost
+        if (quick && ((result.delivered != result.lines) || (result.idle_ms < 0) ||
+                      (result.uart.buffer_full > 0) || (result.uart.fifo_overflows > 0)))
+        {
+            printf("lines were lost\n");
+            return 1;
+        }
+        return 0;
+    }
+
+    int buffer_full_onset = 0;
+    int fifo_overflow_onset = 0;
+    for (int rate = START_BAUD_RATE; rate <= MAX_BAUD_RATE; rate *= 2)
+    {
+        if (!fork_trial(rate, lines_for(rate, seconds, max_lines), &result))
+        {
+            printf("%10d trial failed\n", rate);
+            break;
+        }
+        print_result(&result);
+        if ((buffer_full_onset == 0) && (result.uart.buffer_full > 0))
+        {
+            buffer_full_onset = rate;
+        }
+        if ((fifo_overflow_onset == 0) && (result.uart.fifo_overflows > 0))
+        {
+            fifo_overflow_onset = rate;
+        }
+        if (buffer_full_onset && fifo_overflow_onset)
+        {
+            break;
+        }
+    }
+    printf("UART_BUFFER_FULL starts at: %d baud\n", buffer_full_onset);
+    printf("UART_FIFO_OVF starts at: %d baud\n", fifo_overflow_onset);
+    return 0;
+}
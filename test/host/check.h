@@ -0,0 +1,30 @@
+#pragma once
+
+/**
+ * Checks and timing of the host tests. A failed check is reported and the
+ * test goes on, CHECK_DONE() makes it fail at the end.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+static int check_failures = 0;
+
+#define CHECK(condition) do                                                         \
+    {                                                                               \
+        if (!(condition))                                                           \
+        {                                                                           \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            check_failures += 1;                                                    \
+        }                                                                           \
+    } while (0)
+
+#define CHECK_DONE() (check_failures ? (fprintf(stderr, "%d checks failed\n", check_failures), 1) : 0)
+
+static inline int64_t bench_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
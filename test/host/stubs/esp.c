@@ -0,0 +1,382 @@
+/**
+ * The rest of ESP-IDF the bridge uses: clocks, logging, the default event
+ * loop, the Wi-Fi station interface (always connected to 127.0.0.1 unless the
+ * harness takes the link down), SNTP (the host clock is set already) and a
+ * "spool" partition in RAM with NOR flash semantics.
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_cpu.h"
+#include "esp_err.h"
+#include "esp_event.h"
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_partition.h"
+#include "esp_rom_sys.h"
+#include "esp_sntp.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "nvs_flash.h"
+#include "host.h"
+#include "wifi_helper.h"
+
+#define MAX_EVENT_HANDLERS 8
+#define LOOPBACK_ADDR 0x0100007f        /*!< 127.0.0.1 in network order */
+
+typedef struct
+{
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t handler;
+    void *arg;
+} event_handler_t;
+
+esp_event_base_t const WIFI_EVENT = "WIFI_EVENT";
+esp_event_base_t const IP_EVENT = "IP_EVENT";
+
+esp_log_level_t host_log_level = ESP_LOG_WARN;
+unsigned int host_syslog_port = 514;
+
+static event_handler_t event_handlers[MAX_EVENT_HANDLERS];
+static size_t event_handler_count = 0;
+static pthread_mutex_t event_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool link_up = true;
+static bool power_save = false;
+
+static uint8_t *flash = NULL;
+static esp_partition_t flash_partition = { .label = "spool" };
+static int flash_ops_left = -1;
+
+
+/* lwIP reports a closed connection as an error, it does not raise SIGPIPE */
+__attribute__((constructor))
+static void ignore_sigpipe()
+{
+    signal(SIGPIPE, SIG_IGN);
+}
+
+
+static int64_t monotonic_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+
+int64_t esp_timer_get_time(void)
+{
+    return monotonic_ns() / 1000;
+}
+
+
+uint32_t esp_cpu_get_cycle_count(void)
+{
+    return (uint32_t)monotonic_ns();
+}
+
+
+uint32_t esp_rom_get_cpu_ticks_per_us(void)
+{
+    return 1000;
+}
+
+
+void esp_restart(void)
+{
+    fprintf(stderr, "esp_restart() called\n");
+    abort();
+}
+
+
+/* there is no heap accounting on the host */
+uint32_t esp_get_free_heap_size(void)
+{
+    return 0;
+}
+
+
+uint32_t esp_get_minimum_free_heap_size(void)
+{
+    return 0;
+}
+
+
+size_t strlcpy(char *dst, const char *src, size_t size)
+{
+    const size_t len = strlen(src);
+    if (size > 0)
+    {
+        const size_t count = (len < size) ? len : size - 1;
+        memcpy(dst, src, count);
+        dst[count] = '\0';
+    }
+    return len;
+}
+
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code)
+    {
+    case ESP_OK: return "ESP_OK";
+    case ESP_FAIL: return "ESP_FAIL";
+    case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+    default: return "UNKNOWN ERROR";
+    }
+}
+
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+}
+
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    static const char letters[] = "NEWIDV";
+    if (level > host_log_level)
+    {
+        return;
+    }
+    char text[512];
+    va_list args;
+    va_start(args, format);
+    (void) vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    fprintf(stderr, "%c (%lld) %s: %s\n", letters[level], (long long)(esp_timer_get_time() / 1000), tag, text);
+}
+
+
+esp_err_t nvs_flash_init(void)
+{
+    return ESP_OK;
+}
+
+
+esp_err_t nvs_flash_erase(void)
+{
+    return ESP_OK;
+}
+
+
+esp_err_t esp_event_loop_create_default(void)
+{
+    return ESP_OK;
+}
+
+
+esp_err_t esp_event_handler_register(esp_event_base_t event_base, int32_t event_id,
+                                     esp_event_handler_t handler, void *arg)
+{
+    pthread_mutex_lock(&event_lock);
+    const bool room = event_handler_count < MAX_EVENT_HANDLERS;
+    if (room)
+    {
+        event_handlers[event_handler_count++] = (event_handler_t) {
+            .base = event_base, .id = event_id, .handler = handler, .arg = arg,
+        };
+    }
+    pthread_mutex_unlock(&event_lock);
+    return room ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+
+/* run the handlers on the calling thread, instead of the event loop task */
+static void post_event(esp_event_base_t event_base, int32_t event_id)
+{
+    pthread_mutex_lock(&event_lock);
+    const size_t count = event_handler_count;
+    pthread_mutex_unlock(&event_lock);
+    for (size_t i = 0; i < count; i++)
+    {
+        const event_handler_t *handler = &event_handlers[i];
+        if ((handler->base == event_base) && ((handler->id == event_id) || (handler->id == ESP_EVENT_ANY_ID)))
+        {
+            handler->handler(handler->arg, event_base, event_id, NULL);
+        }
+    }
+}
+
+
+void host_set_link(bool up)
+{
+    link_up = up;
+    if (up)
+    {
+        post_event(IP_EVENT, IP_EVENT_STA_GOT_IP);
+    }
+    else
+    {
+        post_event(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED);
+    }
+}
+
+
+esp_netif_t *esp_netif_get_handle_from_ifkey(const char *if_key)
+{
+    static int netif;
+    return (esp_netif_t *)&netif;
+}
+
+
+esp_err_t esp_netif_get_hostname(esp_netif_t *netif, const char **hostname)
+{
+    *hostname = CONFIG_OWN_HOSTNAME;
+    return ESP_OK;
+}
+
+
+esp_err_t esp_netif_get_ip_info(esp_netif_t *netif, esp_netif_ip_info_t *ip_info)
+{
+    memset(ip_info, 0, sizeof(*ip_info));
+    ip_info->ip.addr = link_up ? LOOPBACK_ADDR : 0;
+    return ESP_OK;
+}
+
+
+bool wifi_start(const char *hostname, const uint32_t conn_timeout_ms)
+{
+    return true;
+}
+
+
+void wifi_stop(void)
+{
+}
+
+
+void wifi_set_power_save(bool enable)
+{
+    power_save = enable;
+}
+
+
+bool host_wifi_power_save(void)
+{
+    return power_save;
+}
+
+
+void esp_sntp_setoperatingmode(int operating_mode)
+{
+}
+
+
+void esp_sntp_setservername(uint8_t idx, const char *server)
+{
+}
+
+
+void sntp_set_time_sync_notification_cb(sntp_sync_time_cb_t callback)
+{
+}
+
+
+void esp_sntp_init(void)
+{
+}
+
+
+void host_flash_set_size(uint32_t size)
+{
+    free(flash);
+    flash = size ? malloc(size) : NULL;
+    if (flash)
+    {
+        memset(flash, 0xff, size);
+    }
+    flash_partition.size = size;
+}
+
+
+void host_flash_fail_after(int count)
+{
+    flash_ops_left = count;
+}
+
+
+/* count down the operations left before the injected failure */
+static bool flash_op_fails()
+{
+    if (flash_ops_left < 0)
+    {
+        return false;
+    }
+    if (flash_ops_left == 0)
+    {
+        return true;
+    }
+    flash_ops_left -= 1;
+    return false;
+}
+
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label)
+{
+    return (flash && label && (strcmp(label, flash_partition.label) == 0)) ? &flash_partition : NULL;
+}
+
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t offset, void *dst, size_t size)
+{
+    if (offset + size > partition->size)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (flash_op_fails())
+    {
+        return ESP_FAIL;
+    }
+    memcpy(dst, flash + offset, size);
+    return ESP_OK;
+}
+
+
+/* writing can only clear bits, like on NOR flash */
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t offset, const void *src, size_t size)
+{
+    if (offset + size > partition->size)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (flash_op_fails())
+    {
+        return ESP_FAIL;
+    }
+    for (size_t i = 0; i < size; i++)
+    {
+        flash[offset + i] &= ((const uint8_t *)src)[i];
+    }
+    return ESP_OK;
+}
+
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size)
+{
+    if ((offset + size > partition->size) || (offset % 4096) || (size % 4096))
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (flash_op_fails())
+    {
+        return ESP_FAIL;
+    }
+    memset(flash + offset, 0xff, size);
+    return ESP_OK;
+}
@@ -0,0 +1,413 @@
+/**
+ * FreeRTOS tasks, notifications, queues, queue sets and mutexes on POSIX
+ * threads. Priorities and core affinity are only recorded: the tasks run
+ * in parallel like on the two cores of an ESP32.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#define TICK_NS (1000000000LL / configTICK_RATE_HZ)
+
+struct host_task
+{
+    pthread_t thread;
+    TaskFunction_t function;
+    void *arg;
+    BaseType_t core_id;
+    pthread_mutex_t lock;
+    pthread_cond_t notified;
+    uint32_t notify_count;
+};
+
+struct host_queue
+{
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    uint8_t *items;
+    size_t item_size;
+    size_t length;
+    size_t head;
+    size_t count;
+    struct host_queue *set;     /* member of this queue set */
+};
+
+static __thread struct host_task *current_task = NULL;
+
+
+static int64_t monotonic_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+
+/* ticks count from the first call, which the harness makes before any task */
+static int64_t start_ns()
+{
+    static int64_t start = 0;
+    if (start == 0)
+    {
+        start = monotonic_ns();
+    }
+    return start;
+}
+
+
+/* absolute CLOCK_MONOTONIC deadline of a wait, false if it waits forever */
+static bool deadline(TickType_t ticks, struct timespec *until)
+{
+    if (ticks == portMAX_DELAY)
+    {
+        return false;
+    }
+    const int64_t ns = monotonic_ns() + (int64_t)ticks * TICK_NS;
+    until->tv_sec = ns / 1000000000LL;
+    until->tv_nsec = ns % 1000000000LL;
+    return true;
+}
+
+
+static void init_cond(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+
+/* wait on cond until signaled or the deadline passed, false on timeout */
+static bool wait_cond(pthread_cond_t *cond, pthread_mutex_t *lock, bool timed, const struct timespec *until)
+{
+    if (!timed)
+    {
+        pthread_cond_wait(cond, lock);
+        return true;
+    }
+    return pthread_cond_timedwait(cond, lock, until) != ETIMEDOUT;
+}
+
+
+static struct host_task *new_task(TaskFunction_t function, void *arg, BaseType_t core_id)
+{
+    struct host_task *task = calloc(1, sizeof(*task));
+    task->function = function;
+    task->arg = arg;
+    task->core_id = (core_id == tskNO_AFFINITY) ? 0 : core_id;
+    pthread_mutex_init(&task->lock, NULL);
+    init_cond(&task->notified);
+    return task;
+}
+
+
+static void *run_task(void *arg)
+{
+    current_task = arg;
+    current_task->function(current_task->arg);
+    return NULL;
+}
+
+
+BaseType_t xPortGetCoreID(void)
+{
+    return xTaskGetCurrentTaskHandle()->core_id;
+}
+
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stack_depth, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core_id)
+{
+    struct host_task *task = new_task(function, arg, core_id);
+    (void) start_ns();
+    if (handle)
+    {
+        *handle = task;
+    }
+    if (pthread_create(&task->thread, NULL, run_task, task) != 0)
+    {
+        return pdFAIL;
+    }
+    pthread_detach(task->thread);
+    return pdPASS;
+}
+
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t function, const char *name, uint32_t stack_depth, void *arg,
+                                           UBaseType_t priority, StackType_t *stack, StaticTask_t *buffer,
+                                           BaseType_t core_id)
+{
+    TaskHandle_t task = NULL;
+    return (xTaskCreatePinnedToCore(function, name, stack_depth, arg, priority, &task, core_id) == pdPASS) ?
+           task : NULL;
+}
+
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if ((task == NULL) || (task == current_task))
+    {
+        /* as on FreeRTOS, the handle of a deleted task is no longer valid */
+        pthread_mutex_destroy(&current_task->lock);
+        pthread_cond_destroy(&current_task->notified);
+        free(current_task);
+        current_task = NULL;
+        pthread_exit(NULL);
+    }
+}
+
+
+void vTaskDelay(TickType_t ticks)
+{
+    const struct timespec delay = {
+        .tv_sec = (int64_t)ticks * TICK_NS / 1000000000LL,
+        .tv_nsec = (int64_t)ticks * TICK_NS % 1000000000LL,
+    };
+    nanosleep(&delay, NULL);
+}
+
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)((monotonic_ns() - start_ns()) / TICK_NS);
+}
+
+
+/* threads not created as tasks (the harness running app_main) become tasks on core 0 */
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    if (current_task == NULL)
+    {
+        current_task = new_task(NULL, NULL, 0);
+        current_task->thread = pthread_self();
+    }
+    return current_task;
+}
+
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+    return 0;
+}
+
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&task->lock);
+    task->notify_count += 1;
+    pthread_cond_signal(&task->notified);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks)
+{
+    struct host_task *task = xTaskGetCurrentTaskHandle();
+    struct timespec until;
+    const bool timed = deadline(ticks, &until);
+
+    pthread_mutex_lock(&task->lock);
+    while ((task->notify_count == 0) && (ticks > 0))
+    {
+        if (!wait_cond(&task->notified, &task->lock, timed, &until))
+        {
+            break;
+        }
+    }
+    const uint32_t count = task->notify_count;
+    if (count > 0)
+    {
+        task->notify_count = clear_on_exit ? 0 : count - 1;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return count;
+}
+
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    struct host_queue *queue = calloc(1, sizeof(*queue));
+    queue->items = calloc(length, item_size ? item_size : 1);
+    queue->item_size = item_size;
+    queue->length = length;
+    pthread_mutex_init(&queue->lock, NULL);
+    init_cond(&queue->changed);
+    return queue;
+}
+
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->changed);
+    free(queue->items);
+    free(queue);
+}
+
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    struct timespec until;
+    const bool timed = deadline(ticks, &until);
+
+    pthread_mutex_lock(&queue->lock);
+    while ((queue->count == queue->length) && (ticks > 0))
+    {
+        if (!wait_cond(&queue->changed, &queue->lock, timed, &until))
+        {
+            break;
+        }
+    }
+    if (queue->count == queue->length)
+    {
+        pthread_mutex_unlock(&queue->lock);
+        return pdFAIL;
+    }
+    const size_t tail = (queue->head + queue->count) % queue->length;
+    if (queue->item_size > 0)
+    {
+        memcpy(queue->items + tail * queue->item_size, item, queue->item_size);
+    }
+    queue->count += 1;
+    pthread_cond_broadcast(&queue->changed);
+    struct host_queue *set = queue->set;
+    pthread_mutex_unlock(&queue->lock);
+
+    // like FreeRTOS, the set holds one handle per item of its members
+    if (set)
+    {
+        (void) xQueueSend(set, &queue, 0);
+    }
+    return pdPASS;
+}
+
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *woken)
+{
+    if (woken)
+    {
+        *woken = pdFALSE;
+    }
+    return xQueueSend(queue, item, 0);
+}
+
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    struct timespec until;
+    const bool timed = deadline(ticks, &until);
+
+    pthread_mutex_lock(&queue->lock);
+    while ((queue->count == 0) && (ticks > 0))
+    {
+        if (!wait_cond(&queue->changed, &queue->lock, timed, &until))
+        {
+            break;
+        }
+    }
+    if (queue->count == 0)
+    {
+        pthread_mutex_unlock(&queue->lock);
+        return pdFAIL;
+    }
+    if (queue->item_size > 0)
+    {
+        memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+    }
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count -= 1;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    const UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->head = 0;
+    queue->count = 0;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+
+QueueSetHandle_t xQueueCreateSet(UBaseType_t length)
+{
+    return xQueueCreate(length, sizeof(QueueSetMemberHandle_t));
+}
+
+
+BaseType_t xQueueAddToSet(QueueSetMemberHandle_t member, QueueSetHandle_t set)
+{
+    pthread_mutex_lock(&member->lock);
+    const bool added = (member->set == NULL) && (member->count == 0);
+    if (added)
+    {
+        member->set = set;
+    }
+    pthread_mutex_unlock(&member->lock);
+    return added ? pdPASS : pdFAIL;
+}
+
+
+QueueSetMemberHandle_t xQueueSelectFromSet(QueueSetHandle_t set, TickType_t ticks)
+{
+    QueueSetMemberHandle_t member = NULL;
+    return (xQueueReceive(set, &member, ticks) == pdPASS) ? member : NULL;
+}
+
+
+/* a mutex is a queue of one empty item, taking it is receiving that item */
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    SemaphoreHandle_t semaphore = xQueueCreate(1, 0);
+    (void) xQueueSend(semaphore, NULL, 0);
+    return semaphore;
+}
+
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buffer)
+{
+    return xSemaphoreCreateMutex();
+}
+
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks)
+{
+    return xQueueReceive(semaphore, NULL, ticks);
+}
+
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    return xQueueSend(semaphore, NULL, 0);
+}
+
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore)
+{
+    vQueueDelete(semaphore);
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdint.h>
+
+/* one "cycle" is a nanosecond on the host */
+uint32_t esp_cpu_get_cycle_count(void);
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdint.h>
+#include <sys/time.h>
+
+/* the host clock is synchronized already */
+#define ESP_SNTP_OPMODE_POLL 0
+
+typedef void (*sntp_sync_time_cb_t)(struct timeval *tv);
+
+void esp_sntp_setoperatingmode(int operating_mode);
+void esp_sntp_setservername(uint8_t idx, const char *server);
+void sntp_set_time_sync_notification_cb(sntp_sync_time_cb_t callback);
+void esp_sntp_init(void);
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdint.h>
+
+/* microseconds of the monotonic clock since start */
+int64_t esp_timer_get_time(void);
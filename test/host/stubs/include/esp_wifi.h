@@ -0,0 +1,7 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_event.h"
+#include "esp_netif.h"
+
+#define WIFI_EVENT_STA_DISCONNECTED 5
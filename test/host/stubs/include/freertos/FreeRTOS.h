@@ -0,0 +1,47 @@
+#pragma once
+
+/**
+ * FreeRTOS on top of POSIX threads, just enough for the bridge: tasks are
+ * threads, ticks are derived from the monotonic clock.
+ */
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint32_t StackType_t;
+
+typedef void (*TaskFunction_t)(void *);
+typedef struct host_task *TaskHandle_t;
+typedef struct host_queue *QueueHandle_t;
+typedef struct host_queue *QueueSetHandle_t;
+typedef struct host_queue *QueueSetMemberHandle_t;
+typedef struct host_queue *SemaphoreHandle_t;
+
+/* the static variants allocate anyway, these just have to exist */
+typedef struct { void *unused; } StaticTask_t;
+typedef struct { void *unused; } StaticQueue_t;
+typedef StaticQueue_t StaticSemaphore_t;
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define pdFAIL pdFALSE
+#define pdPASS pdTRUE
+
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define configTICK_RATE_HZ CONFIG_FREERTOS_HZ
+#define portTICK_PERIOD_MS ((TickType_t)1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(((TickType_t)(ms) * (TickType_t)configTICK_RATE_HZ) / (TickType_t)1000U))
+
+#define configMAX_PRIORITIES 25
+#define configNUM_CORES 2
+#define portNUM_PROCESSORS configNUM_CORES
+#define tskNO_AFFINITY ((BaseType_t)0x7fffffff)
+#define WIFI_TASK_CORE_ID 0
+
+BaseType_t xPortGetCoreID(void);
@@ -0,0 +1,54 @@
+#pragma once
+
+/**
+ * Controls of the simulated hardware for the host tests and benchmarks.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "driver/uart.h"
+#include "esp_log.h"
+
+/* everything received on the simulated line of a UART, and the overflows */
+typedef struct
+{
+    uint64_t bytes;             /* shifted into the FIFO */
+    uint32_t isr_calls;         /* FIFO moved into the driver ring */
+    uint32_t events;            /* posted to the event queue */
+    uint32_t events_dropped;    /* the event queue was full */
+    uint32_t buffer_full;       /* UART_BUFFER_FULL events */
+    uint32_t fifo_overflows;    /* UART_FIFO_OVF events */
+    uint64_t overflow_bytes;    /* lost in the FIFO */
+} host_uart_stats_t;
+
+/* called with the bytes entering the FIFO, and when they did */
+typedef void (*host_uart_rx_hook_t)(uart_port_t port, const char *data, size_t len, int64_t time_us);
+
+/* baud rate of the line instead of the one configured by the firmware, 0 to not override */
+void host_uart_set_baud(uart_port_t port, int baud_rate);
+
+void host_uart_set_rx_hook(uart_port_t port, host_uart_rx_hook_t hook);
+
+/* send bytes over the line, blocks while the line is busy with earlier ones */
+void host_uart_write(uart_port_t port, const char *data, size_t len);
+
+/* wait until everything written went over the line */
+void host_uart_wait_sent(uart_port_t port);
+
+void host_uart_get_stats(uart_port_t port, host_uart_stats_t *stats);
+
+/* post IP_EVENT_STA_GOT_IP, or WIFI_EVENT_STA_DISCONNECTED */
+void host_set_link(bool up);
+
+/* last mode set through wifi_set_power_save() */
+bool host_wifi_power_save(void);
+
+/* size of the "spool" partition, 0 for none; to be set before it is found */
+void host_flash_set_size(uint32_t size);
+
+/* let every flash operation after the next count ones fail, -1 never */
+void host_flash_fail_after(int count);
+
+extern esp_log_level_t host_log_level;
@@ -0,0 +1,7 @@
+#pragma once
+
+/* what ESP-IDF's newlib has and older glibc lacks, included into every source */
+
+#include <stddef.h>
+
+size_t strlcpy(char *dst, const char *src, size_t size);
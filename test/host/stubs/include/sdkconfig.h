@@ -0,0 +1,53 @@
+#pragma once
+
+/**
+ * Host build configuration. The boolean options are set per target by
+ * test/host/CMakeLists.txt, the values below are the Kconfig defaults.
+ */
+
+extern unsigned int host_syslog_port;   /* the port of the harness receiver */
+
+#define CONFIG_OWN_HOSTNAME "uart-syslog"
+#define CONFIG_SYSLOG_HOST "127.0.0.1"
+#define CONFIG_SYSLOG_HOST_FALLBACK ""
+#define CONFIG_SYSLOG_PORT host_syslog_port
+#define CONFIG_SYSLOG_RESOLVE_INTERVAL 300
+#define CONFIG_SYSLOG_APP_NAME "-"
+
+#define CONFIG_SYSLOG_RAW_IDLE_MS 20
+#define CONFIG_SYSLOG_MAX_LINE_LEN 1024
+#define CONFIG_SYSLOG_IDLE_FLUSH_MS 250
+#define CONFIG_SYSLOG_LINE_RING_SIZE 16384
+#define CONFIG_SYSLOG_LINE_QUEUE_SIZE 256
+
+#define CONFIG_SYSLOG_BATCH_MAX_SIZE 1400
+#define CONFIG_SYSLOG_BATCH_MAX_LINES 32
+#define CONFIG_SYSLOG_BATCH_MAX_DELAY_MS 20
+
+#define CONFIG_SYSLOG_SPOOL_RAM_SIZE 16384
+#define CONFIG_SYSLOG_SPOOL_REPLAY_RATE 200
+
+#define CONFIG_SYSLOG_SNTP_SERVER ""
+#define CONFIG_SYSLOG_DEDUPE_WINDOW_MS 1000
+#define CONFIG_SYSLOG_SEVERITY_PATTERNS "E (=3,W (=4,I (=6,D (=7,V (=7,Error:=3,!!=2,echo:=6,// =6," \
+                                        "<0>=0,<1>=1,<2>=2,<3>=3,<4>=4,<5>=5,<6>=6,<7>=7"
+#define CONFIG_SYSLOG_STATS_INTERVAL 60
+
+#define CONFIG_SYSLOG_WIFI_PS_HIGH_RATE 4000
+#define CONFIG_SYSLOG_WIFI_PS_LOW_RATE 1000
+#define CONFIG_SYSLOG_WIFI_PS_HIGH_QUEUED 4096
+#define CONFIG_SYSLOG_WIFI_PS_HOLD_MS 5000
+
+#define CONFIG_SYSLOG_TRACE_RING_SIZE 1024
+
+#define CONFIG_SYSLOG_USE_UART1 1
+#define CONFIG_SYSLOG_UART1_TASK_NAME "uart1"
+#define CONFIG_SYSLOG_UART1_BAUD_RATE 115200
+#define CONFIG_SYSLOG_UART1_RX_PIN 9
+#define CONFIG_SYSLOG_UART1_BUF_SIZE 10240
+#define CONFIG_SYSLOG_UART1_EVENT_QUEUE_SIZE 100
+#define CONFIG_SYSLOG_UART1_PATTERN_QUEUE_SIZE 500
+#define CONFIG_SYSLOG_UART1_RX_FULL_THRESHOLD 42
+#define CONFIG_SYSLOG_UART1_RX_TIMEOUT 10
+
+#define CONFIG_FREERTOS_HZ 100
@@ -0,0 +1,3 @@
+#pragma once
+
+#define UART_RXFIFO_FULL_THRHD_V 0x7F
@@ -0,0 +1,485 @@
+/**
+ * The UART driver on a simulated line. A thread per UART shifts the bytes
+ * written by the harness into the 128 byte hardware FIFO at the baud rate
+ * (10 bits per byte) and plays the interrupt handler of ESP-IDF: when the
+ * FIFO reaches the RX full threshold, or the line stays idle for the RX
+ * timeout, the FIFO is moved into the driver ring and an event posted. If
+ * the ring has no room, the bytes are stashed, the RX interrupts disabled and
+ * UART_BUFFER_FULL posted; the FIFO then overflows (UART_FIFO_OVF, the FIFO is
+ * reset) until a read makes room for the stash again.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "driver/uart.h"
+#include "freertos/queue.h"
+#include "host.h"
+
+#define WIRE_SIZE 4096                  /*!< written, not yet on the line */
+#define DEFAULT_RX_FULL_THRESHOLD 120   /*!< of the ESP-IDF driver */
+#define DEFAULT_RX_TIMEOUT 10
+#define BITS_PER_BYTE 10
+#define MIN_SLEEP_NS 20000
+
+#define min(a,b) \
+   ({ __typeof__ (a) _a = (a); \
+       __typeof__ (b) _b = (b); \
+     _a < _b ? _a : _b; })
+
+typedef struct
+{
+    bool installed;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    pthread_t line_thread;
+    QueueHandle_t events;
+    int baud_rate;
+    int baud_override;
+    int rx_full_threshold;
+    int rx_timeout;                     /* in symbols */
+    bool pattern_det;
+    char pattern_chr;
+    host_uart_rx_hook_t hook;
+    /* the line */
+    char wire[WIRE_SIZE];
+    size_t wire_head;
+    size_t wire_len;
+    int64_t line_start_ns;              /* since then the line is busy */
+    uint64_t line_bytes;                /* shifted in since line_start_ns */
+    /* the hardware */
+    char fifo[UART_FIFO_LEN];
+    size_t fifo_len;
+    int64_t last_rx_ns;
+    bool rx_intr_enabled;
+    /* the driver */
+    char stash[UART_FIFO_LEN];          /* read from the FIFO while the ring was full */
+    size_t stash_len;
+    char *ring;
+    size_t ring_size;
+    size_t ring_head;
+    size_t ring_len;
+    host_uart_stats_t stats;
+} host_uart_t;
+
+static host_uart_t uarts[UART_NUM_MAX];
+
+
+static int64_t monotonic_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+
+static int baud_rate(const host_uart_t *uart)
+{
+    return uart->baud_override ? uart->baud_override : uart->baud_rate;
+}
+
+
+static int64_t symbol_ns(const host_uart_t *uart)
+{
+    return 1000000000LL * BITS_PER_BYTE / baud_rate(uart);
+}
+
+
+static void ring_put(host_uart_t *uart, const char *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        uart->ring[(uart->ring_head + uart->ring_len + i) % uart->ring_size] = data[i];
+    }
+    uart->ring_len += len;
+}
+
+
+static void post_event(host_uart_t *uart, uart_event_type_t type, size_t size, bool timeout_flag)
+{
+    const uart_event_t event = { .type = type, .size = size, .timeout_flag = timeout_flag };
+    if (xQueueSendFromISR(uart->events, &event, NULL) == pdPASS)
+    {
+        uart->stats.events += 1;
+    }
+    else
+    {
+        uart->stats.events_dropped += 1;
+    }
+}
+
+
+/* the RX full and RX timeout interrupt */
+static void rx_interrupt(host_uart_t *uart, bool timeout_flag)
+{
+    const size_t len = uart->fifo_len;
+    uart->stats.isr_calls += 1;
+    uart->fifo_len = 0;
+    if (uart->ring_size - uart->ring_len < len)
+    {
+        memcpy(uart->stash, uart->fifo, len);
+        uart->stash_len = len;
+        uart->rx_intr_enabled = false;
+        uart->stats.buffer_full += 1;
+        post_event(uart, UART_BUFFER_FULL, len, timeout_flag);
+        return;
+    }
+    ring_put(uart, uart->fifo, len);
+    const bool pattern = uart->pattern_det && memchr(uart->fifo, uart->pattern_chr, len);
+    post_event(uart, pattern ? UART_PATTERN_DET : UART_DATA, len, timeout_flag);
+}
+
+
+/* shift len bytes from the wire into the FIFO */
+static void receive(host_uart_t *uart, size_t len, int64_t now_ns)
+{
+    while (len > 0)
+    {
+        if (uart->rx_intr_enabled && (uart->fifo_len >= (size_t)uart->rx_full_threshold))
+        {
+            rx_interrupt(uart, false);
+        }
+        if (uart->fifo_len == UART_FIFO_LEN)
+        {
+            // the RX interrupts are off, the overflow interrupt resets the FIFO
+            uart->stats.fifo_overflows += 1;
+            uart->stats.overflow_bytes += uart->fifo_len;
+            uart->fifo_len = 0;
+            post_event(uart, UART_FIFO_OVF, 0, false);
+        }
+        const size_t room = (uart->rx_intr_enabled ? (size_t)uart->rx_full_threshold : UART_FIFO_LEN) - uart->fifo_len;
+        const size_t count = min(min(len, uart->wire_len), min(room, (size_t)WIRE_SIZE - uart->wire_head));
+        memcpy(uart->fifo + uart->fifo_len, uart->wire + uart->wire_head, count);
+        if (uart->hook)
+        {
+            uart->hook(uart - uarts, uart->wire + uart->wire_head, count, now_ns / 1000);
+        }
+        uart->fifo_len += count;
+        uart->wire_head = (uart->wire_head + count) % WIRE_SIZE;
+        uart->wire_len -= count;
+        uart->stats.bytes += count;
+        uart->line_bytes += count;
+        len -= count;
+    }
+    if (uart->rx_intr_enabled && (uart->fifo_len >= (size_t)uart->rx_full_threshold))
+    {
+        rx_interrupt(uart, false);
+    }
+    uart->last_rx_ns = now_ns;
+}
+
+
+static void *line_task(void *arg)
+{
+    host_uart_t *uart = arg;
+    pthread_mutex_lock(&uart->lock);
+    while (uart->installed)
+    {
+        const int64_t now = monotonic_ns();
+        const int64_t timeout_at = uart->last_rx_ns + uart->rx_timeout * symbol_ns(uart);
+        int64_t wake_at = INT64_MAX;
+
+        if (uart->wire_len > 0)
+        {
+            if (uart->line_bytes == 0)
+            {
+                uart->line_start_ns = now;
+            }
+            const uint64_t due = (uint64_t)((now - uart->line_start_ns) / symbol_ns(uart)) + 1;
+            if (due > uart->line_bytes)
+            {
+                receive(uart, min(due - uart->line_bytes, (uint64_t)uart->wire_len), now);
+                pthread_cond_broadcast(&uart->changed);
+            }
+            wake_at = uart->line_start_ns + (int64_t)uart->line_bytes * symbol_ns(uart);
+        }
+        else
+        {
+            // the line went idle, the next byte starts a new burst
+            uart->line_bytes = 0;
+            if ((uart->fifo_len > 0) && uart->rx_intr_enabled)
+            {
+                if (now >= timeout_at)
+                {
+                    rx_interrupt(uart, true);
+                }
+                else
+                {
+                    wake_at = timeout_at;
+                }
+            }
+        }
+
+        if (wake_at == INT64_MAX)
+        {
+            pthread_cond_wait(&uart->changed, &uart->lock);
+        }
+        else
+        {
+            const int64_t until_ns = (wake_at > now + MIN_SLEEP_NS) ? wake_at : now + MIN_SLEEP_NS;
+            const struct timespec until = { .tv_sec = until_ns / 1000000000LL, .tv_nsec = until_ns % 1000000000LL };
+            (void) pthread_cond_timedwait(&uart->changed, &uart->lock, &until);
+        }
+    }
+    pthread_mutex_unlock(&uart->lock);
+    return NULL;
+}
+
+
+static host_uart_t *get_uart(uart_port_t port)
+{
+    return ((port >= 0) && (port < UART_NUM_MAX) && uarts[port].installed) ? &uarts[port] : NULL;
+}
+
+
+esp_err_t uart_driver_install(uart_port_t port, int rx_buffer_size, int tx_buffer_size, int queue_size,
+                              QueueHandle_t *queue, int intr_alloc_flags)
+{
+    if ((port < 0) || (port >= UART_NUM_MAX) || uarts[port].installed || (rx_buffer_size <= UART_FIFO_LEN))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    host_uart_t *uart = &uarts[port];
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&uart->changed, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&uart->lock, NULL);
+    uart->events = xQueueCreate(queue_size, sizeof(uart_event_t));
+    uart->ring = malloc(rx_buffer_size);
+    uart->ring_size = rx_buffer_size;
+    uart->ring_head = 0;
+    uart->ring_len = 0;
+    uart->baud_rate = 115200;
+    uart->rx_full_threshold = DEFAULT_RX_FULL_THRESHOLD;
+    uart->rx_timeout = DEFAULT_RX_TIMEOUT;
+    uart->rx_intr_enabled = true;
+    uart->installed = true;
+    *queue = uart->events;
+    pthread_create(&uart->line_thread, NULL, line_task, uart);
+    return ESP_OK;
+}
+
+
+esp_err_t uart_driver_delete(uart_port_t port)
+{
+    host_uart_t *uart = get_uart(port);
+    if (uart == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    pthread_mutex_lock(&uart->lock);
+    uart->installed = false;
+    pthread_cond_broadcast(&uart->changed);
+    pthread_mutex_unlock(&uart->lock);
+    pthread_join(uart->line_thread, NULL);
+    vQueueDelete(uart->events);
+    free(uart->ring);
+    uart->ring = NULL;
+    return ESP_OK;
+}
+
+
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t *config)
+{
+    host_uart_t *uart = get_uart(port);
+    if ((uart == NULL) || (config->baud_rate <= 0))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&uart->lock);
+    uart->baud_rate = config->baud_rate;
+    pthread_mutex_unlock(&uart->lock);
+    return ESP_OK;
+}
+
+
+esp_err_t uart_set_pin(uart_port_t port, int tx_pin, int rx_pin, int rts_pin, int cts_pin)
+{
+    return get_uart(port) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+
+esp_err_t uart_set_rx_full_threshold(uart_port_t port, int threshold)
+{
+    host_uart_t *uart = get_uart(port);
+    if ((uart == NULL) || (threshold < 1) || (threshold >= UART_FIFO_LEN))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&uart->lock);
+    uart->rx_full_threshold = threshold;
+    pthread_mutex_unlock(&uart->lock);
+    return ESP_OK;
+}
+
+
+esp_err_t uart_set_rx_timeout(uart_port_t port, uint8_t timeout)
+{
+    host_uart_t *uart = get_uart(port);
+    if ((uart == NULL) || (timeout == 0))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&uart->lock);
+    uart->rx_timeout = timeout;
+    pthread_mutex_unlock(&uart->lock);
+    return ESP_OK;
+}
+
+
+esp_err_t uart_enable_pattern_det_baud_intr(uart_port_t port, char pattern_chr, uint8_t chr_num,
+                                            int chr_tout, int post_idle, int pre_idle)
+{
+    host_uart_t *uart = get_uart(port);
+    if (uart == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&uart->lock);
+    uart->pattern_det = true;
+    uart->pattern_chr = pattern_chr;
+    pthread_mutex_unlock(&uart->lock);
+    return ESP_OK;
+}
+
+
+/* the positions are not recorded, the bridge does not pop them */
+esp_err_t uart_pattern_queue_reset(uart_port_t port, int queue_length)
+{
+    return get_uart(port) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+
+int uart_read_bytes(uart_port_t port, void *buf, uint32_t length, TickType_t ticks_to_wait)
+{
+    host_uart_t *uart = get_uart(port);
+    if (uart == NULL)
+    {
+        return -1;
+    }
+    pthread_mutex_lock(&uart->lock);
+    const size_t len = min((size_t)length, uart->ring_len);
+    for (size_t i = 0; i < len; i++)
+    {
+        ((char *)buf)[i] = uart->ring[(uart->ring_head + i) % uart->ring_size];
+    }
+    uart->ring_head = (uart->ring_head + len) % uart->ring_size;
+    uart->ring_len -= len;
+    // like uart_check_buf_full(): room for the stash turns the RX interrupts back on
+    if (!uart->rx_intr_enabled && (uart->ring_size - uart->ring_len >= uart->stash_len))
+    {
+        ring_put(uart, uart->stash, uart->stash_len);
+        uart->stash_len = 0;
+        uart->rx_intr_enabled = true;
+        pthread_cond_broadcast(&uart->changed);
+    }
+    pthread_mutex_unlock(&uart->lock);
+    return (int)len;
+}
+
+
+esp_err_t uart_get_buffered_data_len(uart_port_t port, size_t *size)
+{
+    host_uart_t *uart = get_uart(port);
+    if (uart == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&uart->lock);
+    *size = uart->ring_len;
+    pthread_mutex_unlock(&uart->lock);
+    return ESP_OK;
+}
+
+
+esp_err_t uart_flush_input(uart_port_t port)
+{
+    host_uart_t *uart = get_uart(port);
+    if (uart == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&uart->lock);
+    uart->ring_head = 0;
+    uart->ring_len = 0;
+    uart->stash_len = 0;
+    uart->fifo_len = 0;
+    uart->rx_intr_enabled = true;
+    pthread_cond_broadcast(&uart->changed);
+    pthread_mutex_unlock(&uart->lock);
+    return ESP_OK;
+}
+
+
+void host_uart_set_baud(uart_port_t port, int baud_rate)
+{
+    uarts[port].baud_override = baud_rate;
+}
+
+
+void host_uart_set_rx_hook(uart_port_t port, host_uart_rx_hook_t hook)
+{
+    uarts[port].hook = hook;
+}
+
+
+void host_uart_write(uart_port_t port, const char *data, size_t len)
+{
+    host_uart_t *uart = get_uart(port);
+    if (uart == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&uart->lock);
+    while (len > 0)
+    {
+        while (uart->wire_len == WIRE_SIZE)
+        {
+            pthread_cond_wait(&uart->changed, &uart->lock);
+        }
+        const size_t tail = (uart->wire_head + uart->wire_len) % WIRE_SIZE;
+        const size_t count = min(len, min(WIRE_SIZE - uart->wire_len, WIRE_SIZE - tail));
+        memcpy(uart->wire + tail, data, count);
+        uart->wire_len += count;
+        data += count;
+        len -= count;
+        pthread_cond_broadcast(&uart->changed);
+    }
+    pthread_mutex_unlock(&uart->lock);
+}
+
+
+void host_uart_wait_sent(uart_port_t port)
+{
+    host_uart_t *uart = get_uart(port);
+    if (uart == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&uart->lock);
+    while (uart->wire_len > 0)
+    {
+        pthread_cond_wait(&uart->changed, &uart->lock);
+    }
+    pthread_mutex_unlock(&uart->lock);
+}
+
+
+void host_uart_get_stats(uart_port_t port, host_uart_stats_t *stats)
+{
+    host_uart_t *uart = &uarts[port];
+    if (!uart->installed)
+    {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    pthread_mutex_lock(&uart->lock);
+    *stats = uart->stats;
+    pthread_mutex_unlock(&uart->lock);
+}
@@ -0,0 +1,169 @@
+/**
+ * dedupe: suppressing and summarizing repeats, the window, a forced hash
+ * collision, lines wrapping around the end of the ring, a full table, and
+ * the time per line.
+ */
+
+#include <string.h>
+
+#include "dedupe.h"
+#include "check.h"
+
+#define WINDOW pdMS_TO_TICKS(CONFIG_SYSLOG_DEDUPE_WINDOW_MS)
+#define BENCH_LINES 4000000u
+
+/* two lines of the same length whose FNV-1a hashes are equal (0xf1f613c9) */
+#define COLLISION_A "E (0720089) x"
+#define COLLISION_B "E (1214000) x"
+
+
+static line_record_t record(const char *text, uint32_t seq)
+{
+    return (line_record_t) {
+        .span = { .seg = { text, NULL }, .len = { strlen(text), 0 } },
+        .seq = seq,
+        .severity = 3,
+        .timestamp_us = 1000 * seq,
+    };
+}
+
+
+static void test_repeats(void)
+{
+    static dedupe_t dedupe;
+    dedupe_entry_t summary;
+    dedupe_init(&dedupe);
+    const line_record_t a = record("boot loop", 1);
+    const line_record_t b = record("other line", 2);
+
+    CHECK(!dedupe_check(&dedupe, &a, 0));
+    CHECK(!dedupe_check(&dedupe, &b, 0));
+    CHECK(dedupe_poll(&dedupe, 0) == portMAX_DELAY);
+    for (uint32_t seq = 3; seq < 13; seq++)
+    {
+        const line_record_t repeat = record("boot loop", seq);
+        CHECK(dedupe_check(&dedupe, &repeat, 1));
+    }
+    CHECK(dedupe.suppressed == 10);
+    CHECK(dedupe_poll(&dedupe, 1) == WINDOW - 1);
+
+    /* nothing is due yet, but a different line takes all summaries */
+    CHECK(!dedupe_take_summary(&dedupe, 1, false, &summary));
+    CHECK(dedupe_take_summary(&dedupe, 1, true, &summary));
+    CHECK((summary.count == 10) && (summary.last_seq == 12) && (summary.last_timestamp_us == 12000));
+    CHECK((summary.severity == 3) && (strcmp(summary.sample, "boot loop") == 0));
+    CHECK(!dedupe_take_summary(&dedupe, 1, true, &summary));
+
+    /* still within the window: suppressed again, summarized once it expired */
+    const line_record_t repeat = record("boot loop", 13);
+    CHECK(dedupe_check(&dedupe, &repeat, 2));
+    CHECK(dedupe_take_summary(&dedupe, WINDOW, false, &summary));
+    CHECK((summary.count == 1) && (summary.last_seq == 13));
+    CHECK(!dedupe_take_summary(&dedupe, WINDOW, false, &summary));
+
+    /* forgotten after the window */
+    CHECK(!dedupe_check(&dedupe, &a, WINDOW));
+    CHECK(dedupe_check(&dedupe, &a, WINDOW));
+}
+
+
+static void test_collision(void)
+{
+    static dedupe_t dedupe;
+    dedupe_init(&dedupe);
+    const line_record_t a = record(COLLISION_A, 1);
+    const line_record_t b = record(COLLISION_B, 2);
+    CHECK(!dedupe_check(&dedupe, &a, 0));
+    CHECK(!dedupe_check(&dedupe, &b, 0));
+    CHECK(dedupe_check(&dedupe, &b, 0));
+    CHECK(dedupe.suppressed == 1);
+
+    /* the same start but a different length */
+    const line_record_t longer = record(COLLISION_A " more", 3);
+    CHECK(!dedupe_check(&dedupe, &longer, 0));
+}
+
+
+static void test_wrapped(void)
+{
+    static dedupe_t dedupe;
+    dedupe_init(&dedupe);
+    const line_record_t line = record("W (1234) heater: overshoot", 1);
+    line_record_t wrapped = line;
+    wrapped.span = (line_span_t) { .seg = { "W (1234) he", "ater: overshoot" }, .len = { 11, 15 } };
+    CHECK(!dedupe_check(&dedupe, &wrapped, 0));
+    CHECK(dedupe_check(&dedupe, &line, 0));
+    CHECK(dedupe_check(&dedupe, &wrapped, 0));
+}
+
+
+/* with all entries in use, further lines are not remembered */
+static void test_full(void)
+{
+    static dedupe_t dedupe;
+    dedupe_init(&dedupe);
+    char texts[DEDUPE_ENTRIES + 1][8];
+    for (int i = 0; i <= DEDUPE_ENTRIES; i++)
+    {
+        snprintf(texts[i], sizeof(texts[i]), "line %d", i);
+        const line_record_t line = record(texts[i], i);
+        CHECK(!dedupe_check(&dedupe, &line, 0));
+    }
+    const line_record_t first = record(texts[0], 20);
+    const line_record_t last = record(texts[DEDUPE_ENTRIES], 21);
+    CHECK(dedupe_check(&dedupe, &first, 1));
+    CHECK(!dedupe_check(&dedupe, &last, 1));
+
+    /* expired entries without repeats make room again */
+    CHECK(!dedupe_check(&dedupe, &last, WINDOW + 1));
+    CHECK(dedupe_check(&dedupe, &last, WINDOW + 1));
+}
+
+
+/* time per line of lines which differ (but for a few remembered ones), and of a line repeating */
+static void bench(void)
+{
+    static dedupe_t dedupe;
+    static char texts[4096][80];
+    static const char *const lines[] = {
+        "ok T:210.0 /210.0 B:60.0 /60.0 @:64 B@:32",
+        "I (123456) motion: G1 X120.500 Y80.250 E0.04210 F3000",
+        "X:120.50 Y:80.25 Z:2.40 E:0.00 Count X:9640 Y:6420 Z:960",
+    };
+    const size_t count = sizeof(texts) / sizeof(texts[0]);
+    for (size_t i = 0; i < count; i++)
+    {
+        snprintf(texts[i], sizeof(texts[i]), "%s %u", lines[i % 3], (unsigned)i);
+    }
+    dedupe_init(&dedupe);
+
+    int64_t start = bench_ns();
+    for (uint32_t i = 0; i < BENCH_LINES; i++)
+    {
+        const line_record_t line = record(texts[i % count], i);
+        (void) dedupe_check(&dedupe, &line, 0);
+    }
+    const double different_ns = (double)(bench_ns() - start) / BENCH_LINES;
+
+    dedupe_init(&dedupe);
+    start = bench_ns();
+    for (uint32_t i = 0; i < BENCH_LINES; i++)
+    {
+        const line_record_t line = record(texts[0], i);
+        (void) dedupe_check(&dedupe, &line, 0);
+    }
+    const double repeated_ns = (double)(bench_ns() - start) / BENCH_LINES;
+    CHECK(dedupe.suppressed == BENCH_LINES - 1);
+    printf("different lines: %.0f ns per line, a repeated line: %.0f ns per line\n", different_ns, repeated_ns);
+}
+
+
+int main(void)
+{
+    test_repeats();
+    test_collision();
+    test_wrapped();
+    test_full();
+    bench();
+    return CHECK_DONE();
+}
@@ -0,0 +1,68 @@
+/**
+ * histogram: bucketing and percentiles reported as exclusive bucket bounds.
+ */
+
+#include "histogram.h"
+#include "check.h"
+
+
+static void test_buckets(void)
+{
+    histogram_t histogram;
+    histogram_reset(&histogram);
+    histogram_add(&histogram, 0);
+    histogram_add(&histogram, 1);
+    histogram_add(&histogram, 2);
+    histogram_add(&histogram, 3);
+    histogram_add(&histogram, 4);
+    histogram_add(&histogram, UINT32_MAX);
+    CHECK(histogram.count[0] == 1);
+    CHECK(histogram.count[1] == 1);
+    CHECK(histogram.count[2] == 2);
+    CHECK(histogram.count[3] == 1);
+    CHECK(histogram.count[HISTOGRAM_BUCKETS - 1] == 1);
+    CHECK(histogram.total == 6);
+}
+
+
+static void test_bucket_bounds(void)
+{
+    CHECK(histogram_bucket_bound(0) == 1);
+    CHECK(histogram_bucket_bound(1) == 2);
+    CHECK(histogram_bucket_bound(10) == 1024);
+    CHECK(histogram_bucket_bound(HISTOGRAM_BUCKETS - 2) == (uint32_t)1 << (HISTOGRAM_BUCKETS - 2));
+    CHECK(histogram_bucket_bound(HISTOGRAM_BUCKETS - 1) == UINT32_MAX);
+}
+
+
+/* every value is below the percentile reported for it */
+static void test_percentiles(void)
+{
+    histogram_t histogram;
+    histogram_reset(&histogram);
+    CHECK(histogram_percentile(&histogram, 50) == 0);
+
+    for (uint32_t value = 1; value <= 100; value++)
+    {
+        histogram_add(&histogram, value);
+    }
+    CHECK(histogram_percentile(&histogram, 1) == 2);        /* 1 in [1, 2) */
+    CHECK(histogram_percentile(&histogram, 50) == 64);      /* 50 in [32, 64) */
+    CHECK(histogram_percentile(&histogram, 99) == 128);     /* 99 in [64, 128) */
+    CHECK(histogram_percentile(&histogram, 100) == 128);
+
+    histogram_reset(&histogram);
+    histogram_add(&histogram, 0);
+    CHECK(histogram_percentile(&histogram, 50) == 1);
+    histogram_add(&histogram, 3000000000u);
+    CHECK(histogram_percentile(&histogram, 100) == UINT32_MAX);
+}
+
+
+int main(void)
+{
+    test_buckets();
+    test_bucket_bounds();
+    test_percentiles();
+    return CHECK_DONE();
+}
@@ -0,0 +1,107 @@
+/**
+ * line_queue: order, full and empty queue, and records handed from a
+ * producer thread to a consumer thread, as from the capture to the sender
+ * task, with the rate at which that happens.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "line_queue.h"
+#include "check.h"
+
+#define STRESS_RECORDS 4000000u
+
+
+static void test_order(void)
+{
+    line_queue_t queue;
+    line_record_t slots[4];
+    CHECK(!line_queue_init(&queue, slots, 3));
+    CHECK(line_queue_init(&queue, slots, 4));
+    CHECK(line_queue_front(&queue) == NULL);
+
+    /* several rounds, so that the positions wrap around the slots */
+    uint32_t pushed = 0, popped = 0;
+    for (int round = 0; round < 5; round++)
+    {
+        while (!line_queue_full(&queue))
+        {
+            const line_record_t record = { .seq = pushed++ };
+            CHECK(line_queue_push(&queue, &record));
+        }
+        const line_record_t record = { .seq = pushed };
+        CHECK(!line_queue_push(&queue, &record));
+        CHECK(line_queue_depth(&queue) == 4);
+
+        for (int i = 0; i < 3; i++)
+        {
+            const line_record_t *front = line_queue_front(&queue);
+            CHECK(front && (front->seq == popped));
+            popped += 1;
+            line_queue_pop(&queue);
+        }
+        CHECK(line_queue_depth(&queue) == 1);
+    }
+    CHECK(queue.high_water == 4);
+}
+
+
+static void *consume(void *arg)
+{
+    line_queue_t *queue = arg;
+    uint32_t expected = 0;
+    while (expected < STRESS_RECORDS)
+    {
+        const line_record_t *front = line_queue_front(queue);
+        if (front == NULL)
+        {
+            sched_yield();
+            continue;
+        }
+        if ((front->seq != expected) || (front->span.next != expected * 3u))
+        {
+            break;
+        }
+        expected += 1;
+        line_queue_pop(queue);
+    }
+    return (void *)(uintptr_t)expected;
+}
+
+
+/* the consumer must see every record complete and in order */
+static void test_threads(void)
+{
+    static line_record_t slots[64];
+    line_queue_t queue;
+    pthread_t consumer;
+    CHECK(line_queue_init(&queue, slots, 64));
+    CHECK(pthread_create(&consumer, NULL, consume, &queue) == 0);
+
+    const int64_t start = bench_ns();
+    for (uint32_t seq = 0; seq < STRESS_RECORDS; seq++)
+    {
+        const line_record_t record = { .seq = seq, .span.next = seq * 3u };
+        while (!line_queue_push(&queue, &record))
+        {
+            sched_yield();
+        }
+    }
+    void *received;
+    pthread_join(consumer, &received);
+    const double seconds = (bench_ns() - start) / 1e9;
+
+    CHECK((uint32_t)(uintptr_t)received == STRESS_RECORDS);
+    CHECK(line_queue_front(&queue) == NULL);
+    printf("%.1f M records/s between two threads, high water %zu of 64\n",
+           STRESS_RECORDS / seconds / 1e6, queue.high_water);
+}
+
+
+int main(void)
+{
+    test_order();
+    test_threads();
+    return CHECK_DONE();
+}
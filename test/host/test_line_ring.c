@@ -0,0 +1,308 @@
+/**
+ * line_ring: framing lines in place across the end of the ring, splitting
+ * over-long lines, incomplete lines sent as parts, raw chunks, and the
+ * framing rate compared with copying every line out of the driver buffer
+ * into a scratch buffer first, as the bridge did before.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "line_ring.h"
+#include "check.h"
+
+#define BENCH_RING_SIZE 16384
+#define BENCH_MAX_LEN 200
+#define BENCH_BYTES (64u << 20)
+
+
+/* write all of text into the ring, which must have room for it */
+static void put(line_ring_t *ring, const char *text, size_t len)
+{
+    while (len > 0)
+    {
+        size_t avail;
+        char *dst = line_ring_write_ptr(ring, &avail);
+        const size_t n = (avail < len) ? avail : len;
+        memcpy(dst, text, n);
+        line_ring_commit(ring, n);
+        text += n;
+        len -= n;
+    }
+}
+
+
+static void put_str(line_ring_t *ring, const char *text)
+{
+    put(ring, text, strlen(text));
+}
+
+
+/* true if the span holds exactly text */
+static bool span_is(const line_span_t *span, const char *text)
+{
+    const size_t len = strlen(text);
+    return (line_span_len(span) == len) &&
+           (memcmp(span->seg[0], text, span->len[0]) == 0) &&
+           (memcmp(span->seg[1], text + span->len[0], span->len[1]) == 0);
+}
+
+
+static void test_init(void)
+{
+    line_ring_t ring;
+    char buf[16];
+    CHECK(!line_ring_init(&ring, buf, 0));
+    CHECK(!line_ring_init(&ring, buf, 12));
+    CHECK(line_ring_init(&ring, buf, 16));
+    size_t avail;
+    CHECK(line_ring_write_ptr(&ring, &avail) == buf);
+    CHECK(avail == 16);
+}
+
+
+/* lines arrive in small pieces and wrap around the 16-byte ring */
+static void test_lines_wrap(void)
+{
+    static const char *const lines[] = { "ab", "cdefghij", "", "mnopqrs", "kl", "tu" };
+    line_ring_t ring;
+    char buf[16];
+    line_span_t span;
+    CHECK(line_ring_init(&ring, buf, sizeof(buf)));
+
+    const char *input = "ab\r\ncdefghij\n\r\nmnopqrs\nkl\ntu\n";
+    size_t line = 0;
+    bool wrapped = false;
+    const size_t len = strlen(input);
+    for (size_t pos = 0; pos < len; pos += 3)
+    {
+        put(&ring, input + pos, (len - pos < 3) ? len - pos : 3);
+        while (line_ring_next_line(&ring, 8, &span) && (line < 6))
+        {
+            CHECK(span_is(&span, lines[line]));
+            CHECK((span.part == 0) && !span.more);
+            wrapped |= (span.len[1] > 0);
+            line += 1;
+            line_ring_release(&ring, &span);
+        }
+    }
+    CHECK(line == 6);
+    CHECK(wrapped);
+    CHECK(line_ring_fill(&ring) == 0);
+    CHECK(ring.split_count == 0);
+}
+
+
+/* a line only fits once the lines before were released */
+static void test_release(void)
+{
+    line_ring_t ring;
+    char buf[16];
+    line_span_t first, second;
+    CHECK(line_ring_init(&ring, buf, sizeof(buf)));
+    put_str(&ring, "12345\n6789\n");
+    CHECK(line_ring_next_line(&ring, 8, &first));
+    CHECK(line_ring_next_line(&ring, 8, &second));
+    CHECK(line_ring_fill(&ring) == 11);
+
+    size_t avail;
+    (void) line_ring_write_ptr(&ring, &avail);
+    CHECK(avail == 5);
+    line_ring_release(&ring, &first);
+    CHECK(line_ring_fill(&ring) == 5);
+    line_ring_release(&ring, &second);
+    CHECK(line_ring_fill(&ring) == 0);
+    (void) line_ring_write_ptr(&ring, &avail);
+    CHECK(avail == 5);      /* up to the end of the buffer */
+}
+
+
+/* lines longer than max_len become numbered parts */
+static void test_split(void)
+{
+    line_ring_t ring;
+    char buf[64];
+    line_span_t span;
+    CHECK(line_ring_init(&ring, buf, sizeof(buf)));
+
+    put_str(&ring, "0123456789abcdefghij\r\n");
+    CHECK(line_ring_next_line(&ring, 8, &span) && span_is(&span, "01234567"));
+    CHECK((span.part == 1) && span.more);
+    CHECK(line_ring_next_line(&ring, 8, &span) && span_is(&span, "89abcdef"));
+    CHECK((span.part == 2) && span.more);
+    CHECK(line_ring_next_line(&ring, 8, &span) && span_is(&span, "ghij"));
+    CHECK((span.part == 3) && !span.more);
+    CHECK(!line_ring_next_line(&ring, 8, &span));
+    line_ring_release(&ring, &span);
+
+    /* exactly max_len bytes, and one more */
+    put_str(&ring, "01234567\n012345678\n");
+    CHECK(line_ring_next_line(&ring, 8, &span) && span_is(&span, "01234567"));
+    CHECK(span.part == 0);
+    CHECK(line_ring_next_line(&ring, 8, &span) && span_is(&span, "01234567"));
+    CHECK((span.part == 1) && span.more);
+    CHECK(line_ring_next_line(&ring, 8, &span) && span_is(&span, "8"));
+    CHECK((span.part == 2) && !span.more);
+    CHECK(ring.split_count == 2);
+}
+
+
+/* incomplete lines sent after the input went idle, the rest follows as further parts */
+static void test_partial(void)
+{
+    line_ring_t ring;
+    char buf[32];
+    line_span_t span;
+    CHECK(line_ring_init(&ring, buf, sizeof(buf)));
+    put_str(&ring, "one\nprompt> ");
+    CHECK(line_ring_next_line(&ring, 16, &span) && span_is(&span, "one") && (span.part == 0));
+    CHECK(!line_ring_next_line(&ring, 16, &span));
+    CHECK(line_ring_next_partial(&ring, &span) && span_is(&span, "prompt> "));
+    CHECK((span.part == 1) && span.more);
+    CHECK(!line_ring_next_partial(&ring, &span) && (line_ring_pending(&ring) == 0));
+    line_ring_release(&ring, &span);
+
+    /* the answer ends the line as its last part */
+    put_str(&ring, "yes\r\nx\n");
+    CHECK(line_ring_next_line(&ring, 16, &span) && span_is(&span, "yes") && (span.part == 2) && !span.more);
+    CHECK(line_ring_next_line(&ring, 16, &span) && span_is(&span, "x") && (span.part == 0));
+    line_ring_release(&ring, &span);
+
+    /* a delimiter right after a partial gives an empty last part, a split continues the numbering */
+    put_str(&ring, "wait");
+    CHECK(line_ring_next_partial(&ring, &span) && span_is(&span, "wait") && (span.part == 1));
+    put_str(&ring, "\n");
+    CHECK(line_ring_next_line(&ring, 16, &span) && span_is(&span, "") && (span.part == 2) && !span.more);
+    line_ring_release(&ring, &span);
+    put_str(&ring, "abc");
+    CHECK(line_ring_next_partial(&ring, &span) && (span.part == 1));
+    line_ring_release(&ring, &span);
+    put_str(&ring, "0123456789abcdefgh\n");
+    CHECK(line_ring_next_line(&ring, 16, &span) && (line_span_len(&span) == 16) && (span.part == 2) && span.more);
+    line_ring_release(&ring, &span);
+    CHECK(line_ring_next_line(&ring, 16, &span) && span_is(&span, "gh") && (span.part == 3) && !span.more);
+}
+
+
+/* raw chunks: full ones as soon as they are there, the rest on a flush */
+static void test_chunks(void)
+{
+    line_ring_t ring;
+    char buf[16];
+    line_span_t span;
+    CHECK(line_ring_init(&ring, buf, sizeof(buf)));
+    put_str(&ring, "ab\ncdefghij");
+    CHECK(line_ring_next_chunk(&ring, 4, false, &span) && span_is(&span, "ab\nc"));
+    CHECK(line_ring_next_chunk(&ring, 4, false, &span) && span_is(&span, "defg"));
+    CHECK(!line_ring_next_chunk(&ring, 4, false, &span));
+    CHECK(line_ring_pending(&ring) == 3);
+    line_ring_release(&ring, &span);
+
+    /* across the end of the ring */
+    put_str(&ring, "klmnopqr");
+    CHECK(line_ring_next_chunk(&ring, 3, false, &span) && span_is(&span, "hij"));
+    CHECK(line_ring_next_chunk(&ring, 3, false, &span) && span_is(&span, "klm"));
+    CHECK(line_ring_next_chunk(&ring, 3, false, &span) && span_is(&span, "nop") && (span.len[1] == 1));
+    CHECK(!line_ring_next_chunk(&ring, 3, false, &span));
+    CHECK(line_ring_next_chunk(&ring, 3, true, &span) && span_is(&span, "qr"));
+    CHECK(!line_ring_next_chunk(&ring, 3, true, &span));
+    CHECK(line_ring_pending(&ring) == 0);
+    line_ring_release(&ring, &span);
+    size_t avail;
+    (void) line_ring_write_ptr(&ring, &avail);
+    CHECK(avail > 0);
+}
+
+
+/* deterministic text lines of 20 to 140 bytes */
+static char *bench_input(size_t size)
+{
+    char *input = malloc(size);
+    uint32_t state = 1;
+    size_t pos = 0;
+    while (pos < size)
+    {
+        state = state * 1103515245u + 12345u;
+        const size_t len = 20 + (state >> 16) % 120;
+        for (size_t i = 0; (i < len) && (pos < size); i++)
+        {
+            input[pos] = (char)('a' + (pos % 26));
+            pos += 1;
+        }
+        if (pos < size)
+        {
+            input[pos++] = '\n';
+        }
+    }
+    return input;
+}
+
+
+/**
+ * Frame the input written in blocks of fifo bytes, either handing out the
+ * spans in place or copying each line into a scratch buffer of max_len bytes
+ * like uart_read_bytes() did. Returns the bytes framed per second.
+ */
+static double bench_framing(const char *input, size_t size, bool copy, size_t *lines)
+{
+    static char buf[BENCH_RING_SIZE];
+    static char scratch[BENCH_MAX_LEN];
+    const size_t fifo = 120;
+    line_ring_t ring;
+    line_span_t span;
+    volatile char sink = 0;
+    (void) line_ring_init(&ring, buf, sizeof(buf));
+    *lines = 0;
+
+    const int64_t start = bench_ns();
+    for (size_t pos = 0; pos < BENCH_BYTES; pos += fifo)
+    {
+        const size_t offset = pos % size;
+        put(&ring, input + offset, (size - offset < fifo) ? size - offset : fifo);
+        while (line_ring_next_line(&ring, BENCH_MAX_LEN, &span))
+        {
+            if (copy)
+            {
+                memcpy(scratch, span.seg[0], span.len[0]);
+                memcpy(scratch + span.len[0], span.seg[1], span.len[1]);
+                sink = scratch[0];
+            }
+            else
+            {
+                sink = span.seg[0][0];
+            }
+            *lines += 1;
+            line_ring_release(&ring, &span);
+        }
+    }
+    (void) sink;
+    return BENCH_BYTES / ((bench_ns() - start) / 1e9);
+}
+
+
+static void bench(void)
+{
+    const size_t size = 1 << 20;
+    char *input = bench_input(size);
+    size_t in_place_lines, copy_lines;
+    const double in_place = bench_framing(input, size, false, &in_place_lines);
+    const double copy = bench_framing(input, size, true, &copy_lines);
+    CHECK(in_place_lines == copy_lines);
+    printf("framing in place: %.0f MB/s, %.1f M lines/s\n", in_place / 1e6,
+           in_place_lines / (BENCH_BYTES / in_place) / 1e6);
+    printf("copying each line: %.0f MB/s (%.2fx)\n", copy / 1e6, in_place / copy);
+    free(input);
+}
+
+
+int main(void)
+{
+    test_init();
+    test_lines_wrap();
+    test_release();
+    test_split();
+    test_partial();
+    test_chunks();
+    bench();
+    return CHECK_DONE();
+}
@@ -0,0 +1,273 @@
+/**
+ * lz4_block: blocks decode to the input with a strict decoder of the LZ4 block
+ * format, capacity limits, and the compression ratio and time per KB of
+ * batches of RFC 5424 messages, from printer output or a trace given as the
+ * first argument (one line per line).
+ *
+ * usage: test_lz4_block [TRACE]
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lz4_block.h"
+#include "check.h"
+
+#define BATCH_SIZE 1400                 /* CONFIG_SYSLOG_BATCH_MAX_SIZE */
+#define BENCH_BYTES (16u << 20)
+
+static const char *const sample_trace[] = {
+    "echo:busy: processing",
+    "ok T:%u.0 /210.0 B:60.0 /60.0 @:64 B@:32",
+    "I (%u) motion: G1 X120.500 Y80.250 E0.04210 F3000",
+    "X:120.50 Y:80.25 Z:2.40 E:0.00 Count X:%u Y:6420 Z:960",
+    "W (%u) heater: bed temperature overshoot 0.8C",
+    "// action:notification Layer %u/240",
+    "ok",
+    "E (%u) sdcard: read retry 1 at sector 48213",
+};
+
+
+/**
+ * Decode one block into dst, checking every length against the input and
+ * the output, and the rules for the end of a block. Returns the decoded
+ * size, or -1 if the block is invalid.
+ */
+static long lz4_decompress_block(const uint8_t *src, size_t len, uint8_t *dst, size_t capacity)
+{
+    size_t ip = 0, op = 0;
+    for (;;)
+    {
+        if (ip >= len)
+        {
+            return -1;
+        }
+        const uint8_t token = src[ip++];
+        size_t literal_len = token >> 4;
+        if (literal_len == 15)
+        {
+            uint8_t n;
+            do
+            {
+                if (ip >= len)
+                {
+                    return -1;
+                }
+                n = src[ip++];
+                literal_len += n;
+            } while (n == 255);
+        }
+        if ((literal_len > len - ip) || (literal_len > capacity - op))
+        {
+            return -1;
+        }
+        memcpy(dst + op, src + ip, literal_len);
+        ip += literal_len;
+        op += literal_len;
+        if (ip == len)
+        {
+            /* the last sequence has no match */
+            return ((token & 15) == 0) ? (long)op : -1;
+        }
+
+        if (len - ip < 2)
+        {
+            return -1;
+        }
+        const size_t offset = src[ip] | (src[ip + 1] << 8);
+        ip += 2;
+        size_t match_len = token & 15;
+        if (match_len == 15)
+        {
+            uint8_t n;
+            do
+            {
+                if (ip >= len)
+                {
+                    return -1;
+                }
+                n = src[ip++];
+                match_len += n;
+            } while (n == 255);
+        }
+        match_len += 4;
+        if ((offset == 0) || (offset > op) || (match_len > capacity - op))
+        {
+            return -1;
+        }
+        for (size_t i = 0; i < match_len; i++, op++)
+        {
+            dst[op] = dst[op - offset];     /* may overlap */
+        }
+    }
+}
+
+
+/* compress and decode again, checking the end-of-block rules of the format */
+static size_t round_trip(lz4_state_t *state, const char *src, size_t len)
+{
+    static char compressed[LZ4_MAX_INPUT_SIZE + LZ4_MAX_INPUT_SIZE / 255 + 16];
+    static uint8_t decoded[LZ4_MAX_INPUT_SIZE];
+    const size_t compressed_len = lz4_compress_block(state, src, len, compressed, sizeof(compressed));
+    CHECK(compressed_len > 0);
+    const long decoded_len = lz4_decompress_block((const uint8_t *)compressed, compressed_len,
+                                                  decoded, sizeof(decoded));
+    CHECK(decoded_len == (long)len);
+    CHECK((decoded_len < 0) || (memcmp(decoded, src, len) == 0));
+    return compressed_len;
+}
+
+
+static void test_round_trip(void)
+{
+    static lz4_state_t state;
+    static char input[LZ4_MAX_INPUT_SIZE];
+    uint32_t random = 1;
+
+    CHECK(round_trip(&state, "", 0) == 1);
+    CHECK(round_trip(&state, "short", 5) == 6);
+    memset(input, 'a', sizeof(input));
+    CHECK(round_trip(&state, input, 20) == 10);     /* 1 literal, a match, 5 literals */
+    CHECK(round_trip(&state, input, sizeof(input)) < 300);
+
+    /* mostly repeating, with random bytes mixed in, at many lengths */
+    for (size_t len = 0; len < 3000; len += 7)
+    {
+        for (size_t i = 0; i < len; i++)
+        {
+            random = random * 1103515245u + 12345u;
+            input[i] = ((random >> 16) % 4 == 0) ? (char)(random >> 24) : "abcab\n"[i % 6];
+        }
+        (void) round_trip(&state, input, len);
+    }
+
+    /* incompressible: at most one token and length bytes more */
+    for (size_t i = 0; i < sizeof(input); i++)
+    {
+        random = random * 1103515245u + 12345u;
+        input[i] = (char)(random >> 24);
+    }
+    CHECK(round_trip(&state, input, sizeof(input)) <= sizeof(input) + 1 + sizeof(input) / 255 + 1);
+}
+
+
+static void test_limits(void)
+{
+    static lz4_state_t state;
+    static char input[LZ4_MAX_INPUT_SIZE + 1];
+    static char output[LZ4_MAX_INPUT_SIZE + 1024];
+    memset(input, 'x', sizeof(input));
+    CHECK(lz4_compress_block(&state, input, sizeof(input), output, sizeof(output)) == 0);
+
+    /* a capacity below the input size only accepts blocks which save space */
+    for (size_t i = 0; i < 64; i++)
+    {
+        input[i] = (char)(i * 37);
+    }
+    CHECK(lz4_compress_block(&state, input, 64, output, 63) == 0);
+    CHECK(lz4_compress_block(&state, input, 64, output, 65) == 0);
+    CHECK(lz4_compress_block(&state, input, 64, output, 66) == 66);     /* token, length, 64 literals */
+}
+
+
+/* one line of the trace with its numbers varying, as an RFC 5424 message */
+static size_t format_message(char *dst, size_t size, char *const *trace, size_t trace_len, uint32_t seq)
+{
+    const char *line = trace[seq % trace_len];
+    char text[256];
+    snprintf(text, sizeof(text), line, 100000 + seq * 37 % 9000);
+    return snprintf(dst, size, "<134>1 2024-01-18T22:46:%02u.%06uZ uart-syslog - uart1 - "
+                    "[meta sequenceId=\"%u\"] %s\n", seq / 1000 % 60, seq * 4337 % 1000000, seq, text);
+}
+
+
+static char **load_trace(const char *path, size_t *count)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        perror(path);
+        exit(2);
+    }
+    char **trace = NULL;
+    char line[1024];
+    *count = 0;
+    while (fgets(line, sizeof(line), file))
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        for (char *p = strchr(line, '%'); p; p = strchr(p, '%'))
+        {
+            *p = '#';           /* lines are used as format strings */
+        }
+        trace = realloc(trace, (*count + 1) * sizeof(*trace));
+        trace[(*count)++] = strdup(line);
+    }
+    fclose(file);
+    return trace;
+}
+
+
+/* compress batches of messages and report the ratio and the time per KB */
+static void bench(char *const *trace, size_t trace_len)
+{
+    static lz4_state_t state;
+    static char batch[BATCH_SIZE];
+    static char compressed[BATCH_SIZE];
+    uint64_t input_bytes = 0, output_bytes = 0, batches = 0, kept = 0;
+    int64_t elapsed_ns = 0;
+    uint32_t seq = 0;
+    char message[512];
+
+    while (input_bytes < BENCH_BYTES)
+    {
+        size_t batch_len = 0;
+        for (;;)
+        {
+            const size_t len = format_message(message, sizeof(message), trace, trace_len, seq);
+            if ((batch_len > 0) && (batch_len + len > sizeof(batch)))
+            {
+                break;
+            }
+            memcpy(batch + batch_len, message, len);
+            batch_len += len;
+            seq += 1;
+        }
+        /* like the client: only blocks which save space are sent */
+        const int64_t start = bench_ns();
+        const size_t len = lz4_compress_block(&state, batch, batch_len, compressed, batch_len - 6);
+        elapsed_ns += bench_ns() - start;
+        input_bytes += batch_len;
+        output_bytes += (len > 0) ? len + 6 : batch_len;
+        kept += (len == 0);
+        batches += 1;
+    }
+    printf("%llu batches of %llu bytes on average: ratio %.2f, %.0f ns per KB, %llu not compressed\n",
+           (unsigned long long)batches, (unsigned long long)(input_bytes / batches),
+           (double)input_bytes / output_bytes, elapsed_ns * 1024.0 / input_bytes, (unsigned long long)kept);
+}
+
+
+int main(int argc, char **argv)
+{
+    test_round_trip();
+    test_limits();
+    if (argc > 1)
+    {
+        size_t trace_len;
+        char **trace = load_trace(argv[1], &trace_len);
+        if (trace_len > 0)
+        {
+            bench(trace, trace_len);
+        }
+        for (size_t i = 0; i < trace_len; i++)
+        {
+            free(trace[i]);
+        }
+        free(trace);
+    }
+    else
+    {
+        bench((char *const *)sample_trace, sizeof(sample_trace) / sizeof(sample_trace[0]));
+    }
+    return CHECK_DONE();
+}
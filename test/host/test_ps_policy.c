@@ -0,0 +1,148 @@
+/**
+ * ps_policy: the thresholds entering performance mode, the hold time before
+ * saving power again, no flapping with traffic around either threshold, and
+ * counters wrapping around.
+ */
+
+#include <stdint.h>
+
+#include "sdkconfig.h"
+#include "ps_policy.h"
+#include "check.h"
+
+#define STEP_MS 250                     /* the update period of the sender */
+
+static const ps_policy_config_t config = {
+    .high_rate = CONFIG_SYSLOG_WIFI_PS_HIGH_RATE,
+    .low_rate = CONFIG_SYSLOG_WIFI_PS_LOW_RATE,
+    .high_queued = CONFIG_SYSLOG_WIFI_PS_HIGH_QUEUED,
+    .hold_ms = CONFIG_SYSLOG_WIFI_PS_HOLD_MS,
+};
+
+/* the running totals fed to the policy */
+static uint32_t now_ms;
+static uint32_t sent;
+
+
+static void start(ps_policy_t *policy, uint32_t start_ms, uint32_t start_sent)
+{
+    now_ms = start_ms;
+    sent = start_sent;
+    ps_policy_init(policy, &config, now_ms, sent);
+}
+
+
+/* one period at the given rate in bytes/s, returns true if the mode changed */
+static bool step(ps_policy_t *policy, uint32_t rate, uint32_t queued)
+{
+    now_ms += STEP_MS;
+    sent += rate * STEP_MS / 1000;
+    return ps_policy_update(policy, now_ms, sent, queued);
+}
+
+
+/* quiet periods until the mode changes, 0 if it did not within twice hold_ms */
+static uint32_t quiet_until_change(ps_policy_t *policy, uint32_t rate)
+{
+    for (uint32_t ms = STEP_MS; ms <= 2 * config.hold_ms; ms += STEP_MS)
+    {
+        if (step(policy, rate, 0))
+        {
+            return ms;
+        }
+    }
+    return 0;
+}
+
+
+static void test_enter(void)
+{
+    ps_policy_t policy;
+    start(&policy, 0, 0);
+    CHECK(policy.mode == PS_POLICY_SAVE);
+    CHECK(!step(&policy, config.high_rate - 4, 0));
+    CHECK(!step(&policy, 0, config.high_queued - 1));
+    CHECK(step(&policy, config.high_rate, 0) && (policy.mode == PS_POLICY_PERFORMANCE));
+
+    start(&policy, 0, 0);
+    CHECK(step(&policy, 0, config.high_queued) && (policy.mode == PS_POLICY_PERFORMANCE));
+    CHECK((policy.transitions[PS_POLICY_PERFORMANCE] == 1) && (policy.transitions[PS_POLICY_SAVE] == 0));
+
+    /* no time passed: nothing to measure */
+    CHECK(!ps_policy_update(&policy, now_ms, sent + 100000, 0));
+}
+
+
+static void test_leave(void)
+{
+    ps_policy_t policy;
+    start(&policy, 0, 0);
+    CHECK(step(&policy, config.high_rate, 0));
+
+    /* quiet from the end of the first low period on, power is saved once that lasted hold_ms */
+    CHECK(quiet_until_change(&policy, config.low_rate - 4) == config.hold_ms + STEP_MS);
+    CHECK(policy.mode == PS_POLICY_SAVE);
+
+    /* a backlog of half the threshold, or a rate in between, is not quiet */
+    CHECK(step(&policy, config.high_rate, 0));
+    for (uint32_t ms = 0; ms < 4 * config.hold_ms; ms += 2 * STEP_MS)
+    {
+        CHECK(!step(&policy, 0, config.high_queued / 2));
+        CHECK(!step(&policy, config.low_rate, 0));
+    }
+    CHECK(policy.mode == PS_POLICY_PERFORMANCE);
+}
+
+
+/* traffic alternating around a threshold switches at most once */
+static void test_no_flapping(void)
+{
+    ps_policy_t policy;
+    uint32_t changes = 0;
+    start(&policy, 0, 0);
+    for (uint32_t ms = 0; ms < 60000; ms += 2 * STEP_MS)
+    {
+        changes += step(&policy, config.high_rate + 100, 0);
+        changes += step(&policy, config.high_rate - 100, 0);
+    }
+    CHECK((changes == 1) && (policy.mode == PS_POLICY_PERFORMANCE));
+
+    for (uint32_t ms = 0; ms < 60000; ms += 2 * STEP_MS)
+    {
+        changes += step(&policy, config.low_rate + 100, 0);
+        changes += step(&policy, config.low_rate - 100, 0);
+    }
+    CHECK((changes == 1) && (policy.mode == PS_POLICY_PERFORMANCE));
+
+    /* in power save, the band between the thresholds keeps it there */
+    changes += (quiet_until_change(&policy, 0) > 0);
+    for (uint32_t ms = 0; ms < 60000; ms += 2 * STEP_MS)
+    {
+        changes += step(&policy, config.high_rate - 100, config.high_queued - 1);
+        changes += step(&policy, config.low_rate - 100, 0);
+    }
+    CHECK((changes == 2) && (policy.mode == PS_POLICY_SAVE));
+    CHECK((policy.transitions[PS_POLICY_PERFORMANCE] == 1) && (policy.transitions[PS_POLICY_SAVE] == 1));
+}
+
+
+/* the millisecond clock and the byte counter are uint32_t and wrap around */
+static void test_wrap(void)
+{
+    ps_policy_t policy;
+    start(&policy, UINT32_MAX - STEP_MS / 2, UINT32_MAX - 100);
+    CHECK(!step(&policy, config.high_rate - 4, 0));
+    CHECK(step(&policy, config.high_rate, 0));
+    CHECK(quiet_until_change(&policy, 0) == config.hold_ms + STEP_MS);
+    CHECK(policy.mode == PS_POLICY_SAVE);
+}
+
+
+int main(void)
+{
+    test_enter();
+    test_leave();
+    test_no_flapping();
+    test_wrap();
+    return CHECK_DONE();
+}
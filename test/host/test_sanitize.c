@@ -0,0 +1,201 @@
+/**
+ * sanitize: escape sequences, control characters and invalid UTF-8 in lines
+ * wrapped at every position, characters cut in half carried to the next
+ * part, and the time per byte compared with scanning one byte at a time.
+ */
+
+#include <string.h>
+
+#include "sanitize.h"
+#include "check.h"
+
+/* the same sanitizer without the word-at-a-time scan of printable ASCII */
+#define SANITIZE_BYTEWISE
+#define sanitize_span sanitize_span_bytewise
+#define sanitize_utf8_tail sanitize_utf8_tail_bytewise
+#define sanitize_utf8_prefix sanitize_utf8_prefix_bytewise
+#include "sanitize.c"
+#undef sanitize_span
+#undef sanitize_utf8_tail
+#undef sanitize_utf8_prefix
+
+#define BENCH_SIZE (1u << 16)
+#define BENCH_ROUNDS 200
+
+
+/* write all of text into the ring, which must have room for it */
+static void put(line_ring_t *ring, const char *text, size_t len)
+{
+    while (len > 0)
+    {
+        size_t avail;
+        char *dst = line_ring_write_ptr(ring, &avail);
+        const size_t n = (avail < len) ? avail : len;
+        memcpy(dst, text, n);
+        line_ring_commit(ring, n);
+        text += n;
+        len -= n;
+    }
+}
+
+
+/* true if the span holds exactly text */
+static bool span_is(const line_span_t *span, const char *text)
+{
+    const size_t len = strlen(text);
+    return (line_span_len(span) == len) &&
+           (memcmp(span->seg[0], text, span->len[0]) == 0) &&
+           (memcmp(span->seg[1], text + span->len[0], span->len[1]) == 0);
+}
+
+
+/* sanitize input wrapped after every byte, checking the result and the counts */
+static void check_clean(const char *input, size_t len, const char *expected, uint32_t stripped, uint32_t repaired)
+{
+    for (size_t split = 0; split <= len; split++)
+    {
+        char first[256], second[256];
+        memcpy(first, input, split);
+        memcpy(second, input + split, len - split);
+        line_span_t span = { .seg = { first, second }, .len = { split, len - split } };
+        sanitize_result_t result = { 0 };
+        sanitize_span(&span, &result);
+        CHECK(span_is(&span, expected));
+        CHECK((result.stripped == stripped) && (result.repaired == repaired));
+    }
+}
+
+
+static void test_clean(void)
+{
+    check_clean("hello world, plain text!", 24, "hello world, plain text!", 0, 0);
+    check_clean("\033[0;32mI (123) wifi: ok\033[0m", 27, "I (123) wifi: ok", 11, 0);
+    check_clean("a\tb\rc\x01" "d\x7f", 8, "a\tbcd", 3, 0);
+    check_clean("a\0b", 3, "ab", 1, 0);
+    check_clean("\033(Bxy\033[", 7, "xy", 5, 0);     /* a charset selection, a CSI cut off */
+    /* runs of plain words moved back over the removed bytes, across the end of the ring */
+    const char *const colored = "\033[1;31mE (123470) sdcard: read retry 1 at sector 48213\033[0m\r";
+    check_clean(colored, strlen(colored), "E (123470) sdcard: read retry 1 at sector 48213", 12, 0);
+
+    /* valid UTF-8 up to 4 bytes is kept, invalid bytes are replaced one by one */
+    const char *const utf8 = "gr\xc3\xbc\xc3\x9f dich \xe2\x82\xac \xf0\x9f\x98\x80!";
+    check_clean(utf8, strlen(utf8), utf8, 0, 0);
+    const char *const invalid = "bad \xff\xc3 x \xed\xa0\x80 \xc0\xaf \xf4\x90\x80\x80 end";
+    check_clean(invalid, strlen(invalid), "bad ?? x ??? ?? ???? end", 0, 11);
+}
+
+
+static void test_utf8_tail(void)
+{
+    CHECK(sanitize_utf8_prefix("abc", 3) == 3);
+    CHECK(sanitize_utf8_prefix("ab\xc3", 3) == 2);
+    CHECK(sanitize_utf8_prefix("ab\xe2\x82", 4) == 2);
+    CHECK(sanitize_utf8_prefix("ab\xe2\x82\xac", 5) == 5);
+    CHECK(sanitize_utf8_prefix("\xf0\x9f\x98", 3) == 0);
+    CHECK(sanitize_utf8_prefix("a\x82", 2) == 2);       /* a stray continuation byte is not carried */
+
+    const line_span_t span = { .seg = { "ab\xf0", "\x9f\x98" }, .len = { 3, 2 } };
+    CHECK(sanitize_utf8_tail(&span) == 3);
+}
+
+
+/* a character cut by the maximum line length, or by an idle flush, goes to the next part whole */
+static void test_carry(void)
+{
+    line_ring_t ring;
+    char buf[64];
+    line_span_t span;
+    CHECK(line_ring_init(&ring, buf, sizeof(buf)));
+
+    /* several rounds, so that the parts wrap around the end of the ring */
+    for (int round = 0; round < 5; round++)
+    {
+        put(&ring, "abcdefg\xe2\x82\xac" "xy\n", 13);
+        CHECK(line_ring_next_line(&ring, 8, &span) && span.more && (span.part == 1));
+        CHECK(line_ring_carry(&ring, &span, sanitize_utf8_tail(&span)));
+        CHECK(span_is(&span, "abcdefg") && (span.part == 1));
+        line_ring_release(&ring, &span);
+        CHECK(line_ring_next_line(&ring, 8, &span) && span_is(&span, "\xe2\x82\xacxy"));
+        CHECK((span.part == 2) && !span.more);
+        line_ring_release(&ring, &span);
+
+        put(&ring, "$ \xc3", 3);
+        CHECK(!line_ring_next_line(&ring, 8, &span) && line_ring_next_partial(&ring, &span));
+        CHECK(line_ring_carry(&ring, &span, sanitize_utf8_tail(&span)));
+        CHECK(span_is(&span, "$ ") && (span.part == 1));
+        line_ring_release(&ring, &span);
+
+        /* nothing but the cut character: not framed, it waits for the rest */
+        CHECK(!line_ring_next_line(&ring, 8, &span) && line_ring_next_partial(&ring, &span));
+        CHECK(!line_ring_carry(&ring, &span, sanitize_utf8_tail(&span)));
+        CHECK(line_ring_pending(&ring) == 1);
+        put(&ring, "\xbcz\n", 3);
+        CHECK(line_ring_next_line(&ring, 8, &span) && span_is(&span, "\xc3\xbcz"));
+        CHECK((span.part == 2) && !span.more);
+        line_ring_release(&ring, &span);
+    }
+}
+
+
+/* printer output: mostly plain ASCII, a colored line now and then */
+static void bench_input(char *input)
+{
+    static const char *const lines[] = {
+        "ok T:210.0 /210.0 B:60.0 /60.0 @:64 B@:32\r\n",
+        "\033[0;32mI (123456) motion: G1 X120.500 Y80.250 E0.04210 F3000\033[0m\n",
+        "X:120.50 Y:80.25 Z:2.40 E:0.00 Count X:9640 Y:6420 Z:960\n",
+        "echo:busy: processing\n",
+    };
+    size_t pos = 0;
+    for (size_t i = 0; pos < BENCH_SIZE; i++)
+    {
+        const char *line = lines[i % 4];
+        const size_t n = strlen(line);
+        memcpy(input + pos, line, (n < BENCH_SIZE - pos) ? n : BENCH_SIZE - pos);
+        pos += n;
+    }
+}
+
+
+/* the best of several rounds of sanitize, in ns per byte */
+static double bench_ns_per_byte(const char *input, void (*sanitize)(line_span_t *, sanitize_result_t *),
+                                size_t *len)
+{
+    static char work[BENCH_SIZE];
+    int64_t best = INT64_MAX;
+    for (int round = 0; round < BENCH_ROUNDS; round++)
+    {
+        memcpy(work, input, sizeof(work));
+        line_span_t span = { .seg = { work, NULL }, .len = { sizeof(work), 0 } };
+        sanitize_result_t result = { 0 };
+        const int64_t start = bench_ns();
+        sanitize(&span, &result);
+        const int64_t elapsed = bench_ns() - start;
+        best = (elapsed < best) ? elapsed : best;
+        *len = line_span_len(&span);
+    }
+    return (double)best / BENCH_SIZE;
+}
+
+
+static void bench(void)
+{
+    static char input[BENCH_SIZE];
+    size_t words_len, bytewise_len;
+    bench_input(input);
+    const double words = bench_ns_per_byte(input, sanitize_span, &words_len);
+    const double bytewise = bench_ns_per_byte(input, sanitize_span_bytewise, &bytewise_len);
+    CHECK(words_len == bytewise_len);
+    printf("sanitize a word at a time: %.2f ns per byte, a byte at a time: %.2f ns per byte (%.1fx)\n",
+           words, bytewise, bytewise / words);
+}
+
+
+int main(void)
+{
+    test_clean();
+    test_utf8_tail();
+    test_carry();
+    bench();
+    return CHECK_DONE();
+}
@@ -0,0 +1,141 @@
+/**
+ * severity: the default patterns, invalid entries, color sequences and
+ * prefixes wrapping around the end of the ring, and the lines/s the capture
+ * path frames with and without classification.
+ */
+
+#include <string.h>
+
+#include "sdkconfig.h"
+#include "host.h"
+#include "severity.h"
+#include "check.h"
+
+#define BENCH_LINES 4000000u
+
+static const char *const bench_lines[] = {
+    "echo:busy: processing",
+    "ok T:210.0 /210.0 B:60.0 /60.0 @:64 B@:32",
+    "I (123456) motion: G1 X120.500 Y80.250 E0.04210 F3000",
+    "X:120.50 Y:80.25 Z:2.40 E:0.00 Count X:9640 Y:6420 Z:960",
+    "W (123460) heater: bed temperature overshoot 0.8C",
+    "// action:notification Layer 12/240",
+    "ok",
+    "E (123470) sdcard: read retry 1 at sector 48213",
+};
+
+
+/* write text into the ring, which must have room for it */
+static void put(line_ring_t *ring, const char *text, size_t len)
+{
+    while (len > 0)
+    {
+        size_t avail;
+        char *dst = line_ring_write_ptr(ring, &avail);
+        const size_t n = (avail < len) ? avail : len;
+        memcpy(dst, text, n);
+        line_ring_commit(ring, n);
+        text += n;
+        len -= n;
+    }
+}
+
+
+static uint8_t classify(const char *text)
+{
+    const line_span_t span = { .seg = { text, NULL }, .len = { strlen(text), 0 } };
+    return severity_classify(&span, 6);
+}
+
+
+static void test_default_patterns(void)
+{
+    severity_init(CONFIG_SYSLOG_SEVERITY_PATTERNS);
+    CHECK(classify("E (1234) wifi: disconnected") == 3);
+    CHECK(classify("W (1) x") == 4);
+    CHECK(classify("D (1) x") == 7);
+    CHECK(classify("Error:Heating failed") == 3);
+    CHECK(classify("!! emergency stop") == 2);
+    CHECK(classify("echo:busy: processing") == 6);
+    CHECK(classify("<3>kernel: oops") == 3);
+    CHECK(classify("<0>panic") == 0);
+    CHECK(classify("\033[0;33mW (1) colored") == 4);
+    CHECK(classify("hello") == 6);
+    CHECK(classify("E") == 6);          /* shorter than the pattern */
+    CHECK(classify("") == 6);
+    CHECK(classify("Errors: 0") == 6);
+}
+
+
+static void test_pattern_list(void)
+{
+    host_log_level = ESP_LOG_ERROR;     /* the invalid entries are warned about */
+    severity_init("bad,x=9,=3,toolongprefix_0123456789=1,a=b=1,ok=5");
+    host_log_level = ESP_LOG_WARN;
+    CHECK(classify("x") == 6);
+    CHECK(classify("a=b rest") == 1);   /* the last '=' separates the severity */
+    CHECK(classify("ok") == 5);
+    severity_init("");
+    CHECK(classify("E (1) x") == 6);
+}
+
+
+static void test_wrapped(void)
+{
+    severity_init(CONFIG_SYSLOG_SEVERITY_PATTERNS);
+    line_span_t span = { .seg = { "E (1", "23) tag: x" }, .len = { 4, 10 } };
+    CHECK(severity_classify(&span, 6) == 3);
+    span = (line_span_t) { .seg = { "E", " (1" }, .len = { 1, 3 } };
+    CHECK(severity_classify(&span, 6) == 3);
+    span = (line_span_t) { .seg = { "\033[0;3", "1mE (1) x" }, .len = { 5, 9 } };
+    CHECK(severity_classify(&span, 6) == 3);
+}
+
+
+/* frame the lines from a ring like the capture task, with or without classifying them */
+static double bench_lines_per_s(bool classify_lines, uint32_t *histogram)
+{
+    static char buf[4096];
+    line_ring_t ring;
+    line_span_t span;
+    (void) line_ring_init(&ring, buf, sizeof(buf));
+    const size_t count = sizeof(bench_lines) / sizeof(bench_lines[0]);
+
+    const int64_t start = bench_ns();
+    for (uint32_t i = 0; i < BENCH_LINES; i++)
+    {
+        const char *line = bench_lines[i % count];
+        put(&ring, line, strlen(line));
+        put(&ring, "\n", 1);
+        while (line_ring_next_line(&ring, CONFIG_SYSLOG_MAX_LINE_LEN, &span))
+        {
+            histogram[classify_lines ? severity_classify(&span, 6) : 6] += 1;
+            line_ring_release(&ring, &span);
+        }
+    }
+    return BENCH_LINES / ((bench_ns() - start) / 1e9);
+}
+
+
+static void bench(void)
+{
+    uint32_t on[SEVERITY_COUNT] = { 0 };
+    uint32_t off[SEVERITY_COUNT] = { 0 };
+    severity_init(CONFIG_SYSLOG_SEVERITY_PATTERNS);
+    const double with = bench_lines_per_s(true, on);
+    const double without = bench_lines_per_s(false, off);
+    CHECK(off[6] == BENCH_LINES);
+    CHECK((on[3] == BENCH_LINES / 8) && (on[4] == BENCH_LINES / 8) && (on[6] == BENCH_LINES * 6 / 8));
+    printf("framing with classification: %.1f M lines/s, without: %.1f M lines/s (%.1f ns per line)\n",
+           with / 1e6, without / 1e6, (1e9 / with) - (1e9 / without));
+}
+
+
+int main(void)
+{
+    test_default_patterns();
+    test_pattern_list();
+    test_wrapped();
+    bench();
+    return CHECK_DONE();
+}
@@ -0,0 +1,178 @@
+/**
+ * spool: lines come back in order with their metadata, the oldest are
+ * evicted and counted when full, RAM overflows to the flash tier, which is
+ * found again after a reboot, and a failing flash falls back to RAM only.
+ */
+
+#include <string.h>
+
+#include "host.h"
+#include "spool.h"
+#include "check.h"
+
+#define FLASH_SECTORS 8
+
+static uint32_t next_put = 0;       /* number of the next line spooled */
+static uint32_t next_taken = 0;     /* lowest number expected next */
+
+
+static size_t line_text(char *dst, uint32_t n)
+{
+    static const char padding[] = "................................................................";
+    return snprintf(dst, 128, "line %u %.*s", (unsigned)n, (int)(n % 64), padding);
+}
+
+
+/* spool the next numbered line, alternating between two sources */
+static void put_line(void)
+{
+    char text[128];
+    const size_t len = line_text(text, next_put);
+    const line_record_t record = {
+        .span = { .seg = { text, NULL }, .len = { len, 0 } },
+        .timestamp_us = 1000 + next_put,
+        .seq = next_put,
+        .severity = next_put % 8,
+    };
+    spool_put(next_put % 2, &record);
+    next_put += 1;
+}
+
+
+/* take all spooled lines, checking their order and contents, returns their number */
+static uint32_t take_all(void)
+{
+    uint32_t count = 0;
+    uint8_t source;
+    line_record_t record;
+    while (spool_peek(&source, &record))
+    {
+        char expected[128], text[2048];
+        const size_t len = line_text(expected, record.seq);
+        memcpy(text, record.span.seg[0], record.span.len[0]);
+        if (record.span.len[1] > 0)
+        {
+            memcpy(text + record.span.len[0], record.span.seg[1], record.span.len[1]);
+        }
+        CHECK(record.seq >= next_taken);
+        CHECK((source == record.seq % 2) && (record.severity == record.seq % 8));
+        CHECK(record.timestamp_us == 1000 + record.seq);
+        CHECK((line_span_len(&record.span) == len) && (memcmp(text, expected, len) == 0));
+        next_taken = record.seq + 1;
+        spool_pop();
+        count += 1;
+    }
+    CHECK(spool_empty());
+    return count;
+}
+
+
+static uint32_t take_evicted(void)
+{
+    return spool_take_evicted(0) + spool_take_evicted(1);
+}
+
+
+static void test_ram(void)
+{
+    spool_stats_t stats;
+    host_log_level = ESP_LOG_ERROR;     /* there is no flash partition */
+    spool_init();
+    host_log_level = ESP_LOG_WARN;
+
+    /* wrapped spans are stored as one */
+    const line_record_t wrapped = { .span = { .seg = { "line 7", " ......." }, .len = { 6, 8 } }, .seq = 7,
+                                    .timestamp_us = 1007, .severity = 7 };
+    spool_put(1, &wrapped);
+    next_taken = 7;
+    CHECK(!spool_empty() && (take_all() == 1));
+
+    /* over-long lines are truncated */
+    static char long_line[SPOOL_MAX_LINE_LEN + 100];
+    memset(long_line, 'x', sizeof(long_line));
+    const line_record_t truncated = { .span = { .seg = { long_line, NULL }, .len = { sizeof(long_line), 0 } } };
+    spool_put(0, &truncated);
+    uint8_t source;
+    line_record_t record;
+    CHECK(spool_peek(&source, &record) && (line_span_len(&record.span) == SPOOL_MAX_LINE_LEN));
+    spool_pop();
+    spool_get_stats(&stats);
+    CHECK(stats.truncated == 1);
+
+    /* when full, the oldest make room */
+    next_put = next_taken = 0;
+    for (int i = 0; i < 2000; i++)
+    {
+        put_line();
+    }
+    spool_get_stats(&stats);
+    CHECK((stats.ram_bytes <= CONFIG_SYSLOG_SPOOL_RAM_SIZE) && (stats.flash_lines == 0));
+    const uint32_t evicted = take_evicted();
+    CHECK((evicted > 0) && (stats.evicted == evicted));
+    CHECK(take_all() + evicted == next_put);
+    CHECK(take_evicted() == 0);
+}
+
+
+static void test_flash(void)
+{
+    spool_stats_t stats;
+    host_flash_set_size(FLASH_SECTORS * 4096);
+    spool_init();
+
+    /* more than RAM and flash together: the oldest are evicted from flash */
+    const uint32_t start = next_put;
+    for (int i = 0; i < 3000; i++)
+    {
+        put_line();
+    }
+    spool_get_stats(&stats);
+    CHECK(stats.flash_lines > 0);
+    const uint32_t evicted = take_evicted();
+    CHECK(evicted > 0);
+
+    /* the lines in flash are found again, as after a reboot */
+    const uint32_t flash_lines = stats.flash_lines;
+    spool_init();
+    spool_get_stats(&stats);
+    CHECK(stats.flash_lines == flash_lines);
+    CHECK(take_all() + evicted == next_put - start);
+}
+
+
+static void test_flash_failure(void)
+{
+    spool_stats_t stats;
+    spool_get_stats(&stats);
+    const uint32_t start = next_put;
+    const uint32_t evicted_before = stats.evicted;
+    host_log_level = ESP_LOG_NONE;      /* the failure is logged as an error */
+    host_flash_fail_after(30);
+    for (int i = 0; i < 1000; i++)
+    {
+        put_line();
+    }
+    host_log_level = ESP_LOG_WARN;
+
+    /* the lines moving to flash and those already there are lost, RAM goes on */
+    spool_get_stats(&stats);
+    CHECK((stats.flash_lines == 0) && (stats.ram_lines > 0));
+    CHECK(take_evicted() > 0);
+    CHECK(take_all() + (stats.evicted - evicted_before) == next_put - start);
+    for (int i = 0; i < 10; i++)
+    {
+        put_line();
+    }
+    CHECK(take_all() == 10);
+    host_flash_fail_after(-1);
+}
+
+
+int main(void)
+{
+    host_flash_set_size(0);
+    test_ram();
+    test_flash();
+    test_flash_failure();
+    return CHECK_DONE();
+}
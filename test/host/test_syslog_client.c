@@ -0,0 +1,179 @@
+/**
+ * syslog_client: a header gathered with a wrapped span, the timestamp and
+ * structured data of a record spliced into the header, and the bytes copied
+ * and time per line compared with building each message in one buffer, the
+ * way the header used to be baked in front of the line.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lwip/sockets.h"
+#include "syslog_client.h"
+#include "timestamp.h"
+#include "check.h"
+
+#define BENCH_LINES 200000u
+#define SEND_BUF_SIZE 2048
+
+static int receiver = -1;
+
+
+static void receiver_open(void)
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t addr_len = sizeof(addr);
+    const struct timeval timeout = { .tv_sec = 2 };
+    receiver = socket(AF_INET, SOCK_DGRAM, 0);
+    CHECK(bind(receiver, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    CHECK(getsockname(receiver, (struct sockaddr *)&addr, &addr_len) == 0);
+    CHECK(setsockopt(receiver, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == 0);
+    host_syslog_port = ntohs(addr.sin_port);
+}
+
+
+/* the next datagram as a string, empty if none came */
+static const char *receive(void)
+{
+    static char buf[SEND_BUF_SIZE];
+    const ssize_t len = recv(receiver, buf, sizeof(buf) - 1, 0);
+    buf[(len > 0) ? len : 0] = '\0';
+    return buf;
+}
+
+
+static bool ends_with(const char *str, const char *suffix)
+{
+    const size_t len = strlen(str), suffix_len = strlen(suffix);
+    return (len >= suffix_len) && (memcmp(str + len - suffix_len, suffix, suffix_len) == 0);
+}
+
+
+static void test_with_header(void)
+{
+    const line_span_t span = { .seg = { "W (1234) he", "ater: overshoot" }, .len = { 11, 15 } };
+    CHECK(syslog_client_send_with_header("<134>1 ", 7, &span));
+    CHECK(strcmp(receive(), "<134>1 W (1234) heater: overshoot") == 0);
+
+    const line_span_t line = { .seg = { "no header", NULL }, .len = { 9, 0 } };
+    CHECK(syslog_client_send_with_header(NULL, 0, &line));
+    CHECK(strcmp(receive(), "no header") == 0);
+}
+
+
+/* copy n bytes to dst, counting them */
+static char *copy(char *dst, const void *src, size_t n, uint64_t *copied)
+{
+    memcpy(dst, src, n);
+    *copied += n;
+    return dst + n;
+}
+
+
+/**
+ * Build the message of a record in one buffer and send that: the header
+ * around the timestamp and the structured data (both formatted in place) is
+ * copied for each line, and the line after it.
+ */
+static bool send_contiguous(const char *header, size_t header_len, const line_record_t *record, uint64_t *copied)
+{
+    static timestamp_cache_t cache;
+    static char buf[SEND_BUF_SIZE];
+    const char *ts_field = strchr(header, ' ') + 1;
+    const char *sd_field = strrchr(header, '-');     /* the last field before the BOM */
+
+    char *p = copy(buf, header, ts_field - header, copied);
+    p += timestamp_format(&cache, record->timestamp_us, p);
+    p = copy(p, ts_field + 1, sd_field - (ts_field + 1), copied);
+    p += syslog_client_build_sd(p, record, NULL);
+    p = copy(p, sd_field + 1, header + header_len - (sd_field + 1), copied);
+    p = copy(p, record->span.seg[0], record->span.len[0], copied);
+    p = copy(p, record->span.seg[1], record->span.len[1], copied);
+    const line_span_t span = { .seg = { buf, NULL }, .len = { p - buf, 0 } };
+    return syslog_client_send_raw(&span);
+}
+
+
+static void test_record(void)
+{
+    char *header = build_syslog_client_header(SYSLOG_INFO, "app", "uart1");
+    char sd[SYSLOG_SD_MAX_LEN];
+    line_record_t record = {
+        .span = { .seg = { "wrapped ", "line" }, .len = { 8, 4 } },
+        .seq = 42,
+    };
+    const size_t sd_len = syslog_client_build_sd(sd, &record, NULL);
+
+    /* without a capture time, the placeholder stays */
+    CHECK(syslog_client_send_record(header, strlen(header), sd, sd_len, &record));
+    const char *msg = receive();
+    CHECK(strncmp(msg, "<134>1 - ", 9) == 0);
+    CHECK(strstr(msg, " app uart1 - [meta sequenceId=\"42\"] ") != NULL);
+    CHECK(ends_with(msg, "wrapped line"));
+
+    record.timestamp_us = 1705617972124600LL;
+    CHECK(syslog_client_send_record(header, strlen(header), sd, sd_len, &record));
+    msg = receive();
+    CHECK(strncmp(msg, "<134>1 2024-01-18T22:46:12.124600Z ", 35) == 0);
+    CHECK(strstr(msg, " app uart1 - [meta sequenceId=\"42\"] ") != NULL);
+    CHECK(ends_with(msg, "wrapped line"));
+
+    /* the same message as built in one buffer by the benchmark */
+    char expected[SEND_BUF_SIZE];
+    uint64_t copied = 0;
+    strcpy(expected, msg);
+    CHECK(send_contiguous(header, strlen(header), &record, &copied));
+    CHECK(strcmp(receive(), expected) == 0);
+    free(header);
+}
+
+
+static void bench(void)
+{
+    char *header = build_syslog_client_header(SYSLOG_INFO, "-", "uart1");
+    const size_t header_len = strlen(header);
+    static const char line[] = "I (123456) motion: G1 X120.500 Y80.250 E0.04210 F3000";
+    char sd[SYSLOG_SD_MAX_LEN];
+    uint64_t contiguous_copied = 0;
+    uint32_t failed = 0;
+
+    /* every line wrapped around the end of the ring, with its own time and number */
+    line_record_t record = {
+        .span = { .seg = { line, line + 20 }, .len = { 20, sizeof(line) - 1 - 20 } },
+        .timestamp_us = 1705617972124600LL,
+    };
+    int64_t start = bench_ns();
+    for (uint32_t i = 0; i < BENCH_LINES; i++)
+    {
+        record.seq = i;
+        record.timestamp_us += 37;
+        failed += !send_contiguous(header, header_len, &record, &contiguous_copied);
+    }
+    const double contiguous_ns = (double)(bench_ns() - start) / BENCH_LINES;
+
+    start = bench_ns();
+    for (uint32_t i = 0; i < BENCH_LINES; i++)
+    {
+        record.seq = i;
+        record.timestamp_us += 37;
+        const size_t sd_len = syslog_client_build_sd(sd, &record, NULL);
+        failed += !syslog_client_send_record(header, header_len, sd, sd_len, &record);
+    }
+    const double gathered_ns = (double)(bench_ns() - start) / BENCH_LINES;
+    CHECK(failed == 0);
+    printf("bytes copied per line: contiguous %.0f, gathered 0; time per line: contiguous %.0f ns, gathered %.0f ns\n",
+           (double)contiguous_copied / BENCH_LINES, contiguous_ns, gathered_ns);
+    free(header);
+}
+
+
+int main(void)
+{
+    receiver_open();
+    syslog_client_start(SYSLOG_LOCAL0);
+    CHECK(syslog_client_add_destination(CONFIG_SYSLOG_HOST, CONFIG_SYSLOG_HOST_FALLBACK, CONFIG_SYSLOG_PORT));
+    test_with_header();
+    test_record();
+    bench();
+    return CHECK_DONE();
+}
@@ -0,0 +1,121 @@
+/**
+ * trace: entries collected per core into the histograms of their stages,
+ * overwritten ones counted as lost, saturated values, and tasks recording
+ * into one ring while it is collected, which must never yield an entry
+ * which was not written completely.
+ */
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include "trace.h"
+#include "check.h"
+
+#define RACE_ENTRIES 2000000u
+#define FRAME_VALUE 100                 /* bucket 7 */
+#define DELIVER_VALUE 7000              /* bucket 13 */
+
+typedef struct
+{
+    trace_stage_t stage;
+    uint32_t value;
+    uint32_t count;
+    atomic_bool done;
+} writer_t;
+
+
+static void writer_task(void *arg)
+{
+    writer_t *writer = arg;
+    for (uint32_t i = 0; i < writer->count; i++)
+    {
+        trace_record(writer->stage, writer->value);
+    }
+    atomic_store(&writer->done, true);
+    vTaskDelete(NULL);
+}
+
+
+static void run_writer(writer_t *writer, BaseType_t core)
+{
+    atomic_init(&writer->done, false);
+    CHECK(xTaskCreatePinnedToCore(writer_task, "writer", 4096, writer, 5, NULL, core) == pdPASS);
+}
+
+
+static void wait_writer(writer_t *writer)
+{
+    while (!atomic_load(&writer->done))
+    {
+        vTaskDelay(1);
+    }
+}
+
+
+static void test_collect(void)
+{
+    histogram_t histograms[TRACE_STAGES];
+    uint32_t lost = 0;
+    memset(histograms, 0, sizeof(histograms));
+
+    for (int i = 0; i < 100; i++)
+    {
+        trace_record(TRACE_SEND, 1000);
+    }
+    /* more than the ring of the other core holds */
+    writer_t writer = { .stage = TRACE_HANDOFF, .value = 5, .count = CONFIG_SYSLOG_TRACE_RING_SIZE + 76 };
+    run_writer(&writer, 1);
+    wait_writer(&writer);
+    trace_record(TRACE_READ, UINT32_MAX);       /* on core 0 */
+
+    trace_collect(histograms, &lost);
+    CHECK((histograms[TRACE_SEND].total == 100) && (histograms[TRACE_READ].total == 1));
+    CHECK((histograms[TRACE_HANDOFF].total == CONFIG_SYSLOG_TRACE_RING_SIZE) && (lost == 76));
+    CHECK(histograms[TRACE_READ].count[28] == 1);      /* saturated to 28 bits */
+
+    /* nothing new */
+    lost = 0;
+    trace_collect(histograms, &lost);
+    CHECK((lost == 0) && (histograms[TRACE_SEND].total == 100));
+}
+
+
+/* two tasks on one core record while the ring is collected */
+static void test_race(void)
+{
+    histogram_t histograms[TRACE_STAGES];
+    uint32_t lost = 0;
+    memset(histograms, 0, sizeof(histograms));
+    writer_t frame = { .stage = TRACE_FRAME, .value = FRAME_VALUE, .count = RACE_ENTRIES };
+    writer_t deliver = { .stage = TRACE_DELIVER, .value = DELIVER_VALUE, .count = RACE_ENTRIES };
+    run_writer(&frame, 1);
+    run_writer(&deliver, 1);
+    while (!atomic_load(&frame.done) || !atomic_load(&deliver.done))
+    {
+        trace_collect(histograms, &lost);
+    }
+    trace_collect(histograms, &lost);
+
+    const uint32_t collected = histograms[TRACE_FRAME].total + histograms[TRACE_DELIVER].total;
+    CHECK(collected + lost == 2 * RACE_ENTRIES);
+    CHECK(histograms[TRACE_FRAME].count[7] == histograms[TRACE_FRAME].total);
+    CHECK(histograms[TRACE_DELIVER].count[13] == histograms[TRACE_DELIVER].total);
+    for (int stage = 0; stage < TRACE_STAGES; stage++)
+    {
+        CHECK((stage == TRACE_FRAME) || (stage == TRACE_DELIVER) || (histograms[stage].total == 0));
+    }
+    printf("collected %u of %u entries recorded concurrently, %u lost\n",
+           (unsigned)collected, 2 * RACE_ENTRIES, (unsigned)lost);
+}
+
+
+int main(void)
+{
+    test_collect();
+    test_race();
+    return CHECK_DONE();
+}
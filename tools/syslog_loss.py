@@ -0,0 +1,187 @@
+#!/usr/bin/env python3
+"""
+Loss ratio of the gateway's messages, from the sequence numbers they carry.
+
+Reads RFC 5424 messages as the gateway sends them, from log files (one
+message per line, e.g. written by rsyslog with RSYSLOG_SyslogProtocol23Format)
+or received on a UDP port, and reports per source (host, app name, process
+id):
+
+ - messages received, and the sequence numbers missing in between (lost in
+   transit, or evicted from a full spool on the gateway),
+ - messages arriving after later ones (replayed from the spool), duplicates,
+   and restarts of the gateway,
+ - the drop counters of the uart@32473 element: bytes flushed from the UART
+   driver, FIFO overflows, frame errors, and lines split for being too long.
+
+Repeats suppressed on the gateway are summarized in a message carrying the
+number of the last one, they are not counted as lost. Run it on the messages
+before tools/syslog_relay.py joins the parts of split lines, as the joined
+message only keeps the number of the first part.
+
+usage: syslog_loss.py [--listen PORT] [--check MAX_PERCENT] [FILE ...]
+"""
+
+import argparse
+import re
+import socket
+import sys
+
+from syslog_relay import FRAME_MAGIC, expand, split_batch
+
+# "HOSTNAME APP-NAME PROCID MSGID [meta sequenceId="N"]..."
+SEQUENCE = re.compile(rb'(\S+) (\S+) (\S+) \S+ \[meta sequenceId="(\d+)"\]')
+DROPS = re.compile(rb'\[uart@32473 flushedBytes="(\d+)" fifoOverflows="(\d+)" frameErrors="(\d+)" '
+                   rb'splitLines="(\d+)"\]')
+REPEATED = re.compile(rb'\[last message repeated (\d+) times: ')
+# sent without structured data by the sources whose lines were evicted
+EVICTED = re.compile(rb'(\S+) (\S+) (\S+) \S+ - (?:\xef\xbb\xbf)?\[spool full, (\d+) lines lost\]')
+
+SEQUENCE_MAX = 2**31 - 1        # wraps around to 1
+RESTART_DISTANCE = 100000       # this far behind the highest number is a restart, not a late message
+START_WINDOW = 100              # numbers this low start a run at 1, seen again much later a restart
+MAX_TRACKED_MISSING = 1000000
+
+
+class Source:
+    def __init__(self):
+        self.received = 0
+        self.lost_before = 0        # in the runs before a restart
+        self.expected_before = 0
+        self.late = 0
+        self.duplicates = 0
+        self.repeats = 0            # suppressed on the gateway, summarized
+        self.evicted = 0
+        self.restarts = 0
+        self.drops = (0, 0, 0, 0)
+        self.start_run(None)
+
+    def start_run(self, seq):
+        # a run which started shortly before is counted from 1, its first messages may come late from the spool
+        self.first = 1 if seq is not None and seq <= START_WINDOW else seq
+        self.highest = seq
+        self.missing = set(range(1, seq)) if self.first == 1 else set()
+        self.untracked = 0          # gaps too large to remember each number
+        self.run_repeats = 0
+
+    def lost_in_run(self):
+        return max(len(self.missing) + self.untracked - self.run_repeats, 0)
+
+    def expected_in_run(self):
+        if self.first is None:
+            return 0
+        return (self.highest - self.first) % SEQUENCE_MAX + 1 - self.run_repeats
+
+    @property
+    def lost(self):
+        return self.lost_before + self.lost_in_run()
+
+    @property
+    def expected(self):
+        return self.expected_before + self.expected_in_run()
+
+    def feed(self, seq, repeats):
+        self.received += 1
+        self.repeats += repeats
+        if self.first is None:
+            self.start_run(seq)
+        elif seq in self.missing:
+            self.missing.discard(seq)
+            self.late += 1
+        elif self.behind(seq) < 0:
+            gap = -self.behind(seq) - 1
+            if len(self.missing) + gap <= MAX_TRACKED_MISSING:
+                self.missing.update((self.highest + i) % SEQUENCE_MAX + 1 for i in range(gap))
+            else:
+                self.untracked += gap
+            self.highest = seq
+        elif self.behind(seq) > RESTART_DISTANCE or (seq <= START_WINDOW and self.behind(seq) >= START_WINDOW):
+            self.restarts += 1
+            self.lost_before += self.lost_in_run()
+            self.expected_before += self.expected_in_run()
+            self.start_run(seq)
+        else:
+            self.duplicates += 1
+        self.run_repeats += repeats
+
+    def behind(self, seq):
+        """How far seq is behind the highest number, negative if ahead."""
+        distance = (self.highest - seq) % SEQUENCE_MAX
+        return distance if distance <= SEQUENCE_MAX // 2 else distance - SEQUENCE_MAX
+
+    def loss_percent(self):
+        return 100.0 * self.lost / self.expected if self.expected > 0 else 0.0
+
+
+class LossCounter:
+    def __init__(self):
+        self.sources = {}
+
+    def source(self, host, app, procid):
+        key = b"/".join((host, app, procid)).decode(errors="replace")
+        return self.sources.setdefault(key, Source())
+
+    def feed(self, message):
+        match = SEQUENCE.search(message)
+        if match:
+            source = self.source(*match.group(1, 2, 3))
+            repeated = REPEATED.search(message, match.end())
+            # the summary stands for the suppressed repeats, it has the number of the last one
+            source.feed(int(match.group(4)), int(repeated.group(1)) - 1 if repeated else 0)
+            drops = DROPS.search(message, match.end())
+            if drops:
+                source.drops = tuple(int(n) for n in drops.groups())
+            return
+        match = EVICTED.search(message)
+        if match:
+            self.source(*match.group(1, 2, 3)).evicted += int(match.group(4))
+
+    def report(self, out=sys.stdout):
+        for key, s in sorted(self.sources.items()):
+            out.write(f"{key}: {s.received} received, {s.lost} lost ({s.loss_percent():.3f} %), "
+                      f"{s.evicted} evicted from the spool, {s.late} late, {s.duplicates} duplicates, "
+                      f"{s.repeats} repeats, {s.restarts} restarts\n")
+            out.write(f"{' ' * len(key)}  gateway: {s.drops[0]} bytes flushed, {s.drops[1]} FIFO overflows, "
+                      f"{s.drops[2]} frame errors, {s.drops[3]} lines split\n")
+        out.flush()
+
+
+def listen(counter, port):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(("", port))
+    print(f"listening on UDP port {port}, Ctrl-C for the report", file=sys.stderr)
+    try:
+        while True:
+            data = sock.recv(65536)
+            try:
+                for message in split_batch(expand(data) if data.startswith(FRAME_MAGIC) else data):
+                    counter.feed(message)
+            except (ValueError, IndexError) as e:
+                print(f"dropping datagram: {e}", file=sys.stderr)
+    except KeyboardInterrupt:
+        pass
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("files", nargs="*", help="log files with one RFC 5424 message per line (default: stdin)")
+    parser.add_argument("--listen", type=int, help="receive the messages on this UDP port instead")
+    parser.add_argument("--check", type=float, metavar="MAX_PERCENT",
+                        help="exit with status 1 if the loss of any source exceeds this")
+    args = parser.parse_args()
+
+    counter = LossCounter()
+    if args.listen:
+        listen(counter, args.listen)
+    else:
+        for path in args.files or ["-"]:
+            with (open(path, "rb") if path != "-" else sys.stdin.buffer) as f:
+                for line in f:
+                    counter.feed(line.rstrip(b"\r\n"))
+    counter.report()
+    if args.check is not None and any(s.loss_percent() > args.check for s in counter.sources.values()):
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,200 @@
+#!/usr/bin/env python3
+"""
+Relay for the compressed batch transport (CONFIG_SYSLOG_BATCH_COMPRESSION).
+
+Receives batches from the gateway via UDP and TCP, expands compressed
+frames, splits batches into single RFC 5424 messages, joins the parts of
+split lines (CONFIG_SYSLOG_MAX_LINE_LEN), and forwards each message as one
+UDP datagram to an unmodified syslog daemon.
+
+A compressed frame consists of the bytes 0xff 'Z', the uncompressed and the
+compressed size (16 bits each, little endian) and one raw LZ4 block.
+Uncompressed batches are passed on as they are.
+"""
+
+import argparse
+import re
+import socket
+import socketserver
+import struct
+import threading
+import time
+
+FRAME_MAGIC = b"\xffZ"
+FRAME_HEADER = struct.Struct("<2sHH")
+
+# "<PRI>VERSION TIMESTAMP HOSTNAME APP-NAME PROCID MSGID SD [MSG]"
+MESSAGE = re.compile(rb"(<\d+>\d+ \S+ (\S+) (\S+) (\S+) \S+ )((?:\[[^\]]*\])+|-) ?(.*)", re.DOTALL)
+FRAGMENT = re.compile(rb'\[frag@32473 id="(\d+)" part="(\d+)" more="([01])"\]')
+BOM = b"\xef\xbb\xbf"
+FRAGMENT_TIMEOUT = 10.0
+
+
+def lz4_block_decompress(block, size):
+    out = bytearray()
+    pos = 0
+    while pos < len(block):
+        token = block[pos]
+        pos += 1
+        literal_len = token >> 4
+        if literal_len == 15:
+            while True:
+                n = block[pos]
+                pos += 1
+                literal_len += n
+                if n != 255:
+                    break
+        out += block[pos:pos + literal_len]
+        pos += literal_len
+        if pos >= len(block):
+            break
+        offset = block[pos] | (block[pos + 1] << 8)
+        pos += 2
+        match_len = token & 15
+        if match_len == 15:
+            while True:
+                n = block[pos]
+                pos += 1
+                match_len += n
+                if n != 255:
+                    break
+        match_len += 4
+        if offset == 0 or offset > len(out):
+            raise ValueError("invalid match offset")
+        start = len(out) - offset
+        for i in range(match_len):      # matches may overlap their output
+            out.append(out[start + i])
+    if len(out) != size:
+        raise ValueError("size mismatch")
+    return bytes(out)
+
+
+def split_batch(batch):
+    """Split a batch framed by octet counting or by newlines."""
+    messages = []
+    if batch[:1].isdigit():
+        pos = 0
+        while pos < len(batch):
+            space = batch.index(b" ", pos)
+            length = int(batch[pos:space])
+            messages.append(batch[space + 1:space + 1 + length])
+            pos = space + 1 + length
+    else:
+        messages = [m for m in batch.split(b"\n") if m]
+    return messages
+
+
+def expand(frame):
+    magic, size, block_len = FRAME_HEADER.unpack_from(frame)
+    return lz4_block_decompress(frame[FRAME_HEADER.size:FRAME_HEADER.size + block_len], size)
+
+
+class Reassembler:
+    """Join the parts of split lines, identified by their frag@32473 element."""
+
+    def __init__(self):
+        self.pending = {}
+
+    def feed(self, message):
+        match = MESSAGE.match(message)
+        fragment = FRAGMENT.search(match.group(5)) if match else None
+        if not fragment:
+            return [message]
+        key = match.group(2, 3, 4) + (fragment.group(1),)
+        entry = self.pending.setdefault(key, {"parts": {}, "last": None, "since": time.monotonic()})
+        part = int(fragment.group(2))
+        body = match.group(6)
+        if part > 1 and body.startswith(BOM):
+            body = body[len(BOM):]
+        entry["parts"][part] = body
+        if part == 1:
+            entry["head"] = match.group(1) + (FRAGMENT.sub(b"", match.group(5)) or b"-")
+        if fragment.group(3) == b"0":
+            entry["last"] = part
+        if entry["last"] and len(entry["parts"]) == entry["last"]:
+            del self.pending[key]
+            return [self.join(entry)]
+        return []
+
+    def expire(self):
+        """Return incomplete lines whose parts stopped arriving."""
+        now = time.monotonic()
+        expired = [k for k, e in self.pending.items() if now - e["since"] > FRAGMENT_TIMEOUT]
+        return [self.join(self.pending.pop(k)) for k in expired]
+
+    @staticmethod
+    def join(entry):
+        head = entry.get("head", b"- - - - - - -")
+        return head + b" " + b"".join(entry["parts"][p] for p in sorted(entry["parts"]))
+
+
+class Relay:
+    def __init__(self, forward):
+        self.forward = forward
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.lock = threading.Lock()
+        self.reassembler = Reassembler()
+
+    def send(self, batch):
+        with self.lock:
+            for message in split_batch(batch):
+                for joined in self.reassembler.feed(message) + self.reassembler.expire():
+                    self.sock.sendto(joined, self.forward)
+
+
+class UDPHandler(socketserver.BaseRequestHandler):
+    def handle(self):
+        data = self.request[0]
+        try:
+            self.server.relay.send(expand(data) if data.startswith(FRAME_MAGIC) else data)
+        except (ValueError, IndexError, struct.error) as e:
+            print(f"dropping datagram from {self.client_address[0]}: {e}")
+
+
+class TCPHandler(socketserver.StreamRequestHandler):
+    def read_exactly(self, n):
+        data = self.rfile.read(n)
+        if len(data) != n:
+            raise EOFError
+        return data
+
+    def handle(self):
+        try:
+            while True:
+                first = self.read_exactly(1)
+                if first == FRAME_MAGIC[:1]:
+                    header = first + self.read_exactly(FRAME_HEADER.size - 1)
+                    _, _, block_len = FRAME_HEADER.unpack(header)
+                    self.server.relay.send(expand(header + self.read_exactly(block_len)))
+                else:
+                    # a single octet-counted message
+                    count = first
+                    while not count.endswith(b" "):
+                        count += self.read_exactly(1)
+                    self.server.relay.send(count + self.read_exactly(int(count)))
+        except EOFError:
+            pass
+        except (ValueError, IndexError, struct.error) as e:
+            print(f"closing connection from {self.client_address[0]}: {e}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("--listen", type=int, default=5514, help="UDP and TCP port to listen on")
+    parser.add_argument("--forward", default="127.0.0.1:514", help="host:port of the syslog daemon (UDP)")
+    args = parser.parse_args()
+
+    host, port = args.forward.rsplit(":", 1)
+    relay = Relay((host, int(port)))
+    udp = socketserver.ThreadingUDPServer(("", args.listen), UDPHandler)
+    tcp = socketserver.ThreadingTCPServer(("", args.listen), TCPHandler)
+    for server in (udp, tcp):
+        server.relay = relay
+        server.daemon_threads = True
+        threading.Thread(target=server.serve_forever, daemon=True).start()
+    print(f"relaying port {args.listen} to {args.forward}")
+    threading.Event().wait()
+
+
+if __name__ == "__main__":
+    main()
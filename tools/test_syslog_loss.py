@@ -0,0 +1,107 @@
+#!/usr/bin/env python3
+"""
+Tests of syslog_loss.py: sequence gaps, late and duplicate messages, summaries
+of suppressed repeats, restarts, and the drop counters of the gateway.
+
+Run with "python3 -m unittest test_syslog_loss" in tools/.
+"""
+
+import io
+import subprocess
+import sys
+import unittest
+
+import syslog_loss
+
+BOM = b"\xef\xbb\xbf"
+
+
+def message(seq, text=b"line", procid=b"uart1", sd=b""):
+    return (b'<14>1 2024-01-18T22:46:52.124600+01:00 uart-syslog - %s - [meta sequenceId="%d"]%s %s%s'
+            % (procid, seq, sd, BOM, text))
+
+
+def drops(flushed, overflows, frame_errors, split):
+    return (b'[uart@32473 flushedBytes="%d" fifoOverflows="%d" frameErrors="%d" splitLines="%d"]'
+            % (flushed, overflows, frame_errors, split))
+
+
+def count(messages):
+    counter = syslog_loss.LossCounter()
+    for m in messages:
+        counter.feed(m)
+    return counter
+
+
+class LossTest(unittest.TestCase):
+    def test_no_loss(self):
+        source = count(message(seq) for seq in range(1, 1001)).sources["uart-syslog/-/uart1"]
+        self.assertEqual((source.received, source.lost, source.expected), (1000, 0, 1000))
+        self.assertEqual(source.loss_percent(), 0)
+
+    def test_gaps(self):
+        seqs = [s for s in range(1, 101) if s not in (5, 6, 50)]
+        source = count(message(seq) for seq in seqs).sources["uart-syslog/-/uart1"]
+        self.assertEqual((source.received, source.lost, source.expected), (97, 3, 100))
+        self.assertAlmostEqual(source.loss_percent(), 3.0)
+
+    def test_lost_first_messages(self):
+        source = count(message(seq) for seq in range(4, 11)).sources["uart-syslog/-/uart1"]
+        self.assertEqual((source.lost, source.expected), (3, 10))
+
+    def test_joined_late(self):
+        # spooled 1..3 are replayed after the live 4..6, and 5 arrives twice
+        seqs = [4, 5, 6, 1, 2, 3, 5]
+        source = count(message(seq) for seq in seqs).sources["uart-syslog/-/uart1"]
+        self.assertEqual((source.lost, source.late, source.duplicates, source.restarts), (0, 3, 1, 0))
+
+    def test_repeats(self):
+        # 3 and 4 were suppressed as repeats of 2, the summary carries 4
+        messages = [message(1), message(2), message(4, b"[last message repeated 2 times: line]"), message(5)]
+        source = count(messages).sources["uart-syslog/-/uart1"]
+        self.assertEqual((source.lost, source.repeats, source.expected), (0, 1, 4))
+
+    def test_restart(self):
+        seqs = list(range(1, 501)) + [1, 2, 4]
+        source = count(message(seq) for seq in seqs).sources["uart-syslog/-/uart1"]
+        self.assertEqual((source.restarts, source.lost, source.expected), (1, 1, 504))
+
+    def test_wrap(self):
+        top = syslog_loss.SEQUENCE_MAX
+        source = count(message(seq) for seq in (top - 2, top - 1, top, 2)).sources["uart-syslog/-/uart1"]
+        self.assertEqual((source.restarts, source.lost), (0, 1))
+
+    def test_sources_and_drops(self):
+        messages = [
+            message(1, procid=b"uart1"),
+            message(1, procid=b"uart2"),
+            message(3, procid=b"uart1", sd=drops(120, 1, 0, 2)),
+            b"<12>1 2024-01-18T22:46:53.000000+01:00 uart-syslog - uart2 - - " + BOM +
+            b"[spool full, 7 lines lost]",
+            message(9, procid=b"uart2"),
+        ]
+        counter = count(messages)
+        uart1 = counter.sources["uart-syslog/-/uart1"]
+        uart2 = counter.sources["uart-syslog/-/uart2"]
+        self.assertEqual((uart1.lost, uart1.drops), (1, (120, 1, 0, 2)))
+        self.assertEqual((uart2.lost, uart2.evicted), (7, 7))
+
+    def test_report(self):
+        out = io.StringIO()
+        count(message(seq) for seq in (1, 2, 4)).report(out)
+        self.assertIn("uart-syslog/-/uart1: 3 received, 1 lost (25.000 %)", out.getvalue())
+
+
+class CommandTest(unittest.TestCase):
+    def run_script(self, messages, *args):
+        return subprocess.run([sys.executable, "syslog_loss.py", *args], input=b"\n".join(messages) + b"\n",
+                              capture_output=True)
+
+    def test_check(self):
+        messages = [message(seq) for seq in (1, 2, 4)]
+        self.assertEqual(self.run_script(messages, "--check", "30").returncode, 0)
+        self.assertEqual(self.run_script(messages, "--check", "10").returncode, 1)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+"""
+Tests of syslog_relay.py: octet-counted messages and compressed frames sent
+over TCP in pieces split at every position come out as the same datagrams.
+
+Run with "python3 -m unittest test_syslog_relay" in tools/.
+"""
+
+import socket
+import socketserver
+import threading
+import time
+import unittest
+
+import syslog_relay
+
+MESSAGES = [
+    b'<14>1 2024-01-18T22:46:52.124600+01:00 uart-syslog - uart1 - [meta sequenceId="1"] U-Boot SPL',
+    b'<14>1 2024-01-18T22:46:52.180134+01:00 uart-syslog - uart1 - [meta sequenceId="2"] xburst2 rtos',
+    b'<14>1 2024-01-18T22:46:52.180200+01:00 uart-syslog - uart1 - [meta sequenceId="3"] ' + b"x" * 300,
+]
+
+# "abc" as literals, then a match of 6 bytes at offset 3 which overlaps its own output
+COMPRESSED_BATCH = b"abcabcabc"
+COMPRESSED_FRAME = syslog_relay.FRAME_HEADER.pack(syslog_relay.FRAME_MAGIC, 9, 6) + b"\x32abc\x03\x00"
+
+
+def octet_counted(messages):
+    return b"".join(b"%d %s" % (len(m), m) for m in messages)
+
+
+class TcpListenerTest(unittest.TestCase):
+    def setUp(self):
+        self.collector = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.collector.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4 << 20)
+        self.collector.bind(("127.0.0.1", 0))
+        self.collector.settimeout(2)
+        self.server = socketserver.ThreadingTCPServer(("127.0.0.1", 0), syslog_relay.TCPHandler)
+        self.server.relay = syslog_relay.Relay(self.collector.getsockname())
+        self.server.daemon_threads = True
+        threading.Thread(target=self.server.serve_forever, daemon=True).start()
+
+    def tearDown(self):
+        self.server.shutdown()
+        self.server.server_close()
+        self.collector.close()
+
+    def send_split(self, stream, split):
+        """Send the stream as two TCP segments, split at the given position."""
+        with socket.create_connection(self.server.server_address) as conn:
+            conn.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+            conn.sendall(stream[:split])
+            time.sleep(0.001)
+            conn.sendall(stream[split:])
+
+    def receive(self, count):
+        return [self.collector.recv(65536) for _ in range(count)]
+
+    def test_messages_split_anywhere(self):
+        stream = octet_counted(MESSAGES)
+        # every split within the length prefixes and the first message, some within the rest
+        for split in list(range(1, 110)) + list(range(110, len(stream), 37)):
+            with self.subTest(split=split):
+                self.send_split(stream, split)
+                self.assertEqual(self.receive(len(MESSAGES)), MESSAGES)
+
+    def test_message_in_single_bytes(self):
+        with socket.create_connection(self.server.server_address) as conn:
+            conn.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+            for byte in octet_counted(MESSAGES[:1]):
+                conn.sendall(bytes([byte]))
+        self.assertEqual(self.receive(1), MESSAGES[:1])
+
+    def test_compressed_frame_split_anywhere(self):
+        stream = COMPRESSED_FRAME + octet_counted(MESSAGES[:1])
+        for split in range(1, len(COMPRESSED_FRAME) + 3):
+            with self.subTest(split=split):
+                self.send_split(stream, split)
+                self.assertEqual(self.receive(2), [COMPRESSED_BATCH, MESSAGES[0]])
+
+    def test_throughput(self):
+        # few enough that the datagrams fit into the receive buffer of the collector
+        messages = [MESSAGES[0] + b" #%06d" % i for i in range(2000)]
+        stream = octet_counted(messages)
+        start = time.monotonic()
+        with socket.create_connection(self.server.server_address) as conn:
+            conn.sendall(stream)
+        received = self.receive(len(messages))
+        elapsed = time.monotonic() - start
+        self.assertEqual(received, messages)
+        print(f"\n{len(messages) / elapsed:.0f} messages/s, {len(stream) / elapsed / 1e6:.1f} MB/s relayed")
+
+
+class SplitBatchTest(unittest.TestCase):
+    def test_octet_counting(self):
+        self.assertEqual(syslog_relay.split_batch(octet_counted(MESSAGES)), MESSAGES)
+
+    def test_newlines(self):
+        self.assertEqual(syslog_relay.split_batch(b"\n".join(MESSAGES) + b"\n"), MESSAGES)
+
+
+if __name__ == "__main__":
+    unittest.main()